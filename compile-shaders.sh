@@ -2,3 +2,20 @@
 
 glslc -o shaders/vert.spv -fshader-stage=vert shaders/vertex_shader.glsl
 glslc -o shaders/frag.spv -fshader-stage=frag shaders/fragment_shader.glsl
+glslc -o shaders/vert_pull.spv -fshader-stage=vert --target-env=vulkan1.2 shaders/vertex_pull_shader.glsl
+glslc -o shaders/meshlet_cull.spv -fshader-stage=comp shaders/meshlet_cull_shader.glsl
+glslc -o shaders/meshlet_cull_occlusion.spv -fshader-stage=comp -DOCCLUSION shaders/meshlet_cull_shader.glsl
+glslc -o shaders/hiz_build.spv -fshader-stage=comp shaders/hiz_build_shader.glsl
+glslc -o shaders/downsample_rgba8.spv -fshader-stage=comp -DFORMAT=rgba8 shaders/downsample_shader.glsl
+glslc -o shaders/downsample_rgba16f.spv -fshader-stage=comp -DFORMAT=rgba16f shaders/downsample_shader.glsl
+glslc -o shaders/downsample_r32f.spv -fshader-stage=comp -DFORMAT=r32f shaders/downsample_shader.glsl
+glslc -o shaders/particle_simulate.spv -fshader-stage=comp shaders/particle_simulate_shader.glsl
+glslc -o shaders/particle_sort.spv -fshader-stage=comp shaders/particle_sort_shader.glsl
+glslc -o shaders/particle_vert.spv -fshader-stage=vert shaders/particle_vertex_shader.glsl
+glslc -o shaders/particle_frag.spv -fshader-stage=frag shaders/particle_fragment_shader.glsl
+glslc -o shaders/sprite_vert.spv -fshader-stage=vert shaders/sprite_vertex_shader.glsl
+glslc -o shaders/sprite_frag.spv -fshader-stage=frag shaders/sprite_fragment_shader.glsl
+glslc -o shaders/upscale_vert.spv -fshader-stage=vert shaders/upscale_vertex_shader.glsl
+glslc -o shaders/upscale_frag.spv -fshader-stage=frag shaders/upscale_fragment_shader.glsl
+glslc -o shaders/frag_clustered.spv -fshader-stage=frag -DCLUSTERED_LIGHTING shaders/fragment_shader.glsl
+glslc -o shaders/light_cull.spv -fshader-stage=comp shaders/light_cull_shader.glsl
@@ -0,0 +1,136 @@
+#version 450
+
+// Single pass mip chain generation. Every workgroup reduces a 64x64 tile of
+// mip 0 down to one texel of mip 6, the last workgroup to finish then builds
+// the remaining levels from mip 6. Compiled once per storage format with
+// -DFORMAT=rgba8|rgba16f|r32f.
+
+#ifndef FORMAT
+#define FORMAT rgba8
+#endif
+
+#define MAX_MIPS 13
+#define FILTER_BOX 0
+#define FILTER_MIN 1
+#define FILTER_MAX 2
+
+layout(local_size_x = 256) in;
+
+layout(binding = 0, FORMAT) uniform coherent image2D mips[MAX_MIPS];
+
+layout(binding = 1) buffer Counter {
+    uint finishedWorkgroups;
+} counter;
+
+layout(push_constant) uniform Params {
+    uint mipCount;
+    uint workgroupCount;
+    uint filterMode;
+    uint srgb;
+} params;
+
+shared vec4 tile[16][16];
+shared bool isLastWorkgroup;
+
+vec4 toLinear(vec4 c) {
+    if (params.srgb == 0) {
+        return c;
+    }
+    return vec4(mix(c.rgb / 12.92, pow((c.rgb + 0.055) / 1.055, vec3(2.4)), greaterThan(c.rgb, vec3(0.04045))), c.a);
+}
+
+vec4 toStored(vec4 c) {
+    if (params.srgb == 0) {
+        return c;
+    }
+    return vec4(mix(c.rgb * 12.92, 1.055 * pow(c.rgb, vec3(1.0 / 2.4)) - 0.055, greaterThan(c.rgb, vec3(0.0031308))), c.a);
+}
+
+vec4 reduce4(vec4 a, vec4 b, vec4 c, vec4 d) {
+    if (params.filterMode == FILTER_MIN) {
+        return min(min(a, b), min(c, d));
+    } else if (params.filterMode == FILTER_MAX) {
+        return max(max(a, b), max(c, d));
+    }
+    return (a + b + c + d) * 0.25;
+}
+
+vec4 loadTexel(uint mip, ivec2 coord) {
+    ivec2 size = imageSize(mips[mip]);
+    return toLinear(imageLoad(mips[mip], clamp(coord, ivec2(0), size - 1)));
+}
+
+void storeTexel(uint mip, ivec2 coord, vec4 value) {
+    if (mip <= params.mipCount && all(lessThan(coord, imageSize(mips[mip])))) {
+        imageStore(mips[mip], coord, toStored(value));
+    }
+}
+
+vec4 reduceFrom(uint mip, ivec2 coord) {
+    return reduce4(loadTexel(mip, coord * 2),
+                   loadTexel(mip, coord * 2 + ivec2(1, 0)),
+                   loadTexel(mip, coord * 2 + ivec2(0, 1)),
+                   loadTexel(mip, coord * 2 + ivec2(1, 1)));
+}
+
+void main() {
+    uint index = gl_LocalInvocationIndex;
+    ivec2 local = ivec2(index % 16, index / 16);
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * 64;
+
+    // Mip 1 and 2: every thread owns a 2x2 block of mip 1 and the mip 2 texel it reduces to
+    ivec2 mip1Origin = tileOrigin / 2 + local * 2;
+    vec4 mip1[4];
+    for (int i = 0; i < 4; i++) {
+        ivec2 coord = mip1Origin + ivec2(i % 2, i / 2);
+        mip1[i] = reduceFrom(0, coord);
+        storeTexel(1, coord, mip1[i]);
+    }
+    vec4 value = reduce4(mip1[0], mip1[1], mip1[2], mip1[3]);
+    storeTexel(2, tileOrigin / 4 + local, value);
+    tile[local.y][local.x] = value;
+
+    // Mips 3 to 6 halve the active threads at every level and stay in shared memory
+    uint size = 16;
+    for (uint mip = 3; mip <= 6; mip++) {
+        barrier();
+        size /= 2;
+        if (index < size * size) {
+            ivec2 coord = ivec2(index % size, index / size);
+            value = reduce4(tile[coord.y * 2][coord.x * 2],
+                            tile[coord.y * 2][coord.x * 2 + 1],
+                            tile[coord.y * 2 + 1][coord.x * 2],
+                            tile[coord.y * 2 + 1][coord.x * 2 + 1]);
+            storeTexel(mip, tileOrigin / (1 << mip) + coord, value);
+        }
+        barrier();
+        if (index < size * size) {
+            tile[index / size][index % size] = value;
+        }
+    }
+
+    if (params.mipCount <= 6) {
+        return;
+    }
+
+    // Only the last workgroup to get here continues, by then mip 6 is complete
+    memoryBarrierImage();
+    barrier();
+    if (index == 0) {
+        isLastWorkgroup = atomicAdd(counter.finishedWorkgroups, 1) == params.workgroupCount - 1;
+    }
+    barrier();
+    if (!isLastWorkgroup) {
+        return;
+    }
+
+    for (uint mip = 7; mip <= params.mipCount; mip++) {
+        ivec2 mipSize = imageSize(mips[mip]);
+        for (uint texel = index; texel < uint(mipSize.x * mipSize.y); texel += 256) {
+            ivec2 coord = ivec2(texel % mipSize.x, texel / mipSize.x);
+            storeTexel(mip, coord, reduceFrom(mip - 1, coord));
+        }
+        memoryBarrierImage();
+        barrier();
+    }
+}
@@ -1,9 +1,86 @@
 #version 450
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(binding = 1) uniform sampler2D texSampler;
 
 layout(location = 0) out vec4 outColor;
 
+#ifdef CLUSTERED_LIGHTING
+// Must match ClusteredLighting.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 256
+
+layout(location = 2) in vec3 fragWorldPosition;
+layout(location = 3) in vec3 fragWorldNormal;
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(set = 1, binding = 0) uniform LightParams {
+    mat4 view;
+    mat4 inverseProj;
+    mat4 proj;
+    // Grid size and light count
+    uvec4 grid;
+    // Near and far distance, slices per log unit of depth and the slice of the near plane
+    vec4 depth;
+    vec4 ambient;
+} lightParams;
+
+layout(std430, set = 1, binding = 1) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(std430, set = 1, binding = 2) readonly buffer Clusters {
+    uint lightCounts[CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z];
+    uint lightIndices[];
+};
+
+// Sum of the lights binned into the fragment's cluster. The cluster is found from the
+// world position rather than gl_FragCoord, so any view or render scale finds the right one.
+vec3 clusterLighting(vec3 position, vec3 normal) {
+    vec4 viewPosition = lightParams.view * vec4(position, 1.0);
+    float depth = -viewPosition.z;
+    vec4 clip = lightParams.proj * viewPosition;
+    vec2 ndc = clip.xy / clip.w;
+    if (depth < lightParams.depth.x || depth >= lightParams.depth.y || any(greaterThanEqual(abs(ndc), vec2(1.0)))) {
+        return vec3(0.0);
+    }
+
+    uvec2 tile = uvec2((ndc * 0.5 + 0.5) * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y));
+    uint slice = uint(clamp(log(depth) * lightParams.depth.z + lightParams.depth.w, 0.0, float(CLUSTER_GRID_Z - 1)));
+    uint cluster = (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+
+    vec3 lighting = vec3(0.0);
+    uint count = lightCounts[cluster];
+    for (uint i = 0; i < count; i++) {
+        PointLight light = lights[lightIndices[cluster * CLUSTER_MAX_LIGHTS + i]];
+        vec3 toLight = light.positionRadius.xyz - position;
+        float distanceSquared = dot(toLight, toLight);
+        float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+        if (distanceSquared >= radiusSquared) {
+            continue;
+        }
+        // Falls off smoothly to exactly zero at the radius
+        float window = 1.0 - distanceSquared / radiusSquared;
+        float attenuation = window * window;
+        float lambert = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1e-8))), 0.0);
+        lighting += light.color.rgb * (attenuation * lambert);
+    }
+    return lighting;
+}
+#endif
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    outColor = vec4(fragColor, 1.0) * texture(texSampler, fragTexCoord);
+#ifdef CLUSTERED_LIGHTING
+    vec3 normal = normalize(fragWorldNormal);
+    outColor.rgb *= lightParams.ambient.rgb + clusterLighting(fragWorldPosition, normal);
+#endif
+}
@@ -0,0 +1,43 @@
+#version 450
+
+// One level of the Hi-Z pyramid per dispatch, every texel keeps the farthest
+// depth of the area it covers. Level 0 reduces the full resolution depth
+// image, whose size is not a power of two, so each texel takes the max over
+// every depth pixel its footprint touches. Later levels are exact 2x2 reductions.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D depth;
+layout(binding = 1, r32f) uniform readonly image2D source;
+layout(binding = 2, r32f) uniform writeonly image2D destination;
+
+// Must match HiZBuildParams in HiZBuffer.cpp
+layout(push_constant) uniform Params {
+    ivec2 sourceSize;
+    ivec2 destinationSize;
+    uint fromDepth;
+} params;
+
+void main() {
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(coord, params.destinationSize))) {
+        return;
+    }
+
+    float farthest = 0.0;
+    if (params.fromDepth != 0) {
+        ivec2 first = (coord * params.sourceSize) / params.destinationSize;
+        ivec2 last = min(((coord + 1) * params.sourceSize + params.destinationSize - 1) / params.destinationSize, params.sourceSize);
+        for (int y = first.y; y < last.y; y++) {
+            for (int x = first.x; x < last.x; x++) {
+                farthest = max(farthest, texelFetch(depth, ivec2(x, y), 0).r);
+            }
+        }
+    } else {
+        ivec2 base = coord * 2;
+        ivec2 maxCoord = params.sourceSize - 1;
+        farthest = max(max(imageLoad(source, min(base, maxCoord)).r, imageLoad(source, min(base + ivec2(1, 0), maxCoord)).r),
+                       max(imageLoad(source, min(base + ivec2(0, 1), maxCoord)).r, imageLoad(source, min(base + ivec2(1, 1), maxCoord)).r));
+    }
+    imageStore(destination, coord, vec4(farthest));
+}
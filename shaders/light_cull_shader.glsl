@@ -0,0 +1,104 @@
+#version 450
+
+// Must match ClusteredLighting.h
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_MAX_LIGHTS 256
+
+// One workgroup per cluster, the invocations share out the lights
+layout(local_size_x = 64) in;
+
+struct PointLight {
+    vec4 positionRadius;
+    vec4 color;
+};
+
+layout(binding = 0) uniform LightParams {
+    mat4 view;
+    mat4 inverseProj;
+    mat4 proj;
+    // Grid size and light count
+    uvec4 grid;
+    // Near and far distance, slices per log unit of depth and the slice of the near plane
+    vec4 depth;
+    vec4 ambient;
+} params;
+
+layout(std430, binding = 1) readonly buffer Lights {
+    PointLight lights[];
+};
+
+layout(std430, binding = 2) writeonly buffer Clusters {
+    uint lightCounts[CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z];
+    uint lightIndices[];
+};
+
+shared vec3 clusterMin;
+shared vec3 clusterMax;
+shared uint clusterLightCount;
+shared uint clusterLights[CLUSTER_MAX_LIGHTS];
+
+// View space point where the ray through an NDC position reaches a distance in front of the camera
+vec3 pointAtDepth(vec2 ndc, float depth) {
+    vec4 onNear = params.inverseProj * vec4(ndc, -1.0, 1.0);
+    vec3 point = onNear.xyz / onNear.w;
+    return point * (depth / -point.z);
+}
+
+// Slice k starts at near * (far / near)^(k / slices)
+float sliceDepth(uint slice) {
+    return params.depth.x * pow(params.depth.y / params.depth.x, float(slice) / float(CLUSTER_GRID_Z));
+}
+
+void main() {
+    uvec3 cell = gl_WorkGroupID;
+    uint cluster = (cell.z * CLUSTER_GRID_Y + cell.y) * CLUSTER_GRID_X + cell.x;
+
+    if (gl_LocalInvocationIndex == 0) {
+        // Bounding box of the froxel's eight corners
+        vec2 ndcMin = vec2(cell.xy) / vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y) * 2.0 - 1.0;
+        vec2 ndcMax = vec2(cell.xy + 1) / vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y) * 2.0 - 1.0;
+        float nearDepth = sliceDepth(cell.z);
+        float farDepth = sliceDepth(cell.z + 1);
+
+        vec3 corners[8] = vec3[8](
+            pointAtDepth(ndcMin, nearDepth), pointAtDepth(vec2(ndcMax.x, ndcMin.y), nearDepth),
+            pointAtDepth(vec2(ndcMin.x, ndcMax.y), nearDepth), pointAtDepth(ndcMax, nearDepth),
+            pointAtDepth(ndcMin, farDepth), pointAtDepth(vec2(ndcMax.x, ndcMin.y), farDepth),
+            pointAtDepth(vec2(ndcMin.x, ndcMax.y), farDepth), pointAtDepth(ndcMax, farDepth));
+        vec3 boxMin = corners[0];
+        vec3 boxMax = corners[0];
+        for (int i = 1; i < 8; i++) {
+            boxMin = min(boxMin, corners[i]);
+            boxMax = max(boxMax, corners[i]);
+        }
+        clusterMin = boxMin;
+        clusterMax = boxMax;
+        clusterLightCount = 0;
+    }
+    barrier();
+
+    uint lightCount = params.grid.w;
+    for (uint i = gl_LocalInvocationIndex; i < lightCount; i += gl_WorkGroupSize.x) {
+        vec4 positionRadius = lights[i].positionRadius;
+        vec3 center = (params.view * vec4(positionRadius.xyz, 1.0)).xyz;
+        vec3 closest = clamp(center, clusterMin, clusterMax);
+        vec3 offset = center - closest;
+        if (dot(offset, offset) <= positionRadius.w * positionRadius.w) {
+            uint slot = atomicAdd(clusterLightCount, 1);
+            if (slot < CLUSTER_MAX_LIGHTS) {
+                clusterLights[slot] = i;
+            }
+        }
+    }
+    barrier();
+
+    uint count = min(clusterLightCount, CLUSTER_MAX_LIGHTS);
+    for (uint i = gl_LocalInvocationIndex; i < count; i += gl_WorkGroupSize.x) {
+        lightIndices[cluster * CLUSTER_MAX_LIGHTS + i] = clusterLights[i];
+    }
+    if (gl_LocalInvocationIndex == 0) {
+        lightCounts[cluster] = count;
+    }
+}
@@ -0,0 +1,148 @@
+#version 450
+
+// Must match MESHLET_MAX_TRIANGLES in Meshlet.h, rounded up
+layout(local_size_x = 128) in;
+
+struct Meshlet {
+    vec3 center;
+    float radius;
+    vec3 coneAxis;
+    float coneCutoff;
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+layout(std430, binding = 0) readonly buffer Meshlets {
+    Meshlet meshlets[];
+};
+
+layout(std430, binding = 1) readonly buffer MeshletVertices {
+    uint meshletVertices[];
+};
+
+layout(std430, binding = 2) readonly buffer MeshletTriangles {
+    uint meshletTriangles[];
+};
+
+layout(std430, binding = 3) writeonly buffer Indices {
+    uint indices[];
+};
+
+layout(std430, binding = 4) buffer DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+} draw;
+
+// Frustum and eye in the mesh's object space, the full transform and the
+// pyramid's level 0 size in xy and mip count in z
+layout(std140, binding = 5) uniform CullParams {
+    vec4 planes[6];
+    vec4 cameraPosition;
+    mat4 modelViewProjection;
+    vec4 hizSize;
+} params;
+
+// Must match MESHLET_CULL_* in MeshletCuller.cpp
+const uint MODE_LAST_VISIBLE = 1;
+const uint MODE_OCCLUSION = 2;
+
+// Workgroup i culls meshlet firstMeshlet + i
+layout(push_constant) uniform CullConstants {
+    uint firstMeshlet;
+    uint mode;
+} constants;
+
+#ifdef OCCLUSION
+layout(std430, binding = 6) buffer Visibility {
+    uint visibility[];
+};
+
+layout(binding = 7) uniform sampler2D hiz;
+
+// Projects the box around the bounding sphere and compares its nearest depth with
+// the farthest depth of the pyramid texels under it. Picks the level where the box
+// covers at most 2x2 texels, boxes crossing the near plane always pass.
+bool isOccluded(Meshlet meshlet) {
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = meshlet.center + meshlet.radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = params.modelViewProjection * vec4(corner, 1.0);
+        if (clip.w <= 0.0) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearest = min(nearest, ndc.z);
+    }
+    uvMin = clamp(uvMin, 0.0, 1.0);
+    uvMax = clamp(uvMax, 0.0, 1.0);
+
+    vec2 extent = (uvMax - uvMin) * params.hizSize.xy;
+    int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    level = min(level, int(params.hizSize.z) - 1);
+
+    ivec2 levelSize = max(ivec2(params.hizSize.xy) >> level, ivec2(1));
+    ivec2 lo = min(ivec2(uvMin * vec2(levelSize)), levelSize - 1);
+    ivec2 hi = min(ivec2(uvMax * vec2(levelSize)), levelSize - 1);
+    float farthest = max(max(texelFetch(hiz, lo, level).r, texelFetch(hiz, ivec2(hi.x, lo.y), level).r),
+                         max(texelFetch(hiz, ivec2(lo.x, hi.y), level).r, texelFetch(hiz, hi, level).r));
+    return nearest > farthest;
+}
+#endif
+
+shared bool visible;
+shared uint baseIndex;
+
+void main() {
+    uint meshletIndex = constants.firstMeshlet + gl_WorkGroupID.x;
+    Meshlet meshlet = meshlets[meshletIndex];
+
+    if (gl_LocalInvocationIndex == 0) {
+        visible = true;
+        for (int i = 0; i < 6; i++) {
+            if (dot(params.planes[i].xyz, meshlet.center) + params.planes[i].w < -meshlet.radius) {
+                visible = false;
+            }
+        }
+
+        vec3 toCenter = meshlet.center - params.cameraPosition.xyz;
+        if (visible && dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * length(toCenter) + meshlet.radius) {
+            visible = false;
+        }
+
+#ifdef OCCLUSION
+        if ((constants.mode & MODE_LAST_VISIBLE) != 0) {
+            visible = visible && visibility[meshletIndex] != 0;
+        }
+        if ((constants.mode & MODE_OCCLUSION) != 0) {
+            visible = visible && !isOccluded(meshlet);
+            visibility[meshletIndex] = visible ? 1 : 0;
+        }
+#endif
+
+        if (visible) {
+            baseIndex = atomicAdd(draw.indexCount, meshlet.triangleCount * 3);
+        }
+    }
+    barrier();
+
+    uint triangle = gl_LocalInvocationIndex;
+    if (!visible || triangle >= meshlet.triangleCount) {
+        return;
+    }
+
+    uint packed = meshletTriangles[meshlet.triangleOffset + triangle];
+    uint index = baseIndex + triangle * 3;
+    indices[index + 0] = meshletVertices[meshlet.vertexOffset + (packed & 0xFF)];
+    indices[index + 1] = meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xFF)];
+    indices[index + 2] = meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xFF)];
+}
@@ -0,0 +1,173 @@
+#version 450
+
+// Must match PARTICLE_GROUP_SIZE in ParticleSystem.cpp
+layout(local_size_x = 256) in;
+
+// Must match PARTICLE_PASS_* in ParticleSystem.cpp
+const uint PASS_SIMULATE = 0;
+const uint PASS_EMIT_PREPARE = 1;
+const uint PASS_EMIT = 2;
+const uint PASS_FINALIZE = 3;
+
+// Must match PARTICLE_MEAN_LIFETIME in ParticleSystem.cpp, the middle of the range
+const float MIN_LIFETIME = 1.5;
+const float MAX_LIFETIME = 2.5;
+const vec3 GRAVITY = vec3(0.0, 0.0, -2.0);
+
+// Alive count, the next step's dispatch size and the draw, must match ParticleArgs
+struct Args {
+    uint aliveCount;
+    uint simulateX;
+    uint simulateY;
+    uint simulateZ;
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+};
+
+// Position and age, velocity and lifetime
+layout(std430, binding = 0) readonly buffer InputPositions {
+    vec4 inputPositions[];
+};
+layout(std430, binding = 1) readonly buffer InputVelocities {
+    vec4 inputVelocities[];
+};
+layout(std430, binding = 2) readonly buffer InputAlive {
+    uint inputAlive[];
+};
+layout(std430, binding = 3) readonly buffer InputArgs {
+    Args inputArgs;
+};
+
+layout(std430, binding = 4) buffer OutputPositions {
+    vec4 outputPositions[];
+};
+layout(std430, binding = 5) buffer OutputVelocities {
+    vec4 outputVelocities[];
+};
+layout(std430, binding = 6) buffer OutputAlive {
+    uint outputAlive[];
+};
+layout(std430, binding = 7) buffer OutputArgs {
+    Args outputArgs;
+};
+// Sort key (inverted view depth, so the farthest comes first) and particle index
+layout(std430, binding = 8) writeonly buffer Sorted {
+    uvec2 sorted[];
+};
+
+// Free particle indices, the first deadCount are valid
+layout(std430, binding = 9) buffer Dead {
+    uint dead[];
+};
+layout(std430, binding = 10) buffer Counters {
+    uint deadCount;
+    uint emitCount;
+} counters;
+
+layout(push_constant) uniform SimulateConstants {
+    vec4 cameraPosition;
+    vec4 cameraForward;
+    float deltaTime;
+    float time;
+    uint emitCount;
+    uint pass;
+} constants;
+
+uint hash(uint value) {
+    value ^= value >> 16;
+    value *= 0x7feb352dU;
+    value ^= value >> 15;
+    value *= 0x846ca68bU;
+    value ^= value >> 16;
+    return value;
+}
+
+float random(inout uint state) {
+    state = hash(state);
+    return float(state >> 8) / 16777216.0;
+}
+
+void simulate(uint index) {
+    if (index >= inputArgs.aliveCount) {
+        return;
+    }
+    uint particle = inputAlive[index];
+    vec4 position = inputPositions[particle];
+    vec4 velocity = inputVelocities[particle];
+
+    position.w += constants.deltaTime;
+    if (position.w >= velocity.w) {
+        dead[atomicAdd(counters.deadCount, 1)] = particle;
+        return;
+    }
+
+    velocity.xyz += GRAVITY * constants.deltaTime;
+    position.xyz += velocity.xyz * constants.deltaTime;
+    // Bounce off the ground plane the scene sits on
+    if (position.z < 0.0) {
+        position.z = -position.z;
+        velocity.z = -velocity.z * 0.5;
+    }
+
+    outputPositions[particle] = position;
+    outputVelocities[particle] = velocity;
+    outputAlive[atomicAdd(outputArgs.aliveCount, 1)] = particle;
+}
+
+void emit(uint index) {
+    if (index >= counters.emitCount) {
+        return;
+    }
+    // The prepare pass already took the emitted particles off the top of the free list
+    uint particle = dead[counters.deadCount + index];
+
+    uint state = hash(index ^ hash(floatBitsToUint(constants.time)));
+    float angle = random(state) * 6.2831853;
+    float spread = random(state) * 0.6;
+    float speed = 1.2 + random(state) * 0.6;
+    vec3 direction = normalize(vec3(cos(angle) * spread, sin(angle) * spread, 1.0));
+
+    outputPositions[particle] = vec4(0.0, 0.0, 0.0, 0.0);
+    outputVelocities[particle] = vec4(direction * speed, mix(MIN_LIFETIME, MAX_LIFETIME, random(state)));
+    outputAlive[atomicAdd(outputArgs.aliveCount, 1)] = particle;
+}
+
+void finalize(uint index) {
+    uint aliveCount = outputArgs.aliveCount;
+    if (index == 0) {
+        outputArgs.simulateX = (aliveCount + gl_WorkGroupSize.x - 1) / gl_WorkGroupSize.x;
+        outputArgs.simulateY = 1;
+        outputArgs.simulateZ = 1;
+        outputArgs.vertexCount = 6;
+        outputArgs.instanceCount = aliveCount;
+        outputArgs.firstVertex = 0;
+        outputArgs.firstInstance = 0;
+    }
+
+    // Padding sorts after every particle, depth is clamped so no key reaches it
+    if (index >= aliveCount) {
+        sorted[index] = uvec2(0xFFFFFFFFU, 0);
+        return;
+    }
+    uint particle = outputAlive[index];
+    float depth = max(dot(outputPositions[particle].xyz - constants.cameraPosition.xyz, constants.cameraForward.xyz), 1e-6);
+    sorted[index] = uvec2(~floatBitsToUint(depth), particle);
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (constants.pass == PASS_SIMULATE) {
+        simulate(index);
+    } else if (constants.pass == PASS_EMIT_PREPARE) {
+        if (index == 0) {
+            counters.emitCount = min(constants.emitCount, counters.deadCount);
+            counters.deadCount -= counters.emitCount;
+        }
+    } else if (constants.pass == PASS_EMIT) {
+        emit(index);
+    } else {
+        finalize(index);
+    }
+}
@@ -0,0 +1,63 @@
+#version 450
+
+// Every workgroup handles one block of 1024 pairs, must match PARTICLE_SORT_BLOCK in ParticleSystem.cpp
+#define BLOCK 1024
+layout(local_size_x = BLOCK / 2) in;
+
+// Sort key and particle index, sorted by ascending key
+layout(std430, binding = 0) buffer Sorted {
+    uvec2 sorted[];
+};
+
+// k is the size of the bitonic sequences being merged, j the compare distance.
+// k == 0 sorts every block on its own. A j of at least one block is a single
+// global pass, j == 0 runs all distances below a block in shared memory.
+layout(push_constant) uniform SortConstants {
+    uint k;
+    uint j;
+} constants;
+
+shared uvec2 block[BLOCK];
+
+void main() {
+    uint thread = gl_LocalInvocationID.x;
+
+    if (constants.j >= BLOCK) {
+        uint pair = gl_GlobalInvocationID.x;
+        uint i = 2 * constants.j * (pair / constants.j) + pair % constants.j;
+        uint l = i + constants.j;
+        bool ascending = (i & constants.k) == 0;
+        uvec2 a = sorted[i];
+        uvec2 b = sorted[l];
+        if ((a.x > b.x) == ascending) {
+            sorted[i] = b;
+            sorted[l] = a;
+        }
+        return;
+    }
+
+    uint base = gl_WorkGroupID.x * BLOCK;
+    block[thread] = sorted[base + thread];
+    block[thread + BLOCK / 2] = sorted[base + thread + BLOCK / 2];
+    barrier();
+
+    uint firstK = constants.k == 0 ? 2 : constants.k;
+    uint lastK = constants.k == 0 ? BLOCK : constants.k;
+    for (uint k = firstK; k <= lastK; k *= 2) {
+        for (uint j = min(k / 2, BLOCK / 2); j > 0; j /= 2) {
+            uint i = 2 * j * (thread / j) + thread % j;
+            uint l = i + j;
+            bool ascending = ((base + i) & k) == 0;
+            uvec2 a = block[i];
+            uvec2 b = block[l];
+            if ((a.x > b.x) == ascending) {
+                block[i] = b;
+                block[l] = a;
+            }
+            barrier();
+        }
+    }
+
+    sorted[base + thread] = block[thread];
+    sorted[base + thread + BLOCK / 2] = block[thread + BLOCK / 2];
+}
@@ -0,0 +1,40 @@
+#version 450
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragOffset;
+
+// Position and age, velocity and lifetime of the set drawn
+layout(std430, binding = 0) readonly buffer Positions {
+    vec4 positions[];
+};
+layout(std430, binding = 1) readonly buffer Velocities {
+    vec4 velocities[];
+};
+// Particle indices in y, back to front
+layout(std430, binding = 2) readonly buffer Sorted {
+    uvec2 sorted[];
+};
+
+// Camera right with the particle size in w, and camera up
+layout(push_constant) uniform DrawConstants {
+    mat4 viewProjection;
+    vec4 right;
+    vec4 up;
+} constants;
+
+const vec2 corners[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0), vec2(-1.0, -1.0));
+
+void main() {
+    uint particle = sorted[gl_InstanceIndex].y;
+    vec4 position = positions[particle];
+    vec4 velocity = velocities[particle];
+
+    vec2 corner = corners[gl_VertexIndex];
+    vec3 world = position.xyz + (constants.right.xyz * corner.x + constants.up.xyz * corner.y) * constants.right.w;
+    gl_Position = constants.viewProjection * vec4(world, 1.0);
+
+    // Hot and opaque at birth, cooling and fading out towards the end of the lifetime
+    float life = clamp(position.w / velocity.w, 0.0, 1.0);
+    fragColor = vec4(mix(vec3(1.0, 0.8, 0.3), vec3(0.6, 0.1, 0.05), life), 1.0 - life);
+    fragOffset = corner;
+}
@@ -0,0 +1,21 @@
+#version 450
+
+// Pixels, texture coordinates and color, must match SpriteVertex
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+// Maps pixels to clip space, must match SpriteConstants in SpriteBatcher.cpp
+layout(push_constant) uniform SpriteConstants {
+    vec2 scale;
+    vec2 offset;
+} constants;
+
+void main() {
+    gl_Position = vec4(inPosition * constants.scale + constants.offset, 0.0, 1.0);
+    fragTexCoord = inTexCoord;
+    fragColor = inColor;
+}
@@ -0,0 +1,39 @@
+#version 450
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+layout(binding = 0) uniform sampler2D scene;
+
+// Must match UpscaleConstants in DynamicResolution.cpp
+layout(push_constant) uniform UpscaleConstants {
+    // Rendered area over the target's size
+    vec2 uvScale;
+    // One target texel in texture coordinates
+    vec2 texelSize;
+    float sharpness;
+} constants;
+
+void main() {
+    // Half a texel inside the rendered area, so the bilinear filter never blends in
+    // texels beyond it that hold an older, larger frame
+    vec2 limit = constants.uvScale - 0.5 * constants.texelSize;
+    vec2 uv = min(fragTexCoord * constants.uvScale, limit);
+    vec3 color = texture(scene, uv).rgb;
+
+    if (constants.sharpness > 0.0) {
+        vec3 left = texture(scene, uv - vec2(constants.texelSize.x, 0.0)).rgb;
+        vec3 right = texture(scene, min(uv + vec2(constants.texelSize.x, 0.0), limit)).rgb;
+        vec3 up = texture(scene, uv - vec2(0.0, constants.texelSize.y)).rgb;
+        vec3 down = texture(scene, min(uv + vec2(0.0, constants.texelSize.y), limit)).rgb;
+
+        // Unsharp mask against the four neighbours, clamped to their range so edges do not ring
+        vec3 sharpened = color + (4.0 * color - left - right - up - down) * constants.sharpness;
+        vec3 low = min(color, min(min(left, right), min(up, down)));
+        vec3 high = max(color, max(max(left, right), max(up, down)));
+        color = clamp(sharpened, low, high);
+    }
+
+    outColor = vec4(color, 1.0);
+}
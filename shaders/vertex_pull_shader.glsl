@@ -0,0 +1,70 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+// Must match VertexLayoutFlags in GeometryBuffer.h
+#define VERTEX_LAYOUT_POSITION_3D 1u
+#define VERTEX_LAYOUT_COLOR 2u
+#define VERTEX_LAYOUT_TEXCOORD 4u
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VertexWords {
+    float words[];
+};
+
+layout(push_constant) uniform PushConstants {
+    VertexWords vertices;
+    uint vertexStride;
+    uint vertexLayout;
+} pc;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPosition;
+layout(location = 3) out vec3 fragWorldNormal;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+    uint instancesPerRow;
+} ubo;
+
+// Must match App::createSceneIndex: each instance is scaled down to one cell of a
+// square grid over [-0.5, 0.5], a single instance stays where it is
+vec3 instancePosition(vec3 position) {
+    uint instance = uint(gl_InstanceIndex);
+    uint row = instance / ubo.instancesPerRow;
+    uint column = instance % ubo.instancesPerRow;
+    float cell = 1.0 / float(ubo.instancesPerRow);
+    vec2 offset = (vec2(column, row) + 0.5) * cell - 0.5;
+    return vec3(position.xy * cell + offset, position.z);
+}
+
+void main() {
+    uint word = gl_VertexIndex * pc.vertexStride;
+
+    vec3 position = vec3(pc.vertices.words[word], pc.vertices.words[word + 1], 0.0);
+    word += 2;
+    if ((pc.vertexLayout & VERTEX_LAYOUT_POSITION_3D) != 0) {
+        position.z = pc.vertices.words[word];
+        word += 1;
+    }
+
+    vec3 color = vec3(1.0);
+    if ((pc.vertexLayout & VERTEX_LAYOUT_COLOR) != 0) {
+        color = vec3(pc.vertices.words[word], pc.vertices.words[word + 1], pc.vertices.words[word + 2]);
+        word += 3;
+    }
+
+    vec2 texCoord = vec2(0.0);
+    if ((pc.vertexLayout & VERTEX_LAYOUT_TEXCOORD) != 0) {
+        texCoord = vec2(pc.vertices.words[word], pc.vertices.words[word + 1]);
+    }
+
+    vec4 worldPosition = ubo.model * vec4(instancePosition(position), 1.0);
+    gl_Position = ubo.proj * ubo.view * worldPosition;
+    fragColor = color;
+    fragTexCoord = texCoord;
+    // Vertices carry no normal, meshes lie in or close to their z = 0 plane
+    fragWorldPosition = worldPosition.xyz;
+    fragWorldNormal = mat3(ubo.model) * vec3(0.0, 0.0, 1.0);
+}
@@ -2,16 +2,37 @@
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragWorldPosition;
+layout(location = 3) out vec3 fragWorldNormal;
 
 layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+    uint instancesPerRow;
 } ubo;
 
+// Must match App::createSceneIndex: each instance is scaled down to one cell of a
+// square grid over [-0.5, 0.5], a single instance stays where it is
+vec3 instancePosition(vec3 position) {
+    uint instance = uint(gl_InstanceIndex);
+    uint row = instance / ubo.instancesPerRow;
+    uint column = instance % ubo.instancesPerRow;
+    float cell = 1.0 / float(ubo.instancesPerRow);
+    vec2 offset = (vec2(column, row) + 0.5) * cell - 0.5;
+    return vec3(position.xy * cell + offset, position.z);
+}
+
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
+    vec4 worldPosition = ubo.model * vec4(instancePosition(vec3(inPosition, 0.0)), 1.0);
+    gl_Position = ubo.proj * ubo.view * worldPosition;
     fragColor = inColor;
+    fragTexCoord = inTexCoord;
+    // Vertices carry no normal, the mesh lies in its z = 0 plane
+    fragWorldPosition = worldPosition.xyz;
+    fragWorldNormal = mat3(ubo.model) * vec3(0.0, 0.0, 1.0);
 }
@@ -1,20 +1,34 @@
 #include "App.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <cstring>
-#include <iostream>
+#include <exception>
+#include <iomanip>
+#include <limits>
+#include <random>
 #include <set>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 
-#include "utils.h"
+#include <glm/gtc/constants.hpp>
 
-#define UNI_RED "\033[0;31m"
-#define UNI_GREEN "\033[0;32m"
-#define UNI_YELLOW "\033[0;33m"
-#define UNI_BLUE "\033[0;34m"
-#define UNI_REDBACK "\033[41m"
-#define UNI_RESET "\033[0m"
+#include "Logger.h"
+#include "utils.h"
 
 #define MAX_FRAMES_IN_FLIGHT 2
+#define TEXTURE_BUDGET_MB 256
+#define GEOMETRY_BUFFER_MB 64
+#define MEMORY_BUDGET_POLL_FRAMES 60
+#define SPRITE_OVERLAY_QUADS 4096
+#define ON_DEMAND_WAIT_SECONDS 0.5
+// Lights reaching an average point of the mesh, and the light every fragment gets
+#define LIGHT_OVERLAP 8.0f
+#define LIGHT_AMBIENT 0.1f
+
+#define STARTUP_STEP(step) _startup.measure(#step, [this]() { step(); })
 
 void keyCallback(GLFWwindow *_window, int key, int scancode, int action, int mods) {
     (void)scancode;
@@ -22,6 +36,12 @@ void keyCallback(GLFWwindow *_window, int key, int scancode, int action, int mod
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
         glfwSetWindowShouldClose(_window, GLFW_TRUE);
     }
+
+    auto app = reinterpret_cast<App *>(glfwGetWindowUserPointer(_window));
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+        app->toggleAnimation();
+    }
+    app->_redrawRequested = true;
 }
 
 VkVertexInputBindingDescription Vertex::getBindingDescription() {
@@ -33,8 +53,8 @@ VkVertexInputBindingDescription Vertex::getBindingDescription() {
     return bindingDescription;
 }
 
-std::array<VkVertexInputAttributeDescription, 2> Vertex::getAttributeDescriptions() {
-    std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {};
+std::array<VkVertexInputAttributeDescription, 3> Vertex::getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
 
     attributeDescriptions[0].binding = 0;
     attributeDescriptions[0].location = 0;
@@ -46,6 +66,11 @@ std::array<VkVertexInputAttributeDescription, 2> Vertex::getAttributeDescription
     attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
     attributeDescriptions[1].offset = offsetof(Vertex, color);
 
+    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
+
     return attributeDescriptions;
 }
 
@@ -86,8 +111,29 @@ static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
     app->_framebufferResized = true;
 }
 
+// The window was uncovered or needs repainting for another reason the scene does not know about
+static void windowRefreshCallback(GLFWwindow *window) {
+    auto app = reinterpret_cast<App *>(glfwGetWindowUserPointer(window));
+    app->_redrawRequested = true;
+}
+
+static void viewResizeCallback(GLFWwindow *window, int width, int height) {
+    (void)width;
+    (void)height;
+    auto view = reinterpret_cast<SurfaceView *>(glfwGetWindowUserPointer(window));
+    view->resized = true;
+}
+
+App::App(const AppOptions &options) : _options(options) {
+}
+
 void App::run() {
-    initWindow();
+    Profiler::get().setThreadName("main");
+    if (!_options.replayFile.empty() || _options.replayTrace) {
+        _loadReplay();
+    }
+    _startup.begin();
+    STARTUP_STEP(initWindow);
     initVulkan();
     mainLoop();
     cleanup();
@@ -97,43 +143,142 @@ void App::initWindow() {
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+    // A replay keeps the captured size and needs no window on screen
+    bool replaying = !_replay.frames.empty();
+    glfwWindowHint(GLFW_RESIZABLE, replaying ? GLFW_FALSE : GLFW_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, replaying ? GLFW_FALSE : GLFW_TRUE);
 
     _window = glfwCreateWindow(_width, _height, "Vulkan", nullptr, nullptr);
     glfwSetWindowUserPointer(_window, this);
     glfwSetFramebufferSizeCallback(_window, framebufferResizeCallback);
     glfwSetKeyCallback(_window, keyCallback);
+    glfwSetWindowRefreshCallback(_window, windowRefreshCallback);
+}
+
+void App::toggleAnimation() {
+    _simulation.setPaused(!_simulation.isPaused());
+    LOG_INFO(_simulation.isPaused() ? "Animation paused" : "Animation resumed");
 }
 
 void App::mainLoop() {
+    bool replaying = !_replay.frames.empty();
+    if (replaying) {
+        _replayStart = _replayLastPresent = std::chrono::steady_clock::now();
+    } else {
+        _simulation.start(_options.simulationRate);
+    }
+
+    // Replays always render every frame as fast as possible
+    bool onDemand = _options.onDemand && !replaying;
+    if (onDemand) {
+        _simulation.setPaused(true);
+        LOG_INFO("Rendering on demand, space toggles the animation");
+    }
+
     while (!glfwWindowShouldClose(_window)) {
+        if (onDemand && !_needsRedraw()) {
+            // The frame on screen is still current. Events wake the loop up, the timeout
+            // catches whatever changes without one.
+            glfwWaitEventsTimeout(ON_DEMAND_WAIT_SECONDS);
+            continue;
+        }
+
         glfwPollEvents();
+        _redrawRequested = false;
         _drawFrame();
+        if (_frameCount == 1) {
+            _startup.markFirstFrame();
+        }
+
+        if (_options.maxFrames > 0 && _frameCount >= _options.maxFrames) {
+            break;
+        }
+        if (replaying && _replayLoop >= _options.replayLoops) {
+            break;
+        }
     }
 
+    _simulation.stop();
     vkDeviceWaitIdle(_device);
+    LOG_INFO("Recorded ", _recordedFrames, " command buffers for ", _frameCount, " frames");
+    if (replaying) {
+        _reportReplay();
+        _replayStats.deviceName = _deviceProfile.properties.deviceName;
+        _replayStats.startupMilliseconds = _startup.getTimeToFirstFrame();
+        _replayStats.cpuFrameTimes = _replayFrameTimes;
+        _replayStats.gpuFrameTimes = _gpuTimer.getFrameTimes();
+        _replayStats.peakMemoryBytes = MemoryTelemetry::get().getTotalCounters().peakBytes;
+    }
 }
 
 void App::initVulkan() {
-    createInstance();
-    createSurface();
-    setupDebugMessenger();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createFrameBuffers();
-    createCommandPool();
-    createVertexBuffer();
-    createIndexBuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffer();
-    createSyncObjects();
+    // Reading SPIR-V does not need a device, overlap it with instance and device creation
+    _shaderCode = std::async(std::launch::async, []() {
+        return std::array<std::vector<char>, 4>{Utils::readFile("shaders/vert.spv"), Utils::readFile("shaders/frag.spv"), Utils::readFile("shaders/vert_pull.spv"),
+                                                Utils::readFile("shaders/frag_clustered.spv")};
+    });
+
+    STARTUP_STEP(createInstance);
+    STARTUP_STEP(createSurface);
+    STARTUP_STEP(setupDebugMessenger);
+    STARTUP_STEP(pickPhysicalDevice);
+    STARTUP_STEP(createLogicalDevice);
+    STARTUP_STEP(createSwapChain);
+    STARTUP_STEP(createImageViews);
+    STARTUP_STEP(createRenderPass);
+    STARTUP_STEP(createDescriptorSetLayout);
+
+    // Pipeline compilation only needs the render pass and layouts, so it runs as a
+    // job while the render thread creates attachments and uploads buffers and textures
+    JobCounter pipelineJob;
+    std::exception_ptr pipelineError;
+    _jobSystem.run("createGraphicsPipeline", [this, &pipelineError]() {
+        try {
+            STARTUP_STEP(createGraphicsPipeline);
+        } catch (...) {
+            pipelineError = std::current_exception();
+        }
+    }, &pipelineJob);
+
+    // The job references this frame, so it has to finish even if a step below throws
+    std::exception_ptr initError;
+    try {
+        STARTUP_STEP(createColorResources);
+        STARTUP_STEP(createDepthResources);
+        STARTUP_STEP(createFrameBuffers);
+        STARTUP_STEP(createCommandPool);
+        STARTUP_STEP(createMeshLods);
+        STARTUP_STEP(createSceneIndex);
+        STARTUP_STEP(createVertexBuffer);
+        STARTUP_STEP(createIndexBuffer);
+        STARTUP_STEP(createGeometryBuffer);
+        STARTUP_STEP(createMeshlets);
+        STARTUP_STEP(createOcclusionCulling);
+        STARTUP_STEP(createTextureStreamer);
+        STARTUP_STEP(createUniformBuffers);
+        STARTUP_STEP(createDescriptorPool);
+        STARTUP_STEP(createDescriptorSets);
+        STARTUP_STEP(createCommandBuffer);
+        STARTUP_STEP(createSyncObjects);
+        STARTUP_STEP(createFrameCapture);
+        STARTUP_STEP(createGpuTimer);
+        STARTUP_STEP(createTraceRecorder);
+        STARTUP_STEP(createSyntheticLoad);
+        STARTUP_STEP(createParticles);
+        STARTUP_STEP(createSpriteBatcher);
+        STARTUP_STEP(createLighting);
+        STARTUP_STEP(createViews);
+    } catch (...) {
+        initError = std::current_exception();
+    }
+
+    _jobSystem.wait(pipelineJob);
+    if (initError) {
+        std::rethrow_exception(initError);
+    }
+    if (pipelineError) {
+        std::rethrow_exception(pipelineError);
+    }
 }
 
 void App::createInstance() {
@@ -147,7 +292,9 @@ void App::createInstance() {
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.pEngineName = "No Engine";
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // Newer versions are only used where the device supports them too
+    _instanceApiVersion = DeviceCapabilities::instanceApiVersion();
+    appInfo.apiVersion = _instanceApiVersion;
 
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -157,7 +304,7 @@ void App::createInstance() {
     if (!_checkExtensions(extensions)) {
         throw std::runtime_error("Required extensions not available!");
     } else {
-        std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Required extensions available!" << std::endl;
+        LOG_INFO("Required extensions available!");
     }
 
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
@@ -178,7 +325,7 @@ void App::createInstance() {
     VkResult result = vkCreateInstance(&createInfo, nullptr, &_instance);
     if (result != VK_SUCCESS) {
         // Log the error type
-        std::cerr << "Error: " << result << std::endl;
+        LOG_ERROR("vkCreateInstance returned ", result);
         throw std::runtime_error("Failed to create instance!");
     }
 }
@@ -188,7 +335,7 @@ void App::createSurface() {
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create window surface!");
     }
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Window surface created!" << std::endl;
+    LOG_INFO("Window surface created!");
 }
 
 void App::setupDebugMessenger() {
@@ -211,22 +358,53 @@ void App::pickPhysicalDevice() {
     }
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(_instance, &deviceCount, devices.data());
-    for (const auto &device : devices) {
-        if (_isDeviceSuitable(device)) {
-            _physicalDevice = device;
-            break;
+
+    bool byIndex = !_options.device.empty() && std::all_of(_options.device.begin(), _options.device.end(), ::isdigit);
+    DeviceProfile selected;
+    for (uint32_t i = 0; i < deviceCount; i++) {
+        DeviceProfile profile = DeviceCapabilities::probe(devices[i], _instanceApiVersion);
+        bool suitable = _isDeviceSuitable(devices[i]);
+        DeviceCapabilities::log(profile, suitable);
+
+        if (!_options.device.empty()) {
+            bool requested = byIndex ? std::stoul(_options.device) == i : strstr(profile.properties.deviceName, _options.device.c_str()) != nullptr;
+            if (requested && !suitable) {
+                throw std::runtime_error(std::string("Requested GPU is not suitable: ") + profile.properties.deviceName);
+            }
+            if (requested && selected.device == VK_NULL_HANDLE) {
+                selected = profile;
+            }
+        } else if (suitable && (selected.device == VK_NULL_HANDLE || profile.score > selected.score)) {
+            selected = profile;
         }
     }
-    if (_physicalDevice == VK_NULL_HANDLE) {
-        throw std::runtime_error("Failed to find a suitable GPU!");
+    if (selected.device == VK_NULL_HANDLE) {
+        throw std::runtime_error(_options.device.empty() ? "Failed to find a suitable GPU!" : "Requested GPU not found: " + _options.device);
     }
+
+    _physicalDevice = selected.device;
+    _deviceProfile = selected;
+    _featureTier = selected.tier;
+    LOG_INFO("Device: ", selected.properties.deviceName);
+
+    // Queried once here, every later step reuses the result
+    _queueFamilyIndices = _findQueueFamilies(_physicalDevice);
+    _msaaSamples = _getMaxUsableSampleCount(_options.msaaSamples);
+    _depthFormat = _findDepthFormat();
+    LOG_INFO("Using ", _msaaSamples, "x MSAA");
 }
 
 void App::createLogicalDevice() {
-    QueueFamilyIndices indices = _findQueueFamilies(_physicalDevice);
+    const QueueFamilyIndices &indices = _queueFamilyIndices;
+
+    // Particles get the compute only family when timeline semaphores can order it against the graphics queue
+    bool asyncCompute = _options.particleCount > 0 && _options.asyncCompute && indices.computeFamily.has_value() && _featureTier.timelineSemaphores;
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    if (asyncCompute) {
+        uniqueQueueFamilies.insert(indices.computeFamily.value());
+    }
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
         VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -237,17 +415,23 @@ void App::createLogicalDevice() {
         queueCreateInfo.pQueuePriorities = &queuePriority;
         queueCreateInfos.push_back(queueCreateInfo);
     }
-    VkPhysicalDeviceFeatures deviceFeatures{};
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
-    createInfo.pEnabledFeatures = &deviceFeatures;
 
     if (!_checkDeviceExtensionSupport(_physicalDevice)) {
         throw std::runtime_error("Required device extensions not available!");
     } else {
-        std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Required device extensions available!" << std::endl;
+        LOG_INFO("Required device extensions available!");
+    }
+
+    // Everything in the feature tier is turned on, the optional extensions are appended after the required check
+    VkPhysicalDeviceFeatures2 *features = DeviceCapabilities::enableFeatures(_deviceProfile, _enabledFeatures, deviceExtensions);
+    if (_featureTier.apiVersion >= VK_API_VERSION_1_1) {
+        createInfo.pNext = features;
+    } else {
+        createInfo.pEnabledFeatures = &features->features;
     }
 
     createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
@@ -263,18 +447,41 @@ void App::createLogicalDevice() {
         throw std::runtime_error("Failed to create logical device!");
     }
 
+    MemoryTelemetry::get().init(_physicalDevice, _featureTier.memoryBudget);
+
     vkGetDeviceQueue(_device, indices.graphicsFamily.value(), 0, &_graphicsQueue);
     vkGetDeviceQueue(_device, indices.presentFamily.value(), 0, &_presentQueue);
+    if (asyncCompute) {
+        vkGetDeviceQueue(_device, indices.computeFamily.value(), 0, &_computeQueue);
+    }
+
+    // With device addresses every mesh is drawn by one pipeline that fetches its own vertices
+    _vertexPulling = _featureTier.bufferDeviceAddress;
+    LOG_INFO(_vertexPulling ? "Using vertex pulling" : "Using fixed function vertex input");
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Logical device created!" << std::endl;
+    LOG_INFO("Logical device created!");
 }
 
 void App::createSwapChain() {
-    SwapChainSupportDetails swapChainSupport = _querySwapChainSupport(_physicalDevice);
+    _createSwapChain(_surface, _window, VK_FORMAT_UNDEFINED, _swapChain, _swapChainImages, _swapChainImageFormat, _swapChainExtent);
+}
+
+void App::_createSwapChain(VkSurfaceKHR surface, GLFWwindow *window, VkFormat requiredFormat, VkSwapchainKHR &swapChain, std::vector<VkImage> &images, VkFormat &format, VkExtent2D &extent) {
+    SwapChainSupportDetails swapChainSupport = _querySwapChainSupport(_physicalDevice, surface);
 
     VkSurfaceFormatKHR surfaceFormat = _chooseSwapSurfaceFormat(swapChainSupport.formats);
+    if (requiredFormat != VK_FORMAT_UNDEFINED) {
+        // Views share the render pass, so they have to use the same format
+        auto it = std::find_if(swapChainSupport.formats.begin(), swapChainSupport.formats.end(), [requiredFormat](const VkSurfaceFormatKHR &candidate) {
+            return candidate.format == requiredFormat;
+        });
+        if (it == swapChainSupport.formats.end()) {
+            throw std::runtime_error("Surface does not support the primary swap chain's format!");
+        }
+        surfaceFormat = *it;
+    }
     VkPresentModeKHR presentMode = _chooseSwapPresentMode(swapChainSupport.presentModes);
-    VkExtent2D extent = _chooseSwapExtent(swapChainSupport.capabilities);
+    extent = _chooseSwapExtent(swapChainSupport.capabilities, window);
 
     uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
     if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
@@ -283,7 +490,7 @@ void App::createSwapChain() {
 
     VkSwapchainCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    createInfo.surface = _surface;
+    createInfo.surface = surface;
     createInfo.minImageCount = imageCount;
     createInfo.imageFormat = surfaceFormat.format;
     createInfo.imageColorSpace = surfaceFormat.colorSpace;
@@ -292,7 +499,17 @@ void App::createSwapChain() {
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;  // Render directly to images
     // It is also possible that you'll render images to a separate image first to perform operations like post-processing. In that case you may use a value like VK_IMAGE_USAGE_TRANSFER_DST_BIT instead and use a memory operation to transfer the rendered image to a swap chain image.
 
-    QueueFamilyIndices indices = _findQueueFamilies(_physicalDevice);
+    if (surface == _surface && !_options.captureDirectory.empty()) {
+        // Frame capture copies straight out of the presented images
+        if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        } else {
+            LOG_WARNING("Swap chain images cannot be copied from, capture disabled");
+            _options.captureDirectory.clear();
+        }
+    }
+
+    const QueueFamilyIndices &indices = _queueFamilyIndices;
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
     if (indices.graphicsFamily != indices.presentFamily) {
@@ -312,18 +529,17 @@ void App::createSwapChain() {
 
     createInfo.oldSwapchain = VK_NULL_HANDLE;
 
-    auto result = vkCreateSwapchainKHR(_device, &createInfo, nullptr, &_swapChain);
+    auto result = vkCreateSwapchainKHR(_device, &createInfo, nullptr, &swapChain);
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create swap chain!");
     }
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Swap chain created!" << std::endl;
+    LOG_INFO("Swap chain created!");
 
-    vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, nullptr);
-    _swapChainImages.resize(imageCount);
-    vkGetSwapchainImagesKHR(_device, _swapChain, &imageCount, _swapChainImages.data());
+    vkGetSwapchainImagesKHR(_device, swapChain, &imageCount, nullptr);
+    images.resize(imageCount);
+    vkGetSwapchainImagesKHR(_device, swapChain, &imageCount, images.data());
 
-    _swapChainImageFormat = surfaceFormat.format;
-    _swapChainExtent = extent;
+    format = surfaceFormat.format;
 }
 
 void App::createImageViews() {
@@ -350,56 +566,112 @@ void App::createImageViews() {
 
         auto result = vkCreateImageView(_device, &createInfo, nullptr, &_swapChainImageViews[i]);
         if (result != VK_SUCCESS) {
-            std::cerr << UNI_RED << "Error: " << UNI_RESET << "Failed to create image view for index " << i << "of total " << _swapChainImages.size() << std::endl;
+            LOG_ERROR("Failed to create image view for index ", i, "of total ", _swapChainImages.size());
             throw std::runtime_error("Failed to create image views!");
         }
-        std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Image view created for index " << i << " of total " << _swapChainImages.size() << std::endl;
+        LOG_INFO("Image view created for index ", i, " of total ", _swapChainImages.size());
     }
 }
 
 void App::createRenderPass() {
+    _renderPass = _createRenderPass(VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    LOG_INFO("Render pass created!");
+
+    // The target is sampled by the upscale pass rather than presented
+    if (_options.targetGpuMilliseconds > 0.0f) {
+        _sceneRenderPass = _createRenderPass(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        _dynamicResolution.init(_physicalDevice, _device, _swapChainImageFormat, MAX_FRAMES_IN_FLIGHT, _options.targetGpuMilliseconds, _options.minResolutionScale,
+                                _options.upscaleSharpness);
+    }
+
+    // The depth pre-pass pipeline is compiled with the main one, so its render pass has to exist now
+    _occlusionCulling = _options.occlusionCulling && _options.meshletCulling && HiZBuffer::isSupported(_physicalDevice, _depthFormat);
+    if (_occlusionCulling) {
+        _hiz.createRenderPass(_device, _depthFormat);
+    } else if (_options.occlusionCulling && _options.meshletCulling) {
+        LOG_WARNING("Depth format cannot be sampled, occlusion culling disabled");
+    }
+}
+
+VkRenderPass App::_createRenderPass(VkImageLayout outputLayout) {
+    // With MSAA the multisampled color and depth only live for the duration of the subpass,
+    // they are never stored and resolve straight into the output image
+    bool multisampled = _msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
     VkAttachmentDescription colorAttachment{};
     colorAttachment.format = _swapChainImageFormat;
-    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.samples = _msaaSamples;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    colorAttachment.finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : outputLayout;
+
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = _depthFormat;
+    depthAttachment.samples = _msaaSamples;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentDescription colorAttachmentResolve{};
+    colorAttachmentResolve.format = _swapChainImageFormat;
+    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachmentResolve.finalLayout = outputLayout;
 
     VkAttachmentReference colorAttachmentRef{};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentResolveRef{};
+    colorAttachmentResolveRef.attachment = 2;
+    colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass{};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+    subpass.pResolveAttachments = multisampled ? &colorAttachmentResolveRef : nullptr;
 
+    std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
     VkRenderPassCreateInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = multisampled ? 3 : 2;
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
 
     VkSubpassDependency dependency{};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
     dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
     renderPassInfo.dependencyCount = 1;
     renderPassInfo.pDependencies = &dependency;
 
-    auto result = vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass);
+    VkRenderPass renderPass;
+    auto result = vkCreateRenderPass(_device, &renderPassInfo, nullptr, &renderPass);
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create render pass!");
     }
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Render pass created!" << std::endl;
+    return renderPass;
 }
 
 void App::createDescriptorSetLayout() {
@@ -411,23 +683,35 @@ void App::createDescriptorSetLayout() {
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr;
 
+    VkDescriptorSetLayoutBinding samplerLayoutBinding{};
+    samplerLayoutBinding.binding = 1;
+    samplerLayoutBinding.descriptorCount = 1;
+    samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    samplerLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &uboLayoutBinding;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
 
     auto result = vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_descriptorSetLayout);
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create descriptor set layout!");
     }
+
+    if (_options.lightCount > 0) {
+        _lighting.createSetLayout(_device);
+    }
 }
 
 void App::createGraphicsPipeline() {
-    auto vertShaderCode = Utils::readFile("shaders/vert.spv");
-    auto fragShaderCode = Utils::readFile("shaders/frag.spv");
+    std::array<std::vector<char>, 4> shaderCode = _shaderCode.get();
 
-    VkShaderModule vertShaderModule = _createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = _createShaderModule(fragShaderCode);
+    bool lit = _options.lightCount > 0;
+    VkShaderModule vertShaderModule = _createShaderModule(_vertexPulling ? shaderCode[2] : shaderCode[0]);
+    VkShaderModule fragShaderModule = _createShaderModule(lit ? shaderCode[3] : shaderCode[1]);
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -449,10 +733,12 @@ void App::createGraphicsPipeline() {
     auto attributeDescriptions = Vertex::getAttributeDescriptions();
 
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    if (!_vertexPulling) {
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    }
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
     inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -495,12 +781,20 @@ void App::createGraphicsPipeline() {
     VkPipelineMultisampleStateCreateInfo multisampling{};
     multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.rasterizationSamples = _msaaSamples;
     multisampling.minSampleShading = 1.0f;           // Optional
     multisampling.pSampleMask = nullptr;             // Optional
     multisampling.alphaToCoverageEnable = VK_FALSE;  // Optional
     multisampling.alphaToOneEnable = VK_FALSE;       // Optional
 
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
     VkPipelineColorBlendAttachmentState colorBlendAttachment{};
     colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
     colorBlendAttachment.blendEnable = VK_FALSE;
@@ -524,18 +818,29 @@ void App::createGraphicsPipeline() {
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+    // The lit fragment shader reads the light clusters from set 1
+    std::array<VkDescriptorSetLayout, 2> setLayouts = {_descriptorSetLayout, _lighting.getSetLayout()};
+    pipelineLayoutInfo.setLayoutCount = lit ? 2 : 1;
+    pipelineLayoutInfo.pSetLayouts = setLayouts.data();
     pipelineLayoutInfo.pushConstantRangeCount = 0;     // Optional
     pipelineLayoutInfo.pPushConstantRanges = nullptr;  // Optional
 
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(VertexPullConstants);
+    if (_vertexPulling) {
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    }
+
     auto result = vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout);
 
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create pipeline layout!");
     }
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Created pipeline layout" << std::endl;
+    LOG_INFO("Created pipeline layout");
 
     VkGraphicsPipelineCreateInfo pipelineInfo{};
     pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -554,7 +859,7 @@ void App::createGraphicsPipeline() {
     pipelineInfo.pViewportState = &viewportState;
     pipelineInfo.pRasterizationState = &rasterizer;
     pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;  // Optional
+    pipelineInfo.pDepthStencilState = &depthStencil;
     pipelineInfo.pColorBlendState = &colorBlending;
     pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
     pipelineInfo.layout = _pipelineLayout;
@@ -569,38 +874,79 @@ void App::createGraphicsPipeline() {
         throw std::runtime_error("Failed to create graphics pipeline!");
     }
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Created graphics pipeline" << std::endl;
+    LOG_INFO("Created graphics pipeline");
+
+    // Same vertex stage and layout, depth only and single sampled
+    if (_occlusionCulling) {
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pColorBlendState = nullptr;
+        pipelineInfo.renderPass = _hiz.getRenderPass();
+        result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_depthPrepassPipeline);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create depth pre-pass pipeline!");
+        }
+    }
 
     vkDestroyShaderModule(_device, fragShaderModule, nullptr);
     vkDestroyShaderModule(_device, vertShaderModule, nullptr);
 }
 
+void App::createColorResources() {
+    if (_msaaSamples == VK_SAMPLE_COUNT_1_BIT) {
+        return;
+    }
+    _createAttachment(_swapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, _swapChainExtent, _colorImage, _colorImageMemory, _colorImageView);
+}
+
+void App::createDepthResources() {
+    _createAttachment(_depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, _swapChainExtent, _depthImage, _depthImageMemory, _depthImageView);
+}
+
 void App::createFrameBuffers() {
-    _swapChainFramebuffers.resize(_swapChainImageViews.size());
+    _createFramebuffers(_swapChainImageViews, _colorImageView, _depthImageView, _swapChainExtent, _swapChainFramebuffers);
 
-    for (size_t i = 0; i < _swapChainImageViews.size(); i++) {
-        VkImageView attachments[] = {_swapChainImageViews[i]};
+    if (_options.targetGpuMilliseconds > 0.0f) {
+        _dynamicResolution.resize(_swapChainExtent, _swapChainImageViews);
+
+        // Framebuffers are created against _renderPass, which _sceneRenderPass is compatible with
+        std::vector<VkFramebuffer> framebuffers;
+        _createFramebuffers({_dynamicResolution.getTargetView()}, _colorImageView, _depthImageView, _swapChainExtent, framebuffers);
+        _sceneFramebuffer = framebuffers[0];
+    }
+}
+
+void App::_createFramebuffers(const std::vector<VkImageView> &imageViews, VkImageView colorView, VkImageView depthView, VkExtent2D extent, std::vector<VkFramebuffer> &framebuffers) {
+    framebuffers.resize(imageViews.size());
+
+    for (size_t i = 0; i < imageViews.size(); i++) {
+        std::vector<VkImageView> attachments;
+        if (_msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+            attachments = {colorView, depthView, imageViews[i]};
+        } else {
+            attachments = {imageViews[i], depthView};
+        }
 
         VkFramebufferCreateInfo framebufferInfo{};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = _renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = attachments;
-        framebufferInfo.width = _swapChainExtent.width;
-        framebufferInfo.height = _swapChainExtent.height;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
         framebufferInfo.layers = 1;
 
-        auto result = vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_swapChainFramebuffers[i]);
+        auto result = vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &framebuffers[i]);
         if (result != VK_SUCCESS) {
             throw std::runtime_error("Failed to create framebuffer!");
         }
 
-        std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Created framebuffer " << i << " of " << _swapChainFramebuffers.size() << std::endl;
+        LOG_INFO("Created framebuffer ", i, " of ", framebuffers.size());
     }
 }
 
 void App::createCommandPool() {
-    QueueFamilyIndices queueFamilyIndices = _findQueueFamilies(_physicalDevice);
+    const QueueFamilyIndices &queueFamilyIndices = _queueFamilyIndices;
 
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -612,73 +958,224 @@ void App::createCommandPool() {
         throw std::runtime_error("Failed to create command pool!");
     }
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Created command pool" << std::endl;
+    LOG_INFO("Created command pool");
+}
+
+void App::createMeshLods() {
+    std::vector<glm::vec3> positions;
+    for (const Vertex &vertex : _vertices) {
+        positions.emplace_back(vertex.pos, 0.0f);
+    }
+    if (_options.meshLods) {
+        _lodChain = buildLodChain(positions, _indices);
+    } else {
+        _lodChain = MeshLodChain{};
+        _lodChain.indices = _indices;
+        _lodChain.lods.push_back({0, static_cast<uint32_t>(_indices.size()), 0.0f});
+    }
+    _lodIndices = _lodChain.indices;
+
+    std::ostringstream line;
+    line << "Mesh has " << _lodChain.lods.size() << " LODs:";
+    for (const MeshLod &lod : _lodChain.lods) {
+        line << " " << lod.indexCount / 3 << " triangles (error " << lod.error << ")";
+    }
+    LOG_INFO(line.str());
+}
+
+void App::createSceneIndex() {
+    _meshBounds.min = _meshBounds.max = glm::vec3(_vertices[0].pos, 0.0f);
+    for (const Vertex &vertex : _vertices) {
+        _meshBounds.expand({glm::vec3(vertex.pos, 0.0f), glm::vec3(vertex.pos, 0.0f)});
+    }
+
+    // Must match instancePosition() in the vertex shaders: each instance is scaled down
+    // to one cell of a square grid over [-0.5, 0.5]
+    if (_options.instanceCount > 1) {
+        _instancesPerRow = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(_options.instanceCount))));
+        uint32_t rows = (_options.instanceCount + _instancesPerRow - 1) / _instancesPerRow;
+        float cell = 1.0f / _instancesPerRow;
+        glm::vec3 firstOffset(0.5f * cell - 0.5f, 0.5f * cell - 0.5f, 0.0f);
+        glm::vec3 lastOffset = firstOffset + glm::vec3((_instancesPerRow - 1) * cell, (rows - 1) * cell, 0.0f);
+        glm::vec3 scale(cell, cell, 1.0f);
+        _meshBounds.min = _meshBounds.min * scale + firstOffset;
+        _meshBounds.max = _meshBounds.max * scale + lastOffset;
+    }
+
+    _sceneObject = _sceneIndex.add(_meshBounds);
+    _sceneIndex.update();
 }
 
 void App::createIndexBuffer() {
-    VkDeviceSize bufferSize = sizeof(_indices[0]) * _indices.size();
+    if (_vertexPulling) {
+        return;
+    }
+
+    VkDeviceSize bufferSize = sizeof(_lodIndices[0]) * _lodIndices.size();
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
-    _createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    _createBuffer(MemoryCategory::Staging, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
     void *data;
     vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, _indices.data(), (size_t)bufferSize);
+    memcpy(data, _lodIndices.data(), (size_t)bufferSize);
     vkUnmapMemory(_device, stagingBufferMemory);
 
-    _createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
+    _createBuffer(MemoryCategory::Index, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
 
     _copyBuffer(stagingBuffer, _indexBuffer, bufferSize);
 
     vkDestroyBuffer(_device, stagingBuffer, nullptr);
-    vkFreeMemory(_device, stagingBufferMemory, nullptr);
+    Utils::freeMemory(_device, stagingBufferMemory);
 }
 
 void App::createVertexBuffer() {
+    if (_vertexPulling) {
+        return;
+    }
+
     VkDeviceSize bufferSize = sizeof(_vertices[0]) * _vertices.size();
 
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
-    _createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    _createBuffer(MemoryCategory::Staging, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
     void *data;
     vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
     memcpy(data, _vertices.data(), (size_t)bufferSize);
     vkUnmapMemory(_device, stagingBufferMemory);
 
-    _createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory);
+    _createBuffer(MemoryCategory::Vertex, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory);
 
     _copyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
 
     vkDestroyBuffer(_device, stagingBuffer, nullptr);
-    vkFreeMemory(_device, stagingBufferMemory, nullptr);
+    Utils::freeMemory(_device, stagingBufferMemory);
+}
+
+void App::createGeometryBuffer() {
+    if (!_vertexPulling) {
+        return;
+    }
+
+    // Grows past the default for meshes that would not fit, with room for the alignment of both ranges
+    VkDeviceSize meshSize = sizeof(_vertices[0]) * _vertices.size() + sizeof(_lodIndices[0]) * _lodIndices.size() + 64;
+    _geometry.init(_physicalDevice, _device, _graphicsQueue, _queueFamilyIndices.graphicsFamily.value(), std::max((VkDeviceSize)GEOMETRY_BUFFER_MB << 20, meshSize));
+    static_assert(sizeof(Vertex) == 7 * sizeof(float), "Vertex must match VERTEX_LAYOUT_COLOR | VERTEX_LAYOUT_TEXCOORD");
+    _mesh = _geometry.addMesh(_vertices.data(), static_cast<uint32_t>(_vertices.size()), VERTEX_LAYOUT_COLOR | VERTEX_LAYOUT_TEXCOORD, _lodIndices.data(), static_cast<uint32_t>(_lodIndices.size()));
+}
+
+void App::createMeshlets() {
+    if (!_options.meshletCulling || _lodIndices.empty()) {
+        return;
+    }
+    if (_options.instanceCount > 1) {
+        LOG_WARNING("Meshlet culling only tests the first instance, disabled for ", _options.instanceCount, " instances");
+        return;
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(_physicalDevice, &queueFamilyCount, queueFamilies.data());
+    if (!(queueFamilies[_queueFamilyIndices.graphicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+        LOG_WARNING("Graphics queue cannot run compute, meshlet culling disabled");
+        return;
+    }
+
+    std::vector<glm::vec3> positions;
+    for (const Vertex &vertex : _vertices) {
+        positions.emplace_back(vertex.pos, 0.0f);
+    }
+
+    // Meshlets never span two LODs, so the culler can be pointed at any level's range
+    MeshletMesh meshlets;
+    for (const MeshLod &lod : _lodChain.lods) {
+        auto first = _lodChain.indices.begin() + lod.firstIndex;
+        std::vector<uint32_t> indices(first, first + lod.indexCount);
+        _lodMeshlets.push_back(appendMeshlets(meshlets, buildMeshlets(positions, indices)));
+    }
+
+    _meshletCuller.init(_physicalDevice, _device, _graphicsQueue, _queueFamilyIndices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT, meshlets, _occlusionCulling);
+    _meshletCulling = true;
+}
+
+void App::createOcclusionCulling() {
+    if (!_occlusionCulling) {
+        return;
+    }
+
+    _hiz.init(_physicalDevice, _swapChainExtent);
+    if (_meshletCulling) {
+        _meshletCuller.setHiZ(_hiz.getView(), _hiz.getSampler(), _hiz.getSize(), _hiz.getMipCount());
+    }
+}
+
+void App::createTextureStreamer() {
+    const QueueFamilyIndices &queueFamilyIndices = _queueFamilyIndices;
+    _mipGenerator.init(_physicalDevice, _device, _featureTier.storageImageDynamicIndexing, _featureTier.extendedImageUsage);
+
+    VkDeviceSize textureBudget = (VkDeviceSize)TEXTURE_BUDGET_MB << 20;
+    if (_featureTier.memoryBudget) {
+        // Leave the other half of what the driver says is free to the rest of the process
+        textureBudget = std::min(textureBudget, DeviceCapabilities::queryDeviceLocalBudget(_physicalDevice) / 2);
+    }
+    _textureStreamer.init(_physicalDevice, _device, _graphicsQueue, queueFamilyIndices.graphicsFamily.value(), &_mipGenerator, MAX_FRAMES_IN_FLIGHT, textureBudget);
+
+    try {
+        _texture = _textureStreamer.load("textures/texture.ktx2");
+    } catch (const std::exception &e) {
+        // Not fatal, fall back to a procedural texture with GPU generated mips
+        LOG_WARNING(e.what());
+
+        const uint32_t size = 512;
+        std::vector<uint32_t> pixels(size * size);
+        _jobSystem.parallelFor("checkerboard", size, 0, [&pixels, size](uint32_t begin, uint32_t end) {
+            for (uint32_t y = begin; y < end; y++) {
+                for (uint32_t x = 0; x < size; x++) {
+                    pixels[y * size + x] = ((x / 32 + y / 32) % 2) ? 0xFFFFFFFF : 0xFF404040;
+                }
+            }
+        });
+        _texture = _textureStreamer.create(size, size, VK_FORMAT_R8G8B8A8_SRGB, pixels.data(), pixels.size() * sizeof(uint32_t), MipFilter::Box);
+    }
 }
 
 void App::createUniformBuffers() {
+    _frameUniforms.resize(MAX_FRAMES_IN_FLIGHT);
+    _createUniformBuffers(_uniformBuffers, _uniformBuffersMemory, _uniformBuffersMapped);
+}
+
+void App::_createUniformBuffers(std::vector<VkBuffer> &buffers, std::vector<VkDeviceMemory> &memories, std::vector<void *> &mapped) {
     VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-    _uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    _uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    _uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    buffers.resize(MAX_FRAMES_IN_FLIGHT);
+    memories.resize(MAX_FRAMES_IN_FLIGHT);
+    mapped.resize(MAX_FRAMES_IN_FLIGHT);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        _createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _uniformBuffers[i], _uniformBuffersMemory[i]);
+        _createBuffer(MemoryCategory::Uniform, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffers[i], memories[i]);
 
-        vkMapMemory(_device, _uniformBuffersMemory[i], 0, bufferSize, 0, &_uniformBuffersMapped[i]);
+        vkMapMemory(_device, memories[i], 0, bufferSize, 0, &mapped[i]);
     }
 }
 
 void App::createDescriptorPool() {
-    VkDescriptorPoolSize poolSize{};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    // One set per frame in flight for the primary window and every extra view
+    uint32_t setCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT) * (1 + _options.extraViews);
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = setCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = setCount;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = setCount;
 
     auto result = vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool);
     if (result != VK_SUCCESS) {
@@ -687,6 +1184,10 @@ void App::createDescriptorPool() {
 }
 
 void App::createDescriptorSets() {
+    _allocateDescriptorSets(_uniformBuffers, _descriptorSets, _boundTextureViews);
+}
+
+void App::_allocateDescriptorSets(const std::vector<VkBuffer> &uniformBuffers, std::vector<VkDescriptorSet> &descriptorSets, std::vector<VkImageView> &boundTextureViews) {
     std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, _descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -694,21 +1195,21 @@ void App::createDescriptorSets() {
     allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
     allocInfo.pSetLayouts = layouts.data();
 
-    _descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+    descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
 
-    auto result = vkAllocateDescriptorSets(_device, &allocInfo, _descriptorSets.data());
+    auto result = vkAllocateDescriptorSets(_device, &allocInfo, descriptorSets.data());
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate descriptor sets!");
     }
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         VkDescriptorBufferInfo bufferInfo{};
-        bufferInfo.buffer = _uniformBuffers[i];
+        bufferInfo.buffer = uniformBuffers[i];
         bufferInfo.offset = 0;
         bufferInfo.range = sizeof(UniformBufferObject);
         VkWriteDescriptorSet descriptorWrite{};
         descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = _descriptorSets[i];
+        descriptorWrite.dstSet = descriptorSets[i];
         descriptorWrite.dstBinding = 0;
         descriptorWrite.dstArrayElement = 0;
         descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -718,22 +1219,40 @@ void App::createDescriptorSets() {
         descriptorWrite.pTexelBufferView = nullptr;  // Optional
         vkUpdateDescriptorSets(_device, 1, &descriptorWrite, 0, nullptr);
     }
+
+    boundTextureViews.assign(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        _updateTextureDescriptor(descriptorSets[i], boundTextureViews[i]);
+    }
 }
 
 void App::createCommandBuffer() {
-    _commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    // Also called when the swap chain was recreated, the old recordings point at its framebuffers
+    std::vector<VkCommandBuffer> commandBuffers;
+    for (const FrameRecording &recording : _recordings) {
+        commandBuffers.push_back(recording.commandBuffer);
+    }
+    if (!commandBuffers.empty()) {
+        vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+    }
+
+    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT * _swapChainImages.size());
+    _recordings.assign(commandBuffers.size(), FrameRecording{});
 
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = _commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t)_commandBuffers.size();
+    allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
 
-    auto result = vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data());
+    auto result = vkAllocateCommandBuffers(_device, &allocInfo, commandBuffers.data());
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to allocate command buffers!");
     }
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Allocated command buffers" << std::endl;
+    for (size_t i = 0; i < commandBuffers.size(); i++) {
+        _recordings[i].commandBuffer = commandBuffers[i];
+    }
+    LOG_INFO("Allocated ", commandBuffers.size(), " command buffers");
 }
 
 void App::createSyncObjects() {
@@ -767,10 +1286,306 @@ void App::createSyncObjects() {
         throw std::runtime_error("Failed to create inFlight fence!");
     }
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Created sync objects" << std::endl;
+    LOG_INFO("Created sync objects");
+}
+
+void App::createFrameCapture() {
+    if (_options.captureDirectory.empty()) {
+        return;
+    }
+    // Two spare slots give the encoders some slack before frames get dropped
+    _frameCapture.init(_physicalDevice, _device, _swapChainImageFormat, _swapChainExtent, _options.captureDirectory, _options.captureFormat, _options.captureFrames, MAX_FRAMES_IN_FLIGHT + 2);
+}
+
+void App::createTraceRecorder() {
+    if (!_replay.frames.empty()) {
+        // Device limits may not allow what the capture used, the workload differs then
+        bool captured = !_options.replayTrace;
+        if (captured && (static_cast<uint32_t>(_msaaSamples) != _replay.config.msaaSamples || _vertexPulling != (_replay.config.vertexPulling != 0))) {
+            LOG_WARNING("Replaying with ", _msaaSamples, "x MSAA and vertex pulling ", _vertexPulling, ", the trace was captured with ",
+                        _replay.config.msaaSamples, "x MSAA and vertex pulling ", _replay.config.vertexPulling != 0);
+        }
+        return;
+    }
+    if (_options.recordFile.empty()) {
+        return;
+    }
+
+    TraceConfig config;
+    config.width = _swapChainExtent.width;
+    config.height = _swapChainExtent.height;
+    config.msaaSamples = static_cast<uint32_t>(_msaaSamples);
+    config.meshletCulling = _options.meshletCulling;
+    config.occlusionCulling = _options.occlusionCulling;
+    config.vertexPulling = _vertexPulling;
+    config.meshLods = _options.meshLods;
+    config.drawCount = _options.drawCount;
+    config.instanceCount = _options.instanceCount;
+    config.particleCount = _options.particleCount;
+    config.asyncCompute = _options.asyncCompute;
+    config.spriteCount = _options.spriteCount;
+    config.debugBounds = _options.debugBounds;
+    config.lightCount = _options.lightCount;
+    config.extraViews = _options.extraViews;
+    config.reuseCommandBuffers = _options.reuseCommandBuffers;
+    config.targetGpuMilliseconds = _options.targetGpuMilliseconds;
+    config.minResolutionScale = _options.minResolutionScale;
+    config.upscaleSharpness = _options.upscaleSharpness;
+    config.uploadBytesPerFrame = _options.uploadBytesPerFrame;
+    _traceWriter.open(_options.recordFile, config);
+    _traceWriter.writeBuffer("vertices", sizeof(Vertex), _vertices.data(), _vertices.size() * sizeof(Vertex));
+    _traceWriter.writeBuffer("indices", sizeof(uint32_t), _indices.data(), _indices.size() * sizeof(uint32_t));
+    _traceStart = std::chrono::steady_clock::now();
+}
+
+void App::createSyntheticLoad() {
+    if (_options.uploadBytesPerFrame == 0) {
+        return;
+    }
+    _uploadData.assign(_options.uploadBytesPerFrame, 0x5a);
+    _createBuffer(MemoryCategory::Storage, _options.uploadBytesPerFrame, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _uploadTarget, _uploadTargetMemory);
+}
+
+void App::createParticles() {
+    if (_options.particleCount == 0) {
+        return;
+    }
+    if (_options.asyncCompute && _computeQueue == VK_NULL_HANDLE) {
+        LOG_INFO("No compute only queue with timeline semaphores, particles share the graphics queue");
+    }
+    uint32_t graphicsFamily = _queueFamilyIndices.graphicsFamily.value();
+    _particles.init(_physicalDevice, _device, _graphicsQueue, graphicsFamily, _computeQueue, _queueFamilyIndices.computeFamily.value_or(graphicsFamily),
+                    MAX_FRAMES_IN_FLIGHT, _options.particleCount, _renderPass, _msaaSamples);
+    _particleTime = std::chrono::steady_clock::now();
+}
+
+void App::createSpriteBatcher() {
+    _overlay = _options.spriteCount > 0 || _options.debugBounds;
+    if (!_overlay) {
+        return;
+    }
+    const uint32_t white = 0xFFFFFFFF;
+    _whiteTexture = _textureStreamer.create(1, 1, VK_FORMAT_R8G8B8A8_UNORM, &white, sizeof(white), MipFilter::Box);
+    // Room for the debug shapes on top of the sprites
+    uint32_t maxQuads = _options.spriteCount + SPRITE_OVERLAY_QUADS;
+    _sprites.init(_physicalDevice, _device, MAX_FRAMES_IN_FLIGHT, maxQuads, _renderPass, _msaaSamples, _textureStreamer.getSampler(), _textureStreamer.getImageView(_whiteTexture));
+}
+
+void App::createLighting() {
+    if (_options.lightCount == 0) {
+        return;
+    }
+    _lighting.init(_physicalDevice, MAX_FRAMES_IN_FLIGHT, _options.lightCount);
+
+    // Lights hover over the mesh at random, a fixed seed keeps replays comparable. Radii shrink
+    // as the count grows so about LIGHT_OVERLAP lights reach any point of the mesh, which keeps
+    // the per fragment cost flat while the clusters cull the rest.
+    glm::vec3 size = _meshBounds.max - _meshBounds.min;
+    float area = std::max(size.x * size.y, 1e-4f);
+    float radius = std::sqrt(LIGHT_OVERLAP * area / (glm::pi<float>() * _options.lightCount));
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    _lightOrbits.resize(_options.lightCount);
+    for (PointLight &light : _lightOrbits) {
+        // Low enough over the mesh for most of the sphere to reach it
+        float lightRadius = radius * (0.5f + unit(random));
+        glm::vec3 position = _meshBounds.min + size * glm::vec3(unit(random), unit(random), 0.0f);
+        position.z = _meshBounds.max.z + lightRadius * (0.2f + 0.4f * unit(random));
+        light.positionRadius = glm::vec4(position, lightRadius);
+        float hue = unit(random);
+        glm::vec3 color = 0.5f + 0.5f * glm::cos(glm::two_pi<float>() * (hue + glm::vec3(0.0f, 0.33f, 0.67f)));
+        light.color = glm::vec4(color * 1.5f, 0.0f);
+    }
+}
+
+void App::createViews() {
+    // Never resized afterwards, the windows point back at their view
+    _views.resize(_options.extraViews);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (size_t i = 0; i < _views.size(); i++) {
+        SurfaceView &view = _views[i];
+        // Spread evenly around the scene, the primary window's camera sits at angle 0
+        view.cameraAngle = glm::radians(360.0f) * (i + 1) / (_views.size() + 1);
+
+        // Same visibility and resizability as the primary window, the hints are still set
+        std::string title = "Vulkan view " + std::to_string(i + 1);
+        view.window = glfwCreateWindow(_width / 2, _height / 2, title.c_str(), nullptr, nullptr);
+        if (view.window == nullptr) {
+            throw std::runtime_error("Failed to create view window!");
+        }
+        glfwSetWindowUserPointer(view.window, &view);
+        glfwSetFramebufferSizeCallback(view.window, viewResizeCallback);
+
+        if (glfwCreateWindowSurface(_instance, view.window, nullptr, &view.surface) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create view surface!");
+        }
+        VkBool32 presentSupport = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(_physicalDevice, _queueFamilyIndices.presentFamily.value(), view.surface, &presentSupport);
+        if (!presentSupport) {
+            throw std::runtime_error("Present queue cannot present to a view's surface!");
+        }
+        _createViewSwapChain(view);
+
+        view.imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        view.renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &view.imageAvailableSemaphores[frame]) != VK_SUCCESS ||
+                vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &view.renderFinishedSemaphores[frame]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create view semaphores!");
+            }
+        }
+
+        view.frameUniforms.resize(MAX_FRAMES_IN_FLIGHT);
+        _createUniformBuffers(view.uniformBuffers, view.uniformBuffersMemory, view.uniformBuffersMapped);
+        _allocateDescriptorSets(view.uniformBuffers, view.descriptorSets, view.boundTextureViews);
+    }
+
+    if (!_views.empty()) {
+        LOG_INFO(_views.size(), " extra views share the device, presented together with the primary window");
+    }
+}
+
+void App::cleanupViews() {
+    for (SurfaceView &view : _views) {
+        _cleanupViewSwapChain(view);
+        for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; frame++) {
+            vkDestroySemaphore(_device, view.imageAvailableSemaphores[frame], nullptr);
+            vkDestroySemaphore(_device, view.renderFinishedSemaphores[frame], nullptr);
+            vkDestroyBuffer(_device, view.uniformBuffers[frame], nullptr);
+            Utils::freeMemory(_device, view.uniformBuffersMemory[frame]);
+        }
+        vkDestroySurfaceKHR(_instance, view.surface, nullptr);
+        glfwDestroyWindow(view.window);
+    }
+    _views.clear();
+}
+
+void App::_createViewSwapChain(SurfaceView &view) {
+    _createSwapChain(view.surface, view.window, _swapChainImageFormat, view.swapChain, view.images, view.format, view.extent);
+
+    view.imageViews.resize(view.images.size());
+    for (size_t i = 0; i < view.images.size(); i++) {
+        view.imageViews[i] = Utils::createImageView(_device, view.images[i], view.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
+    }
+    if (_msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+        _createAttachment(view.format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, view.extent, view.colorImage, view.colorImageMemory, view.colorImageView);
+    }
+    _createAttachment(_depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, view.extent, view.depthImage, view.depthImageMemory, view.depthImageView);
+    _createFramebuffers(view.imageViews, view.colorImageView, view.depthImageView, view.extent, view.framebuffers);
+}
+
+void App::_cleanupViewSwapChain(SurfaceView &view) {
+    for (auto framebuffer : view.framebuffers) {
+        vkDestroyFramebuffer(_device, framebuffer, nullptr);
+    }
+    if (view.colorImage != VK_NULL_HANDLE) {
+        vkDestroyImageView(_device, view.colorImageView, nullptr);
+        vkDestroyImage(_device, view.colorImage, nullptr);
+        Utils::freeMemory(_device, view.colorImageMemory);
+        view.colorImage = VK_NULL_HANDLE;
+    }
+    vkDestroyImageView(_device, view.depthImageView, nullptr);
+    vkDestroyImage(_device, view.depthImage, nullptr);
+    Utils::freeMemory(_device, view.depthImageMemory);
+    for (auto imageView : view.imageViews) {
+        vkDestroyImageView(_device, imageView, nullptr);
+    }
+    vkDestroySwapchainKHR(_device, view.swapChain, nullptr);
+}
+
+// Acquires every view's next image and fills its uniforms from the frame's camera.
+// Minimized views sit the frame out, out of date ones are recreated and skip a frame.
+void App::_prepareViews() {
+    PROFILE_FUNCTION();
+    const UniformBufferObject &primary = _frameUniforms[_currentFrame];
+    for (SurfaceView &view : _views) {
+        view.acquired = false;
+
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(view.window, &width, &height);
+        if (width == 0 || height == 0) {
+            continue;
+        }
+        if (view.resized) {
+            vkDeviceWaitIdle(_device);
+            _cleanupViewSwapChain(view);
+            _createViewSwapChain(view);
+            view.resized = false;
+        }
+
+        auto result = vkAcquireNextImageKHR(_device, view.swapChain, UINT64_MAX, view.imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &view.imageIndex);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            view.resized = true;
+            continue;
+        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("Failed to acquire view swap chain image");
+        }
+        view.acquired = true;
+
+        // The primary camera orbited around the scene's up axis
+        UniformBufferObject ubo = primary;
+        ubo.view = primary.view * glm::rotate(glm::mat4(1.0f), view.cameraAngle, glm::vec3(0.0f, 0.0f, 1.0f));
+        ubo.proj = glm::perspective(glm::radians(45.0f), view.extent.width / (float)view.extent.height, 0.1f, 10.0f);
+        ubo.proj[1][1] *= -1;
+        memcpy(view.uniformBuffersMapped[_currentFrame], &ubo, sizeof(ubo));
+        view.frameUniforms[_currentFrame] = ubo;
+
+        // The fence of this frame was waited on, so its descriptor set is free to change
+        _updateTextureDescriptor(view.descriptorSets[_currentFrame], view.boundTextureViews[_currentFrame]);
+    }
+}
+
+// One render pass per acquired view into the frame's command buffer. The meshlets were
+// culled for the primary camera only, so views draw the selected level in full.
+void App::_recordViews(VkCommandBuffer commandBuffer) {
+    const MeshLod &lod = _lodChain.lods[_lod];
+    for (const SurfaceView &view : _views) {
+        if (!view.acquired) {
+            continue;
+        }
+
+        std::array<VkClearValue, 3> clearValues{};
+        clearValues[0].color = {{0.1f, 0.0f, 0.1f, 1.0f}};
+        clearValues[1].depthStencil = {1.0f, 0};
+
+        VkRenderPassBeginInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = _renderPass;
+        renderPassInfo.framebuffer = view.framebuffers[view.imageIndex];
+        renderPassInfo.renderArea.offset = {0, 0};
+        renderPassInfo.renderArea.extent = view.extent;
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+        _bindGeometry(commandBuffer, VK_NULL_HANDLE, view.descriptorSets[_currentFrame]);
+
+        VkViewport viewport = {};
+        viewport.width = static_cast<float>(view.extent.width);
+        viewport.height = static_cast<float>(view.extent.height);
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent = view.extent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+        vkCmdDrawIndexed(commandBuffer, lod.indexCount, _options.instanceCount, lod.firstIndex, 0, 0);
+        if (_options.particleCount > 0) {
+            const UniformBufferObject &uniforms = view.frameUniforms[_currentFrame];
+            _particles.draw(commandBuffer, uniforms.view, uniforms.proj);
+        }
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
 }
 
 void App::recreateSwapChain() {
+    PROFILE_FUNCTION();
     int width = 0, height = 0;
     glfwGetFramebufferSize(_window, &width, &height);
     while (width == 0 || height == 0) {
@@ -784,13 +1599,43 @@ void App::recreateSwapChain() {
 
     createSwapChain();
     createImageViews();
+    createColorResources();
+    createDepthResources();
     createFrameBuffers();
+
+    if (_occlusionCulling) {
+        _hiz.resize(_swapChainExtent);
+        if (_meshletCulling) {
+            _meshletCuller.setHiZ(_hiz.getView(), _hiz.getSampler(), _hiz.getSize(), _hiz.getMipCount());
+        }
+    }
+
+    _frameCapture.resize(_swapChainImageFormat, _swapChainExtent);
+    createCommandBuffer();
+
+    // Nothing was presented to the new swap chain yet
+    _redrawRequested = true;
 }
 
 void App::cleanupSwapChain() {
     for (auto framebuffer : _swapChainFramebuffers) {
         vkDestroyFramebuffer(_device, framebuffer, nullptr);
     }
+    if (_sceneFramebuffer != VK_NULL_HANDLE) {
+        vkDestroyFramebuffer(_device, _sceneFramebuffer, nullptr);
+        _sceneFramebuffer = VK_NULL_HANDLE;
+    }
+
+    if (_colorImage != VK_NULL_HANDLE) {
+        vkDestroyImageView(_device, _colorImageView, nullptr);
+        vkDestroyImage(_device, _colorImage, nullptr);
+        Utils::freeMemory(_device, _colorImageMemory);
+        _colorImage = VK_NULL_HANDLE;
+    }
+
+    vkDestroyImageView(_device, _depthImageView, nullptr);
+    vkDestroyImage(_device, _depthImage, nullptr);
+    Utils::freeMemory(_device, _depthImageMemory);
 
     for (auto imageView : _swapChainImageViews) {
         vkDestroyImageView(_device, imageView, nullptr);
@@ -811,7 +1656,7 @@ std::vector<const char *> App::_getRequiredExtensions() {
     }
 
     for (const auto &extension : extensions) {
-        std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Required extension: " << extension << std::endl;
+        LOG_INFO("Required extension: ", extension);
     }
     return extensions;
 }
@@ -861,39 +1706,28 @@ bool App::_checkValidationLayerSupport() {
         }
     }
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Validation layers available!" << std::endl;
+    LOG_INFO("Validation layers available!");
     return true;
 }
 
 bool App::_isDeviceSuitable(VkPhysicalDevice device) {
     VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    VkPhysicalDeviceFeatures deviceFeatures;
-    vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
     QueueFamilyIndices indices = _findQueueFamilies(device);
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Checking device " << deviceProperties.deviceName << std::endl;
+    LOG_INFO("Checking device ", deviceProperties.deviceName);
 
     bool extensionsSupported = _checkDeviceExtensionSupport(device);
     bool swapChainAdequate = false;
 
     if (extensionsSupported) {
-        SwapChainSupportDetails swapChainSupport = _querySwapChainSupport(device);
+        SwapChainSupportDetails swapChainSupport = _querySwapChainSupport(device, _surface);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    bool suitable = deviceProperties.deviceType ==
-                        VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-                    indices.isComplete() &&
-                    extensionsSupported &&
-                    swapChainAdequate;
-
-    if (suitable) {
-        std::cout << UNI_GREEN << "Device: " << UNI_RESET << deviceProperties.deviceName << std::endl;
-    }
-
-    return suitable;
+    // Device type no longer rules a GPU out, it only lowers its score
+    return indices.isComplete() && extensionsSupported && swapChainAdequate;
 }
 
 QueueFamilyIndices App::_findQueueFamilies(VkPhysicalDevice device) {
@@ -921,6 +1755,15 @@ QueueFamilyIndices App::_findQueueFamilies(VkPhysicalDevice device) {
         i++;
     }
 
+    // Work submitted to a compute only family can run alongside the graphics queue
+    for (uint32_t family = 0; family < queueFamilyCount; family++) {
+        VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            indices.computeFamily = family;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -934,7 +1777,7 @@ bool App::_checkDeviceExtensionSupport(VkPhysicalDevice device) {
     std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
     for (const auto &ext : requiredExtensions) {
-        std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Required device extension: " << ext << std::endl;
+        LOG_INFO("Required device extension: ", ext);
     }
 
     for (const auto &extension : availableExtensions) {
@@ -944,25 +1787,25 @@ bool App::_checkDeviceExtensionSupport(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
-SwapChainSupportDetails App::_querySwapChainSupport(VkPhysicalDevice device) {
+SwapChainSupportDetails App::_querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) {
     SwapChainSupportDetails details;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, _surface, &details.capabilities);
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
     uint32_t formatCount;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, nullptr);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
 
     if (formatCount != 0) {
         details.formats.resize(formatCount);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, _surface, &formatCount, details.formats.data());
+        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
     }
 
     uint32_t presentModeCount;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, _surface, &presentModeCount, nullptr);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
 
     if (presentModeCount != 0) {
         details.presentModes.resize(presentModeCount);
         vkGetPhysicalDeviceSurfacePresentModesKHR(
-            device, _surface, &presentModeCount, details.presentModes.data());
+            device, surface, &presentModeCount, details.presentModes.data());
     }
 
     return details;
@@ -979,6 +1822,14 @@ VkSurfaceFormatKHR App::_chooseSwapSurfaceFormat(const std::vector<VkSurfaceForm
 }
 
 VkPresentModeKHR App::_chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes) {
+    // Replays measure throughput, so they never wait for vertical blank
+    if (!_replay.frames.empty()) {
+        for (const auto &availablePresentMode : availablePresentModes) {
+            if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+                return availablePresentMode;
+            }
+        }
+    }
     for (const auto &availablePresentMode : availablePresentModes) {
         if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
             return availablePresentMode;
@@ -987,12 +1838,12 @@ VkPresentModeKHR App::_chooseSwapPresentMode(const std::vector<VkPresentModeKHR>
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
-VkExtent2D App::_chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities) {
+VkExtent2D App::_chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities, GLFWwindow *window) {
     if (capabilities.currentExtent.width != UINT32_MAX) {
         return capabilities.currentExtent;
     }
     int width, height;
-    glfwGetFramebufferSize(_window, &width, &height);
+    glfwGetFramebufferSize(window, &width, &height);
     VkExtent2D actualExtent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
     actualExtent.width = std::max(
         capabilities.minImageExtent.width,
@@ -1015,12 +1866,101 @@ VkShaderModule App::_createShaderModule(const std::vector<char> &code) {
         throw std::runtime_error("Failed to create shader module");
     }
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Shader module created" << std::endl;
+    LOG_INFO("Shader module created");
 
     return shaderModule;
 }
 
-void App::_recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+VkSampleCountFlagBits App::_getMaxUsableSampleCount(uint32_t requested) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+
+    VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+    for (uint32_t samples = VK_SAMPLE_COUNT_64_BIT; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1) {
+        if (samples <= requested && (counts & samples)) {
+            return static_cast<VkSampleCountFlagBits>(samples);
+        }
+    }
+    return VK_SAMPLE_COUNT_1_BIT;
+}
+
+VkFormat App::_findDepthFormat() {
+    for (VkFormat format : {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT}) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+            return format;
+        }
+    }
+    throw std::runtime_error("Failed to find a supported depth format!");
+}
+
+void App::_createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkExtent2D extent, VkImage &image, VkDeviceMemory &memory, VkImageView &view) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = _msaaSamples;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    // Never loaded or stored, so tile based GPUs can keep it entirely in on-chip memory
+    imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Attachment, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    view = Utils::createImageView(_device, image, format, aspect, 0, 1);
+}
+
+void App::createGpuTimer() {
+    _gpuTimer.init(_physicalDevice, _device, _graphicsQueue, _queueFamilyIndices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+}
+
+VkCommandBuffer App::_prepareCommandBuffer(uint32_t imageIndex) {
+    PROFILE_FUNCTION();
+    uint32_t frame = static_cast<uint32_t>(_currentFrame);
+    const UniformBufferObject &uniforms = _frameUniforms[frame];
+    bool visible = _cullScene(uniforms);
+    VkExtent2D renderExtent = _options.targetGpuMilliseconds > 0.0f ? _dynamicResolution.getRenderExtent() : _swapChainExtent;
+    _selectLod(uniforms, renderExtent);
+
+    // Particles, sprites, extra views and frame capture record something new every frame
+    bool reusable = _options.reuseCommandBuffers && _options.particleCount == 0 && !_overlay && _views.empty() && !_frameCapture.isEnabled();
+
+    FrameRecording &recording = _recordings[frame * _swapChainImages.size() + imageIndex];
+    if (reusable && recording.valid && recording.visible == visible && recording.lod == _lod && recording.renderExtent.width == renderExtent.width &&
+        recording.renderExtent.height == renderExtent.height) {
+        // The recording reads the new uniforms, only the culling matrices live elsewhere
+        if (_meshletCulling && visible) {
+            _meshletCuller.updateParams(frame, uniforms.model, uniforms.view, uniforms.proj);
+        }
+        _gpuTimer.reuseFrame(frame, recording.gpuZones);
+        return recording.commandBuffer;
+    }
+
+    vkResetCommandBuffer(recording.commandBuffer, 0);
+    _recordCommandBuffer(recording.commandBuffer, imageIndex, visible);
+    _recordedFrames++;
+
+    recording.valid = reusable;
+    recording.visible = visible;
+    recording.lod = _lod;
+    recording.renderExtent = renderExtent;
+    recording.gpuZones = _gpuTimer.getZones(frame);
+    return recording.commandBuffer;
+}
+
+void App::_invalidateRecordings(uint32_t frame) {
+    size_t imageCount = _swapChainImages.size();
+    for (size_t i = 0; i < imageCount; i++) {
+        _recordings[frame * imageCount + i].valid = false;
+    }
+}
+
+void App::_recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool visible) {
+    PROFILE_FUNCTION();
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = 0;
@@ -1032,54 +1972,127 @@ void App::_recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageInde
         throw std::runtime_error("Failed to begin recording command buffer");
     }
 
+    uint32_t frame = static_cast<uint32_t>(_currentFrame);
+    _gpuTimer.beginFrame(commandBuffer, frame);
+    uint32_t frameZone = _gpuTimer.beginZone(commandBuffer, frame, "frame");
+
+    // With dynamic resolution the scene covers part of the target from its origin and is upscaled afterwards
+    bool dynamicResolution = _options.targetGpuMilliseconds > 0.0f;
+    VkExtent2D renderExtent = dynamicResolution ? _dynamicResolution.getRenderExtent() : _swapChainExtent;
+
     VkRenderPassBeginInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = _renderPass;
-    renderPassInfo.framebuffer = _swapChainFramebuffers[imageIndex];
+    renderPassInfo.renderPass = dynamicResolution ? _sceneRenderPass : _renderPass;
+    renderPassInfo.framebuffer = dynamicResolution ? _sceneFramebuffer : _swapChainFramebuffers[imageIndex];
     renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = _swapChainExtent;
+    renderPassInfo.renderArea.extent = renderExtent;
+
+    // Attachment 0 is the color target and attachment 1 depth in both render pass layouts
+    std::array<VkClearValue, 3> clearValues{};
+    clearValues[0].color = {{0.1f, 0.0f, 0.1f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    const UniformBufferObject &uniforms = _frameUniforms[_currentFrame];
+    const MeshLod &lod = _lodChain.lods[_lod];
+
+    // Two phase occlusion culling: last frame's visible meshlets are drawn into the
+    // depth pre-pass, and every meshlet is then tested against the pyramid built from it
+    bool occlusion = _occlusionCulling && _meshletCulling && visible;
+    if (occlusion) {
+        uint32_t prepassZone = _gpuTimer.beginZone(commandBuffer, frame, "depth pre-pass");
+        _meshletCuller.recordPrepass(commandBuffer, static_cast<uint32_t>(_currentFrame), uniforms.model, uniforms.view, uniforms.proj, _lodMeshlets[_lod]);
+
+        _hiz.beginDepthPass(commandBuffer);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _depthPrepassPipeline);
+        _bindGeometry(commandBuffer, _meshletCuller.getPrepassIndexBuffer(_currentFrame), _descriptorSets[_currentFrame]);
+        vkCmdDrawIndexedIndirect(commandBuffer, _meshletCuller.getPrepassDrawBuffer(_currentFrame), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+        vkCmdEndRenderPass(commandBuffer);
+
+        _gpuTimer.endZone(commandBuffer, frame, prepassZone);
+
+        uint32_t hizZone = _gpuTimer.beginZone(commandBuffer, frame, "hi-z build");
+        _hiz.build(commandBuffer);
+        _gpuTimer.endZone(commandBuffer, frame, hizZone);
+    }
+
+    if (_meshletCulling && visible) {
+        uint32_t cullZone = _gpuTimer.beginZone(commandBuffer, frame, "meshlet cull");
+        _meshletCuller.record(commandBuffer, static_cast<uint32_t>(_currentFrame), uniforms.model, uniforms.view, uniforms.proj, _lodMeshlets[_lod]);
+        _gpuTimer.endZone(commandBuffer, frame, cullZone);
+    }
+
+    if (_options.particleCount > 0 && !_particles.isAsync()) {
+        uint32_t particleZone = _gpuTimer.beginZone(commandBuffer, frame, "particles");
+        _particles.record(commandBuffer);
+        _gpuTimer.endZone(commandBuffer, frame, particleZone);
+    }
 
-    VkClearValue clearColor = {{{0.1f, 0.0f, 0.1f, 1.0f}}};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+    // Built even when the primary camera culled the mesh, the extra views read the same lists
+    if (_options.lightCount > 0) {
+        uint32_t lightZone = _gpuTimer.beginZone(commandBuffer, frame, "light culling");
+        _lighting.record(commandBuffer, static_cast<uint32_t>(_currentFrame));
+        _gpuTimer.endZone(commandBuffer, frame, lightZone);
+    }
 
+    uint32_t mainZone = _gpuTimer.beginZone(commandBuffer, frame, "main pass");
+    if (dynamicResolution) {
+        _dynamicResolution.beginScene(commandBuffer);
+    }
     vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-
-    VkBuffer vertexBuffers[] = {_vertexBuffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    _bindGeometry(commandBuffer, _meshletCulling ? _meshletCuller.getIndexBuffer(_currentFrame) : VK_NULL_HANDLE, _descriptorSets[_currentFrame]);
 
     VkViewport viewport = {};
     viewport.x = 0.0f;
     viewport.y = 0.0f;
 
-    viewport.width = static_cast<float>(_swapChainExtent.width);
-    viewport.height = static_cast<float>(_swapChainExtent.height);
+    viewport.width = static_cast<float>(renderExtent.width);
+    viewport.height = static_cast<float>(renderExtent.height);
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
     VkRect2D scissor{};
     scissor.offset = {0, 0};
-    scissor.extent = _swapChainExtent;
+    scissor.extent = renderExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    vkCmdBindDescriptorSets(
-        commandBuffer,
-        VK_PIPELINE_BIND_POINT_GRAPHICS,
-        _pipelineLayout,
-        0,
-        1,
-        &_descriptorSets[_currentFrame],
-        0,
-        nullptr);
-
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(_indices.size()), 1, 0, 0, 0);
+    // When the scene index culled the mesh the render pass only clears the frame
+    if (visible && _meshletCulling) {
+        vkCmdDrawIndexedIndirect(commandBuffer, _meshletCuller.getDrawBuffer(_currentFrame), 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+    } else if (visible) {
+        for (uint32_t i = 0; i < _options.drawCount; i++) {
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, _options.instanceCount, lod.firstIndex, 0, 0);
+        }
+    }
+    if (_options.particleCount > 0) {
+        _particles.draw(commandBuffer, uniforms.view, uniforms.proj);
+    }
+    // Sprites are placed in window pixels, the viewport maps them onto the scaled area
+    if (_overlay) {
+        _sprites.record(commandBuffer, _swapChainExtent);
+    }
 
     vkCmdEndRenderPass(commandBuffer);
+    _gpuTimer.endZone(commandBuffer, frame, mainZone);
+
+    if (dynamicResolution) {
+        uint32_t upscaleZone = _gpuTimer.beginZone(commandBuffer, frame, "upscale");
+        _dynamicResolution.recordUpscale(commandBuffer, imageIndex);
+        _gpuTimer.endZone(commandBuffer, frame, upscaleZone);
+    }
+
+    if (!_views.empty()) {
+        uint32_t viewsZone = _gpuTimer.beginZone(commandBuffer, frame, "views");
+        _recordViews(commandBuffer);
+        _gpuTimer.endZone(commandBuffer, frame, viewsZone);
+    }
+
+    _frameCapture.record(commandBuffer, _swapChainImages[imageIndex], _currentFrame);
+    _gpuTimer.endZone(commandBuffer, frame, frameZone);
 
     result = vkEndCommandBuffer(commandBuffer);
     if (result != VK_SUCCESS) {
@@ -1087,8 +2100,70 @@ void App::_recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageInde
     }
 }
 
+// Binds the mesh's vertices and indices, plus the view's descriptor set and the light clusters
+// for the current frame. Culled meshlets come with their own index buffer.
+void App::_bindGeometry(VkCommandBuffer commandBuffer, VkBuffer meshletIndexBuffer, VkDescriptorSet descriptorSet) {
+    if (_vertexPulling) {
+        const MeshRange &mesh = _geometry.getMesh(_mesh);
+        VertexPullConstants constants{mesh.vertexAddress, mesh.vertexStride, mesh.vertexLayout};
+        vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+    } else {
+        VkBuffer vertexBuffers[] = {_vertexBuffer};
+        VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    }
+
+    if (meshletIndexBuffer != VK_NULL_HANDLE) {
+        vkCmdBindIndexBuffer(commandBuffer, meshletIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    } else if (_vertexPulling) {
+        vkCmdBindIndexBuffer(commandBuffer, _geometry.getBuffer(), _geometry.getMesh(_mesh).indexOffset, VK_INDEX_TYPE_UINT32);
+    } else {
+        vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    }
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    if (_options.lightCount > 0) {
+        VkDescriptorSet lightSet = _lighting.getDescriptorSet(static_cast<uint32_t>(_currentFrame));
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 1, 1, &lightSet, 0, nullptr);
+    }
+}
+
+bool App::_needsRedraw() {
+    if (_frameCount == 0 || _redrawRequested || _framebufferResized) {
+        return true;
+    }
+    for (const SurfaceView &view : _views) {
+        if (view.resized) {
+            return true;
+        }
+    }
+
+    // Particles, sprites and lights animate by themselves, streamed mips change the texture
+    if (_options.particleCount > 0 || _options.spriteCount > 0 || _options.lightCount > 0 || !_textureStreamer.isIdle()) {
+        return true;
+    }
+
+    // Keeps changing for one tick after the animation paused, while samples settle on the last tick
+    SceneState scene = _simulation.sample(std::chrono::steady_clock::now());
+    return scene.rotation != _drawnScene.rotation || scene.cameraPosition != _drawnScene.cameraPosition || scene.cameraTarget != _drawnScene.cameraTarget;
+}
+
 void App::_drawFrame() {
+    PROFILE_FUNCTION();
     vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+    _frameCapture.collect(_currentFrame);
+    bool timed = _gpuTimer.collect(static_cast<uint32_t>(_currentFrame));
+    VkExtent2D renderExtent{};
+    if (_options.targetGpuMilliseconds > 0.0f) {
+        // A replay renders the captured sizes, the controller would follow this machine's GPU instead
+        const TraceFrame *replayed = _replay.frames.empty() ? nullptr : &_replay.frames[_replayFrame];
+        if (replayed != nullptr && replayed->renderWidth > 0) {
+            _dynamicResolution.pinRenderExtent({replayed->renderWidth, replayed->renderHeight});
+        } else if (timed) {
+            _dynamicResolution.update(_gpuTimer.getLastFrameTime());
+        }
+        renderExtent = _dynamicResolution.getRenderExtent();
+    }
 
     uint32_t imageIndex;
     auto result = vkAcquireNextImageKHR(
@@ -1105,98 +2180,168 @@ void App::_drawFrame() {
     } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("Failed to acquire swap chain image");
     }
-    _updateUniformBuffer(_currentFrame);
+
+    // CPU side frame work runs on the job system while this thread services the
+    // streamer, which talks to the queue and has to stay on the render thread
+    JobCounter frameJobs;
+    uint32_t frameIndex = static_cast<uint32_t>(_currentFrame);
+    _jobSystem.run("update uniforms", [this, frameIndex]() { _updateUniformBuffer(frameIndex); }, &frameJobs);
+
+    if (_uploadTarget != VK_NULL_HANDLE) {
+        Utils::uploadBuffer(_physicalDevice, _device, _graphicsQueue, _commandPool, _uploadTarget, 0, _uploadData.data(), _uploadData.size());
+    }
+
+    // The fence above guarantees this frame's descriptor set is no longer in use
+    _textureStreamer.request(_texture, 0, 1.0f);
+    _textureStreamer.update();
+    // Updating a descriptor set invalidates the command buffers it was bound in
+    if (_updateTextureDescriptor(_descriptorSets[_currentFrame], _boundTextureViews[_currentFrame])) {
+        _invalidateRecordings(frameIndex);
+    }
+
+    _jobSystem.wait(frameJobs);
+
+    if (_overlay) {
+        _drawOverlay();
+    }
+    if (_options.lightCount > 0) {
+        _updateLights();
+    }
+    if (!_views.empty()) {
+        _prepareViews();
+    }
+
+    if (_options.particleCount > 0) {
+        // Replays step at a fixed rate so every run simulates the same particles
+        auto now = std::chrono::steady_clock::now();
+        float deltaTime = _replay.frames.empty() ? std::min(std::chrono::duration<float>(now - _particleTime).count(), 0.1f) : 1.0f / 60.0f;
+        _particleTime = now;
+        _particles.beginFrame(deltaTime, _frameUniforms[_currentFrame].view);
+        if (_particles.isAsync()) {
+            _particles.submit();
+        }
+    }
 
     vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
 
-    vkResetCommandBuffer(_commandBuffers[_currentFrame], 0);
-    _recordCommandBuffer(_commandBuffers[_currentFrame], imageIndex);
+    VkCommandBuffer commandBuffer = _prepareCommandBuffer(imageIndex);
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = {_imageAvailableSemaphores[_currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_commandBuffers[_currentFrame];
+    // Every acquired view's image is waited for and signaled alongside the primary one,
+    // so the whole frame goes out in one submit and one present
+    std::vector<VkSemaphore> waitSemaphores = {_imageAvailableSemaphores[_currentFrame]};
+    std::vector<VkPipelineStageFlags> waitStages = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+    std::vector<VkSemaphore> signalSemaphores = {_renderFinishedSemaphores[_currentFrame]};
+    std::vector<VkSwapchainKHR> swapChains = {_swapChain};
+    std::vector<uint32_t> imageIndices = {imageIndex};
+    std::vector<SurfaceView *> presentedViews;
+    for (SurfaceView &view : _views) {
+        if (view.acquired) {
+            waitSemaphores.push_back(view.imageAvailableSemaphores[_currentFrame]);
+            waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            signalSemaphores.push_back(view.renderFinishedSemaphores[_currentFrame]);
+            swapChains.push_back(view.swapChain);
+            imageIndices.push_back(view.imageIndex);
+            presentedViews.push_back(&view);
+        }
+    }
 
-    VkSemaphore signalSemaphores[] = {_renderFinishedSemaphores[_currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    // With async compute the frame waits for the previous particle step and tells the
+    // next one it is done drawing. The timelines go last, the values of the binary
+    // semaphores before them are ignored.
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+    std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+    if (_options.particleCount > 0 && _particles.isAsync()) {
+        waitSemaphores.push_back(_particles.getComputeTimeline());
+        waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+        waitValues.push_back(_particles.getGraphicsWaitValue());
+        signalSemaphores.push_back(_particles.getGraphicsTimeline());
+        signalValues.push_back(_particles.getGraphicsSignalValue());
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+        submitInfo.pNext = &timelineInfo;
+    }
+
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
 
     result = vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]);
     if (result != VK_SUCCESS) {
         throw std::runtime_error("Failed to submit draw command buffer");
     }
 
+    std::vector<VkResult> presentResults(swapChains.size(), VK_SUCCESS);
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-
-    VkSwapchainKHR swapChains[] = {_swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.pResults = nullptr;
+    presentInfo.waitSemaphoreCount = static_cast<uint32_t>(swapChains.size());
+    presentInfo.pWaitSemaphores = signalSemaphores.data();
+    presentInfo.swapchainCount = static_cast<uint32_t>(swapChains.size());
+    presentInfo.pSwapchains = swapChains.data();
+    presentInfo.pImageIndices = imageIndices.data();
+    presentInfo.pResults = presentResults.data();
 
     result = vkQueuePresentKHR(_presentQueue, &presentInfo);
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _framebufferResized) {
-        _framebufferResized = false;
-        recreateSwapChain();
-    } else if (result != VK_SUCCESS) {
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR && result != VK_ERROR_OUT_OF_DATE_KHR) {
         throw std::runtime_error("Failed to present swap chain image");
     }
-
-    _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-}
-
-uint32_t App::_findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
-
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            return i;
+    // Views are recreated before their next acquire
+    for (size_t i = 0; i < presentedViews.size(); i++) {
+        if (presentResults[i + 1] == VK_ERROR_OUT_OF_DATE_KHR || presentResults[i + 1] == VK_SUBOPTIMAL_KHR) {
+            presentedViews[i]->resized = true;
         }
     }
-
-    throw std::runtime_error("Failed to find suitable memory type");
-}
-
-void App::_createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = size;
-    bufferInfo.usage = usage;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    bufferInfo.flags = 0;
-
-    auto result = vkCreateBuffer(_device, &bufferInfo, nullptr, &buffer);
-    if (result != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create vertex buffer!");
+    if (presentResults[0] == VK_ERROR_OUT_OF_DATE_KHR || presentResults[0] == VK_SUBOPTIMAL_KHR || _framebufferResized) {
+        _framebufferResized = false;
+        recreateSwapChain();
     }
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(_device, buffer, &memRequirements);
+    if (_traceWriter.isOpen()) {
+        const UniformBufferObject &uniforms = _frameUniforms[_currentFrame];
+        TraceFrame frame;
+        frame.time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _traceStart).count();
+        frame.width = _swapChainExtent.width;
+        frame.height = _swapChainExtent.height;
+        frame.lod = _lod;
+        frame.renderWidth = renderExtent.width;
+        frame.renderHeight = renderExtent.height;
+        frame.model = uniforms.model;
+        frame.view = uniforms.view;
+        frame.proj = uniforms.proj;
+        _traceWriter.writeFrame(frame);
+    } else if (!_replay.frames.empty()) {
+        _advanceReplay();
+    }
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = _findMemoryType(memRequirements.memoryTypeBits, properties);
+    _currentFrame = (_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    _frameCount++;
 
-    result = vkAllocateMemory(_device, &allocInfo, nullptr, &bufferMemory);
-    if (result != VK_SUCCESS) {
-        throw std::runtime_error("Failed to allocate vertex buffer memory!");
+    // Other processes change what is left of the budget, allocations are checked as they happen
+    if (_frameCount % MEMORY_BUDGET_POLL_FRAMES == 0) {
+        MemoryTelemetry::get().pollBudget();
     }
+}
 
-    vkBindBufferMemory(_device, buffer, bufferMemory, 0);
+uint32_t App::_findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+    return Utils::findMemoryType(_physicalDevice, typeFilter, properties);
+}
+
+void App::_createBuffer(MemoryCategory category, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
+    Utils::createBuffer(_physicalDevice, _device, category, size, usage, properties, buffer, bufferMemory);
 }
 
 void App::_copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+    PROFILE_FUNCTION();
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = _commandPool;
@@ -1241,37 +2386,285 @@ void App::_copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 }
 
 void App::_updateUniformBuffer(uint32_t currentImage) {
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
-
+    PROFILE_FUNCTION();
     UniformBufferObject ubo{};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    if (!_replay.frames.empty()) {
+        const TraceFrame &frame = _replay.frames[_replayFrame];
+        ubo.model = frame.model;
+        ubo.view = frame.view;
+        ubo.proj = frame.proj;
+        ubo.instancesPerRow = _instancesPerRow;
+        memcpy(_uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+        _frameUniforms[currentImage] = ubo;
+        return;
+    }
+
+    SceneState scene = _simulation.sample(std::chrono::steady_clock::now());
+    _drawnScene = scene;
+    ubo.model = glm::rotate(glm::mat4(1.0f), scene.rotation, glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = glm::lookAt(scene.cameraPosition, scene.cameraTarget, glm::vec3(0.0f, 0.0f, 1.0f));
     ubo.proj = glm::perspective(glm::radians(45.0f), _swapChainExtent.width / (float)_swapChainExtent.height, 0.1f, 10.0f);
     ubo.proj[1][1] *= -1;  // flip y coordinate since glm was made for OpenGL and Y coordinate is inverted in Vulkan
+    ubo.instancesPerRow = _instancesPerRow;
     memcpy(_uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    _frameUniforms[currentImage] = ubo;
+}
+
+bool App::_cullScene(const UniformBufferObject &uniforms) {
+    _sceneIndex.setBounds(_sceneObject, _meshBounds.transformed(uniforms.model));
+    _sceneIndex.update();
+
+    _visibleObjects.clear();
+    _sceneIndex.cull(Frustum::fromMatrix(uniforms.proj * uniforms.view), _visibleObjects, &_jobSystem);
+    return !_visibleObjects.empty();
+}
+
+// Errors are measured in pixels of the scene render, which dynamic resolution shrinks below the swap chain
+void App::_selectLod(const UniformBufferObject &uniforms, VkExtent2D renderExtent) {
+    glm::vec4 center = uniforms.view * uniforms.model * glm::vec4(_lodChain.center, 1.0f);
+    float projectionScale = std::abs(uniforms.proj[1][1]) * renderExtent.height * 0.5f;
+
+    uint32_t lod = _lodSelector.select(_lodChain, glm::length(glm::vec3(center)), projectionScale, _lod);
+    if (lod != _lod) {
+        LOG_INFO("Switched to LOD ", lod, " (", _lodChain.lods[lod].indexCount / 3, " triangles)");
+        _lod = lod;
+    }
+}
+
+void App::_loadReplay() {
+    std::string name = _options.replayTrace ? "generated frame trace" : "frame trace " + _options.replayFile;
+    _replay = _options.replayTrace ? *_options.replayTrace : FrameTrace::load(_options.replayFile);
+    if (_replay.frames.empty()) {
+        throw std::runtime_error("The " + name + " has no frames");
+    }
+
+    const TraceConfig &config = _replay.config;
+    _width = config.width;
+    _height = config.height;
+    _options.msaaSamples = config.msaaSamples;
+    _options.meshletCulling = config.meshletCulling != 0;
+    _options.occlusionCulling = config.occlusionCulling != 0;
+    _options.meshLods = config.meshLods != 0;
+    _options.drawCount = config.drawCount;
+    _options.instanceCount = config.instanceCount;
+    _options.uploadBytesPerFrame = config.uploadBytesPerFrame;
+    _options.particleCount = config.particleCount;
+    _options.asyncCompute = config.asyncCompute != 0;
+    _options.spriteCount = config.spriteCount;
+    _options.debugBounds = config.debugBounds != 0;
+    _options.lightCount = config.lightCount;
+    _options.extraViews = config.extraViews;
+    _options.targetGpuMilliseconds = config.targetGpuMilliseconds;
+    _options.minResolutionScale = config.minResolutionScale;
+    _options.upscaleSharpness = config.upscaleSharpness;
+    _options.reuseCommandBuffers = config.reuseCommandBuffers != 0;
+
+    const TraceBuffer *vertices = _replay.findBuffer("vertices");
+    const TraceBuffer *indices = _replay.findBuffer("indices");
+    if (vertices == nullptr || indices == nullptr) {
+        throw std::runtime_error("The " + name + " has no geometry");
+    }
+    if (vertices->stride != sizeof(Vertex) || indices->stride != sizeof(uint32_t)) {
+        throw std::runtime_error("The " + name + " was made with a different vertex layout");
+    }
+    _vertices.resize(vertices->data.size() / sizeof(Vertex));
+    memcpy(_vertices.data(), vertices->data.data(), _vertices.size() * sizeof(Vertex));
+    _indices.resize(indices->data.size() / sizeof(uint32_t));
+    memcpy(_indices.data(), indices->data.data(), _indices.size() * sizeof(uint32_t));
+}
+
+void App::_advanceReplay() {
+    auto now = std::chrono::steady_clock::now();
+    _replayFrameTimes.push_back(std::chrono::duration<float, std::milli>(now - _replayLastPresent).count());
+    _replayLastPresent = now;
+
+    // The same inputs should select the same LOD, a mismatch means the workload changed
+    uint32_t capturedLod = _replay.frames[_replayFrame].lod;
+    if (capturedLod != UINT32_MAX && _lod != capturedLod) {
+        _replayLodMismatches++;
+    }
+
+    if (++_replayFrame == _replay.frames.size()) {
+        _replayFrame = 0;
+        _replayLoop++;
+    }
+}
+
+void App::_reportReplay() const {
+    if (_replayFrameTimes.empty()) {
+        return;
+    }
+    double seconds = std::chrono::duration<double>(_replayLastPresent - _replayStart).count();
+    std::vector<float> frameTimes = _replayFrameTimes;
+    std::sort(frameTimes.begin(), frameTimes.end());
+    double total = 0.0;
+    for (float time : frameTimes) {
+        total += time;
+    }
+
+    std::ostringstream line;
+    line << "Replayed " << frameTimes.size() << " frames in " << std::fixed << std::setprecision(3) << seconds << " s: "
+         << std::setprecision(1) << frameTimes.size() / seconds << " frames/s, "
+         << std::setprecision(3) << total / frameTimes.size() << " ms avg, "
+         << frameTimes[frameTimes.size() / 2] << " ms median, "
+         << frameTimes[std::min(frameTimes.size() - 1, frameTimes.size() * 99 / 100)] << " ms p99, "
+         << frameTimes.back() << " ms max";
+    LOG_INFO(line.str());
+    if (_replayLodMismatches > 0) {
+        LOG_WARNING(_replayLodMismatches, " replayed frames selected a different LOD than the capture");
+    }
+}
+
+bool App::_updateTextureDescriptor(VkDescriptorSet descriptorSet, VkImageView &boundView) {
+    VkImageView imageView = _textureStreamer.getImageView(_texture);
+    if (boundView == imageView) {
+        return false;
+    }
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = _textureStreamer.getSampler();
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = descriptorSet;
+    descriptorWrite.dstBinding = 1;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(_device, 1, &descriptorWrite, 0, nullptr);
+
+    boundView = imageView;
+    return true;
+}
+
+void App::_drawOverlay() {
+    PROFILE_FUNCTION();
+    _sprites.beginFrame(static_cast<uint32_t>(_currentFrame));
+
+    // A grid of sprites filling the window, wobbling so every frame streams new vertices.
+    // The quads are reserved in one go and their vertices written in parallel.
+    SpriteVertex *vertices = _options.spriteCount > 0 ? _sprites.reserveQuads(_textureStreamer.getImageView(_texture), _options.spriteCount) : nullptr;
+    if (vertices != nullptr) {
+        uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(_options.spriteCount))));
+        glm::vec2 cell = glm::vec2(_swapChainExtent.width, _swapChainExtent.height) / static_cast<float>(columns);
+        // Frames rather than wall time, so replays stream the same sprites
+        float time = _frameCount / 60.0f;
+        uint32_t texCoords[4] = {SpriteVertex::packTexCoord({0.0f, 0.0f}), SpriteVertex::packTexCoord({1.0f, 0.0f}),
+                                 SpriteVertex::packTexCoord({1.0f, 1.0f}), SpriteVertex::packTexCoord({0.0f, 1.0f})};
+        _jobSystem.parallelFor("sprites", _options.spriteCount, 4096, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                float phase = time * 2.0f + i * 0.1f;
+                glm::vec2 center = (glm::vec2(i % columns, i / columns) + 0.5f + 0.2f * glm::vec2(std::cos(phase), std::sin(phase))) * cell;
+                glm::vec2 half = cell * 0.4f;
+                uint32_t color = SpriteVertex::packColor(glm::vec4(0.5f + 0.5f * std::sin(phase), static_cast<float>(i % columns) / columns, 1.0f, 0.8f));
+                SpriteVertex *quad = vertices + 4 * static_cast<size_t>(i);
+                quad[0] = {center - half, texCoords[0], color};
+                quad[1] = {{center.x + half.x, center.y - half.y}, texCoords[1], color};
+                quad[2] = {center + half, texCoords[2], color};
+                quad[3] = {{center.x - half.x, center.y + half.y}, texCoords[3], color};
+            }
+        });
+    }
+
+    if (_options.debugBounds) {
+        // Skipped while any corner is behind the camera, its projection would wrap around
+        const UniformBufferObject &uniforms = _frameUniforms[_currentFrame];
+        glm::mat4 transform = uniforms.proj * uniforms.view * uniforms.model;
+        glm::vec2 extent(_swapChainExtent.width, _swapChainExtent.height);
+        glm::vec2 min(std::numeric_limits<float>::max());
+        glm::vec2 max(std::numeric_limits<float>::lowest());
+        bool inFront = true;
+        for (uint32_t corner = 0; corner < 8 && inFront; corner++) {
+            glm::vec3 position((corner & 1) ? _meshBounds.max.x : _meshBounds.min.x, (corner & 2) ? _meshBounds.max.y : _meshBounds.min.y,
+                               (corner & 4) ? _meshBounds.max.z : _meshBounds.min.z);
+            glm::vec4 clip = transform * glm::vec4(position, 1.0f);
+            inFront = clip.w > 0.0f;
+            glm::vec2 pixel = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * extent;
+            min = glm::min(min, pixel);
+            max = glm::max(max, pixel);
+        }
+        if (inFront) {
+            _sprites.drawRect(min, max, SpriteVertex::packColor(glm::vec4(0.2f, 1.0f, 0.2f, 1.0f)));
+        }
+    }
+}
+
+void App::_updateLights() {
+    PROFILE_FUNCTION();
+    uint32_t frame = static_cast<uint32_t>(_currentFrame);
+    const UniformBufferObject &uniforms = _frameUniforms[frame];
+    PointLight *lights = _lighting.getLights(frame);
+    // Frames rather than wall time, so replays light the same frames
+    float time = _frameCount / 60.0f;
+    glm::mat4 model = uniforms.model;
+    _jobSystem.parallelFor("lights", _options.lightCount, 1024, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            const PointLight &orbit = _lightOrbits[i];
+            // Small circles around each anchor, alternating direction
+            float phase = time * (i % 2 == 0 ? 1.0f : -1.0f) + i * 0.37f;
+            glm::vec3 offset = glm::vec3(std::cos(phase), std::sin(phase), 0.0f) * (orbit.positionRadius.w * 0.5f);
+            glm::vec4 position = model * glm::vec4(glm::vec3(orbit.positionRadius) + offset, 1.0f);
+            lights[i].positionRadius = glm::vec4(glm::vec3(position), orbit.positionRadius.w);
+            lights[i].color = orbit.color;
+        }
+    });
+    _lighting.update(frame, _options.lightCount, uniforms.view, uniforms.proj, glm::vec3(LIGHT_AMBIENT));
 }
 
 void App::cleanup() {
+    _frameCapture.cleanup();
+    _traceWriter.close();
+    if (_uploadTarget != VK_NULL_HANDLE) {
+        vkDestroyBuffer(_device, _uploadTarget, nullptr);
+        Utils::freeMemory(_device, _uploadTargetMemory);
+    }
+    _gpuTimer.cleanup();
+    if (_options.particleCount > 0) {
+        _particles.cleanup();
+    }
+    if (_overlay) {
+        _sprites.cleanup();
+    }
+    if (_options.lightCount > 0) {
+        _lighting.cleanup();
+    }
+    cleanupViews();
     cleanupSwapChain();
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroyBuffer(_device, _uniformBuffers[i], nullptr);
-        vkFreeMemory(_device, _uniformBuffersMemory[i], nullptr);
+        Utils::freeMemory(_device, _uniformBuffersMemory[i]);
     }
 
     vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    _textureStreamer.cleanup();
+    _mipGenerator.cleanup();
     vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
 
     vkDestroyBuffer(_device, _vertexBuffer, nullptr);
-    vkFreeMemory(_device, _vertexBufferMemory, nullptr);
+    Utils::freeMemory(_device, _vertexBufferMemory);
     vkDestroyBuffer(_device, _indexBuffer, nullptr);
-    vkFreeMemory(_device, _indexBufferMemory, nullptr);
+    Utils::freeMemory(_device, _indexBufferMemory);
+    if (_vertexPulling) {
+        _geometry.cleanup();
+    }
+    if (_meshletCulling) {
+        _meshletCuller.cleanup();
+    }
+    if (_occlusionCulling) {
+        _hiz.cleanup();
+        vkDestroyPipeline(_device, _depthPrepassPipeline, nullptr);
+    }
 
     vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    if (_options.targetGpuMilliseconds > 0.0f) {
+        _dynamicResolution.cleanup();
+        vkDestroyRenderPass(_device, _sceneRenderPass, nullptr);
+    }
     vkDestroyRenderPass(_device, _renderPass, nullptr);
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -1282,6 +2675,10 @@ void App::cleanup() {
 
     vkDestroyCommandPool(_device, _commandPool, nullptr);
 
+    // Everything is released by now, whatever is still tracked leaked
+    MemoryTelemetry::get().report();
+    MemoryTelemetry::get().reportLeaks();
+
     vkDestroyDevice(_device, nullptr);
     if (_enableValidationLayers) {
         DestroyDebugUtilsMessengerEXT(_instance, _debugMessenger, nullptr);
@@ -1294,7 +2691,12 @@ void App::cleanup() {
     glfwDestroyWindow(_window);
     glfwTerminate();
 
-    std::cout << UNI_GREEN << "Info: " << UNI_RESET << "Cleanup finished" << std::endl;
+    _jobSystem.report();
+    if (!_options.traceFile.empty()) {
+        Profiler::get().exportChromeTrace(_options.traceFile);
+    }
+
+    LOG_INFO("Cleanup finished");
 }
 
 VKAPI_ATTR VkBool32 VKAPI_CALL App::_debugCallback(
@@ -1304,23 +2706,31 @@ VKAPI_ATTR VkBool32 VKAPI_CALL App::_debugCallback(
     void *pUserData) {
     (void)(pUserData);
     (void)(messageType);
+
+    // Validation repeats the same complaint every frame, only the first few make it to the log
+    uint64_t key = static_cast<uint32_t>(pCallbackData->messageIdNumber);
+    if (pCallbackData->pMessageIdName != nullptr) {
+        key ^= std::hash<std::string_view>()(pCallbackData->pMessageIdName);
+    }
+    if (!Logger::get().allowRepeat(key)) {
+        return VK_FALSE;
+    }
+
     switch (messageSeverity) {
         case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-#ifdef VERBOSE
-            std::cout << UNI_BLUE << "VK_Verbose: " << UNI_RESET << pCallbackData->pMessage << std::endl;
-#endif
+            LOG_VERBOSE("VK: ", pCallbackData->pMessage);
             break;
         case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-            std::cout << UNI_GREEN << "VK_Info: " << UNI_RESET << pCallbackData->pMessage << std::endl;
+            LOG_INFO("VK: ", pCallbackData->pMessage);
             break;
         case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-            std::cerr << UNI_YELLOW << "VK_Warning: " << UNI_RESET << pCallbackData->pMessage << std::endl;
+            LOG_WARNING("VK: ", pCallbackData->pMessage);
             break;
         case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-            std::cerr << UNI_RED << "VK_Error: " << UNI_RESET << pCallbackData->pMessage << std::endl;
+            LOG_ERROR("VK: ", pCallbackData->pMessage);
             break;
         default:
-            std::cout << UNI_REDBACK << "VK_Unknown: " << UNI_RESET << pCallbackData->pMessage << std::endl;
+            LOG_ERROR("VK (unknown severity): ", pCallbackData->pMessage);
             break;
     }
 
@@ -0,0 +1,477 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "App.h"
+#include "FrameTrace.h"
+#include "Logger.h"
+#include "MemoryTelemetry.h"
+#include "utils.h"
+
+#define BENCHMARK_BASELINES "benchmarks/baselines.json"
+#define BENCHMARK_WARMUP_FRAMES 30
+#define BENCHMARK_FRAMES 300
+#define BENCHMARK_WIDTH 800
+#define BENCHMARK_HEIGHT 600
+// Frame times regress when the median grows by more than this share of the baseline
+// plus this many standard deviations, estimated from the median absolute deviation
+#define BENCHMARK_FRAME_TOLERANCE 0.10
+#define BENCHMARK_FRAME_SIGMAS 4.0
+// Startup is measured once per run and noisier, memory is nearly deterministic
+#define BENCHMARK_STARTUP_TOLERANCE 0.25
+#define BENCHMARK_STARTUP_SLACK_MS 5.0
+#define BENCHMARK_MEMORY_TOLERANCE 0.05
+#define BENCHMARK_MEMORY_SLACK_MIB 1.0
+
+struct BenchmarkScene {
+    const char *name;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    bool meshletCulling = true;
+    bool meshLods = true;
+    uint32_t drawCount = 1;
+    uint32_t instanceCount = 1;
+    VkDeviceSize uploadBytesPerFrame = 0;
+    uint32_t particleCount = 0;
+    bool asyncCompute = true;
+    uint32_t spriteCount = 0;
+    bool reuseCommandBuffers = true;
+    uint32_t lightCount = 0;
+};
+
+// Metric name to value, one set per scene
+using SceneMetrics = std::map<std::string, double>;
+
+// Just enough JSON for the baselines: nested objects of numbers
+struct JsonValue {
+    double number = 0.0;
+    std::map<std::string, JsonValue> object;
+};
+
+static void skipSpace(const std::string &text, size_t &position) {
+    while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) {
+        position++;
+    }
+}
+
+static void expect(const std::string &text, size_t &position, char c) {
+    skipSpace(text, position);
+    if (position >= text.size() || text[position] != c) {
+        throw std::runtime_error(std::string("Malformed baselines, expected '") + c + "' at offset " + std::to_string(position));
+    }
+    position++;
+}
+
+static std::string parseString(const std::string &text, size_t &position) {
+    expect(text, position, '"');
+    std::string value;
+    while (position < text.size() && text[position] != '"') {
+        if (text[position] == '\\' && position + 1 < text.size()) {
+            position++;
+        }
+        value += text[position++];
+    }
+    expect(text, position, '"');
+    return value;
+}
+
+static JsonValue parseValue(const std::string &text, size_t &position) {
+    JsonValue value;
+    skipSpace(text, position);
+    if (position < text.size() && text[position] == '{') {
+        position++;
+        skipSpace(text, position);
+        if (position < text.size() && text[position] == '}') {
+            position++;
+            return value;
+        }
+        while (true) {
+            std::string key = parseString(text, position);
+            expect(text, position, ':');
+            value.object[key] = parseValue(text, position);
+            skipSpace(text, position);
+            if (position < text.size() && text[position] == ',') {
+                position++;
+                continue;
+            }
+            expect(text, position, '}');
+            return value;
+        }
+    }
+
+    const char *start = text.c_str() + position;
+    char *end = nullptr;
+    value.number = std::strtod(start, &end);
+    if (end == start) {
+        throw std::runtime_error("Malformed baselines, expected a number at offset " + std::to_string(position));
+    }
+    position += end - start;
+    return value;
+}
+
+// Baselines of every device, device name to scene name to metrics
+using Baselines = std::map<std::string, std::map<std::string, SceneMetrics>>;
+
+static Baselines loadBaselines(const std::string &filename) {
+    Baselines baselines;
+    std::ifstream file(filename);
+    if (!file) {
+        return baselines;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+    size_t position = 0;
+    JsonValue root = parseValue(text, position);
+    for (const auto &[device, scenes] : root.object["devices"].object) {
+        for (const auto &[scene, metrics] : scenes.object) {
+            for (const auto &[metric, value] : metrics.object) {
+                baselines[device][scene][metric] = value.number;
+            }
+        }
+    }
+    return baselines;
+}
+
+static void saveBaselines(const std::string &filename, const Baselines &baselines) {
+    std::filesystem::path parent = std::filesystem::path(filename).parent_path();
+    if (!parent.empty()) {
+        std::filesystem::create_directories(parent);
+    }
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Failed to write baselines to " + filename);
+    }
+    file << std::setprecision(6) << "{\n  \"devices\": {";
+    bool firstDevice = true;
+    for (const auto &[device, scenes] : baselines) {
+        file << (firstDevice ? "" : ",") << "\n    \"" << Utils::escapeJson(device) << "\": {";
+        firstDevice = false;
+        bool firstScene = true;
+        for (const auto &[scene, metrics] : scenes) {
+            file << (firstScene ? "" : ",") << "\n      \"" << Utils::escapeJson(scene) << "\": {";
+            firstScene = false;
+            bool firstMetric = true;
+            for (const auto &[metric, value] : metrics) {
+                file << (firstMetric ? "" : ", ") << "\"" << metric << "\": " << value;
+                firstMetric = false;
+            }
+            file << "}";
+        }
+        file << "\n    }";
+    }
+    file << "\n  }\n}\n";
+}
+
+// Drivers append their version to the device name, e.g. "llvmpipe (LLVM 15.0.7, 256 bits)",
+// baselines are keyed by the part before it so a driver update does not orphan them
+static std::string baselineDevice(const std::string &deviceName) {
+    std::string device = deviceName.substr(0, deviceName.find(" ("));
+    while (!device.empty() && std::isspace(static_cast<unsigned char>(device.back()))) {
+        device.pop_back();
+    }
+    return device;
+}
+
+static double median(std::vector<float> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+// Median absolute deviation, a spread estimate that ignores the odd hitch
+static double medianDeviation(const std::vector<float> &values, double center) {
+    std::vector<float> deviations;
+    for (float value : values) {
+        deviations.push_back(static_cast<float>(std::abs(value - center)));
+    }
+    return median(deviations);
+}
+
+// Side by side quads with the corner colors and texture coordinates of the app's default quad
+static void makeQuadGrid(BenchmarkScene &scene, uint32_t quadsPerSide) {
+    const glm::vec3 colors[4] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f}};
+    const glm::vec2 texCoords[4] = {{1.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 1.0f}, {1.0f, 1.0f}};
+    const glm::vec2 corners[4] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+    float size = 1.0f / quadsPerSide;
+    float gap = quadsPerSide > 1 ? size * 0.1f : 0.0f;
+
+    for (uint32_t y = 0; y < quadsPerSide; y++) {
+        for (uint32_t x = 0; x < quadsPerSide; x++) {
+            uint32_t first = static_cast<uint32_t>(scene.vertices.size());
+            glm::vec2 origin(-0.5f + x * size + gap * 0.5f, -0.5f + y * size + gap * 0.5f);
+            for (uint32_t corner = 0; corner < 4; corner++) {
+                scene.vertices.push_back({origin + corners[corner] * (size - gap), colors[corner], texCoords[corner]});
+            }
+            for (uint32_t index : {0, 1, 2, 2, 3, 0}) {
+                scene.indices.push_back(first + index);
+            }
+        }
+    }
+}
+
+// One mesh with shared vertices
+static void makeDenseGrid(BenchmarkScene &scene, uint32_t cellsPerSide) {
+    uint32_t side = cellsPerSide + 1;
+    for (uint32_t y = 0; y < side; y++) {
+        for (uint32_t x = 0; x < side; x++) {
+            glm::vec2 uv(x / static_cast<float>(cellsPerSide), y / static_cast<float>(cellsPerSide));
+            scene.vertices.push_back({uv - glm::vec2(0.5f), glm::vec3(uv, 1.0f - uv.x), uv});
+        }
+    }
+    for (uint32_t y = 0; y < cellsPerSide; y++) {
+        for (uint32_t x = 0; x < cellsPerSide; x++) {
+            uint32_t corner = y * side + x;
+            uint32_t quad[6] = {corner, corner + 1, corner + side + 1, corner + side + 1, corner + side, corner};
+            scene.indices.insert(scene.indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static std::vector<BenchmarkScene> createScenes() {
+    std::vector<BenchmarkScene> scenes(10);
+
+    scenes[0].name = "quad";
+    makeQuadGrid(scenes[0], 1);
+
+    // One draw of 100k instances, meshlet culling only handles a single one
+    scenes[1].name = "instanced quads";
+    makeQuadGrid(scenes[1], 1);
+    scenes[1].meshletCulling = false;
+    scenes[1].instanceCount = 100000;
+
+    // 2M triangles over 1M vertices. The grid is flat and would be drawn at its coarsest LOD.
+    scenes[2].name = "dense mesh";
+    makeDenseGrid(scenes[2], 1024);
+    scenes[2].meshLods = false;
+
+    scenes[3].name = "many small draws";
+    makeQuadGrid(scenes[3], 1);
+    scenes[3].meshletCulling = false;
+    scenes[3].drawCount = 10000;
+
+    scenes[4].name = "upload storm";
+    makeQuadGrid(scenes[4], 1);
+    scenes[4].uploadBytesPerFrame = 16ull << 20;
+
+    // The same particle load with and without the compute queue measures what async compute buys
+    scenes[5].name = "particles";
+    makeQuadGrid(scenes[5], 1);
+    scenes[5].particleCount = 1u << 20;
+
+    scenes[6].name = "particles single queue";
+    makeQuadGrid(scenes[6], 1);
+    scenes[6].particleCount = 1u << 20;
+    scenes[6].asyncCompute = false;
+
+    scenes[7].name = "sprites";
+    makeQuadGrid(scenes[7], 1);
+    scenes[7].spriteCount = 1u << 20;
+
+    // Against "many small draws", which submits its recordings again, measures what recording every frame costs
+    scenes[8].name = "many small draws re-recorded";
+    makeQuadGrid(scenes[8], 1);
+    scenes[8].meshletCulling = false;
+    scenes[8].drawCount = 10000;
+    scenes[8].reuseCommandBuffers = false;
+
+    scenes[9].name = "clustered lights";
+    makeQuadGrid(scenes[9], 128);
+    scenes[9].lightCount = 4096;
+
+    return scenes;
+}
+
+// The camera circles the scene once over the run, the same every time
+static std::shared_ptr<FrameTrace> createTrace(const BenchmarkScene &scene, uint32_t frameCount) {
+    auto trace = std::make_shared<FrameTrace>();
+    trace->config.width = BENCHMARK_WIDTH;
+    trace->config.height = BENCHMARK_HEIGHT;
+    trace->config.msaaSamples = 4;
+    trace->config.meshletCulling = scene.meshletCulling;
+    trace->config.occlusionCulling = scene.meshletCulling;
+    trace->config.meshLods = scene.meshLods;
+    trace->config.drawCount = scene.drawCount;
+    trace->config.instanceCount = scene.instanceCount;
+    trace->config.uploadBytesPerFrame = scene.uploadBytesPerFrame;
+    trace->config.particleCount = scene.particleCount;
+    trace->config.asyncCompute = scene.asyncCompute;
+    trace->config.spriteCount = scene.spriteCount;
+    trace->config.reuseCommandBuffers = scene.reuseCommandBuffers;
+    trace->config.lightCount = scene.lightCount;
+
+    TraceBuffer vertices;
+    vertices.name = "vertices";
+    vertices.stride = sizeof(Vertex);
+    vertices.data.resize(scene.vertices.size() * sizeof(Vertex));
+    memcpy(vertices.data.data(), scene.vertices.data(), vertices.data.size());
+    trace->buffers.push_back(std::move(vertices));
+
+    TraceBuffer indices;
+    indices.name = "indices";
+    indices.stride = sizeof(uint32_t);
+    indices.data.resize(scene.indices.size() * sizeof(uint32_t));
+    memcpy(indices.data.data(), scene.indices.data(), indices.data.size());
+    trace->buffers.push_back(std::move(indices));
+
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), BENCHMARK_WIDTH / static_cast<float>(BENCHMARK_HEIGHT), 0.1f, 10.0f);
+    proj[1][1] *= -1;
+    for (uint32_t i = 0; i < frameCount; i++) {
+        TraceFrame frame;
+        frame.width = BENCHMARK_WIDTH;
+        frame.height = BENCHMARK_HEIGHT;
+        frame.model = glm::rotate(glm::mat4(1.0f), glm::radians(360.0f) * i / frameCount, glm::vec3(0.0f, 0.0f, 1.0f));
+        frame.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        frame.proj = proj;
+        trace->frames.push_back(frame);
+    }
+    return trace;
+}
+
+static SceneMetrics runScene(const BenchmarkScene &scene, uint32_t frameCount, const std::string &device, std::string &deviceName) {
+    AppOptions options;
+    options.device = device;
+    // The replay takes every setting of the scene from the trace's config
+    options.replayTrace = createTrace(scene, BENCHMARK_WARMUP_FRAMES + frameCount);
+
+    LOG_INFO("Benchmark scene ", scene.name, ": ", scene.vertices.size(), " vertices, ", scene.indices.size() / 3, " triangles, ", scene.instanceCount, " instances");
+    MemoryTelemetry::get().resetPeaks();
+    App app(options);
+    app.run();
+
+    const ReplayStats &stats = app.getReplayStats();
+    deviceName = stats.deviceName;
+    std::vector<float> cpuFrameTimes(stats.cpuFrameTimes.begin() + std::min<size_t>(BENCHMARK_WARMUP_FRAMES, stats.cpuFrameTimes.size()), stats.cpuFrameTimes.end());
+    std::vector<float> gpuFrameTimes(stats.gpuFrameTimes.begin() + std::min<size_t>(BENCHMARK_WARMUP_FRAMES, stats.gpuFrameTimes.size()), stats.gpuFrameTimes.end());
+
+    SceneMetrics metrics;
+    metrics["cpu_frame_ms"] = median(cpuFrameTimes);
+    metrics["cpu_frame_mad"] = medianDeviation(cpuFrameTimes, metrics["cpu_frame_ms"]);
+    if (!gpuFrameTimes.empty()) {
+        metrics["gpu_frame_ms"] = median(gpuFrameTimes);
+        metrics["gpu_frame_mad"] = medianDeviation(gpuFrameTimes, metrics["gpu_frame_ms"]);
+    }
+    metrics["startup_ms"] = stats.startupMilliseconds;
+    metrics["peak_memory_mib"] = stats.peakMemoryBytes / (1024.0 * 1024.0);
+    return metrics;
+}
+
+// Highest value of `metric` that still passes, negative when it is not checked
+static double threshold(const std::string &metric, const SceneMetrics &baseline, const SceneMetrics &current) {
+    auto base = baseline.find(metric);
+    if (base == baseline.end()) {
+        return -1.0;
+    }
+    if (metric == "cpu_frame_ms" || metric == "gpu_frame_ms") {
+        std::string spreadMetric = metric.substr(0, metric.size() - 2) + "mad";
+        auto baseSpread = baseline.find(spreadMetric);
+        auto currentSpread = current.find(spreadMetric);
+        double spread = std::max(baseSpread != baseline.end() ? baseSpread->second : 0.0, currentSpread != current.end() ? currentSpread->second : 0.0);
+        // 1.4826 scales the median absolute deviation to a standard deviation for normal noise
+        return base->second * (1.0 + BENCHMARK_FRAME_TOLERANCE) + BENCHMARK_FRAME_SIGMAS * 1.4826 * spread;
+    }
+    if (metric == "startup_ms") {
+        return base->second * (1.0 + BENCHMARK_STARTUP_TOLERANCE) + BENCHMARK_STARTUP_SLACK_MS;
+    }
+    if (metric == "peak_memory_mib") {
+        return base->second * (1.0 + BENCHMARK_MEMORY_TOLERANCE) + BENCHMARK_MEMORY_SLACK_MIB;
+    }
+    return -1.0;
+}
+
+int runBenchmarks(int argc, char **argv) {
+    std::string baselinesFile = BENCHMARK_BASELINES;
+    std::string device;
+    std::string onlyScene;
+    uint32_t frameCount = BENCHMARK_FRAMES;
+    bool updateBaselines = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--baselines") == 0 && hasValue) {
+            baselinesFile = argv[++i];
+        } else if (strcmp(argv[i], "--device") == 0 && hasValue) {
+            device = argv[++i];
+        } else if (strcmp(argv[i], "--scene") == 0 && hasValue) {
+            onlyScene = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+            frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--update-baselines") == 0) {
+            updateBaselines = true;
+        } else {
+            throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+        }
+    }
+
+    Baselines baselines = loadBaselines(baselinesFile);
+    std::string deviceName;
+    std::map<std::string, SceneMetrics> results;
+    for (const BenchmarkScene &scene : createScenes()) {
+        if (onlyScene.empty() || onlyScene == scene.name) {
+            results[scene.name] = runScene(scene, frameCount, device, deviceName);
+        }
+    }
+    if (results.empty()) {
+        throw std::runtime_error("Unknown benchmark scene: " + onlyScene);
+    }
+
+    std::string baselineKey = baselineDevice(deviceName);
+    const std::map<std::string, SceneMetrics> &deviceBaselines = baselines[baselineKey];
+    uint32_t regressions = 0;
+    uint32_t missing = 0;
+    std::ostringstream table;
+    table << "Benchmark results on " << deviceName << " (current, baseline, limit):";
+    for (const auto &[scene, metrics] : results) {
+        auto baseline = deviceBaselines.find(scene);
+        for (const auto &[metric, value] : metrics) {
+            if (metric.size() > 4 && metric.compare(metric.size() - 4, 4, "_mad") == 0) {
+                continue;
+            }
+            table << "\n    " << std::left << std::setw(18) << scene << std::setw(16) << metric << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(12) << value;
+            double limit = baseline != deviceBaselines.end() ? threshold(metric, baseline->second, metrics) : -1.0;
+            if (limit < 0.0) {
+                table << "  MISSING BASELINE";
+                missing++;
+                continue;
+            }
+            table << std::setw(12) << baseline->second.at(metric) << std::setw(12) << limit;
+            if (value > limit) {
+                table << "  REGRESSED";
+                regressions++;
+            }
+        }
+    }
+    LOG_INFO(table.str());
+
+    if (updateBaselines) {
+        for (const auto &[scene, metrics] : results) {
+            baselines[baselineKey][scene] = metrics;
+        }
+        saveBaselines(baselinesFile, baselines);
+        LOG_INFO("Updated baselines in ", baselinesFile);
+        return EXIT_SUCCESS;
+    }
+    if (missing > 0) {
+        LOG_ERROR(missing, " benchmark metrics have no baseline for \"", baselineKey, "\" in ", baselinesFile,
+                  ", record them with --update-baselines");
+    }
+    if (regressions > 0) {
+        LOG_ERROR(regressions, " benchmark metrics regressed");
+    }
+    return missing > 0 || regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#include "Bounds.h"
+
+#include <algorithm>
+
+float Aabb::surfaceArea() const {
+    glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void Aabb::expand(const Aabb &other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+Aabb Aabb::transformed(const glm::mat4 &transform) const {
+    // Each output axis is the translation plus the extreme contribution of every input axis
+    Aabb result;
+    result.min = glm::vec3(transform[3]);
+    result.max = result.min;
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            float a = transform[column][row] * min[column];
+            float b = transform[column][row] * max[column];
+            result.min[row] += std::min(a, b);
+            result.max[row] += std::max(a, b);
+        }
+    }
+    return result;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4 &transform) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(transform[0][i], transform[1][i], transform[2][i], transform[3][i]);
+    }
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];
+    frustum.planes[1] = rows[3] - rows[0];
+    frustum.planes[2] = rows[3] + rows[1];
+    frustum.planes[3] = rows[3] - rows[1];
+    frustum.planes[4] = rows[2];  // Depth range is [0, 1] in Vulkan
+    frustum.planes[5] = rows[3] - rows[2];
+    for (glm::vec4 &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
@@ -0,0 +1,194 @@
+#include "ClusteredLighting.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "utils.h"
+
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+
+// Camera the grid is built for, std140, must match light_cull_shader.glsl and fragment_shader.glsl
+struct LightParams {
+    glm::mat4 view;
+    glm::mat4 inverseProj;
+    glm::mat4 proj;
+    // Grid size and light count
+    glm::uvec4 grid;
+    // Near and far distance, slices per log unit of depth and the slice of the near plane
+    glm::vec4 depth;
+    glm::vec4 ambient;
+};
+
+void ClusteredLighting::createSetLayout(VkDevice device) {
+    _device = device;
+
+    // Parameters, lights and cluster lists, read by the lit fragment shader too
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light descriptor set layout!");
+    }
+}
+
+void ClusteredLighting::init(VkPhysicalDevice physicalDevice, uint32_t framesInFlight, uint32_t maxLights) {
+    _maxLights = maxLights;
+    _createPipeline();
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = framesInFlight;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = framesInFlight * 2;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = framesInFlight;
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light descriptor pool!");
+    }
+
+    // Lights are rewritten by the CPU every frame and read by every cluster, so they stay in
+    // host memory like the sprite rings. The lists never leave the GPU.
+    VkDeviceSize lightBytes = static_cast<VkDeviceSize>(std::max(maxLights, 1u)) * sizeof(PointLight);
+    VkDeviceSize clusterBytes = static_cast<VkDeviceSize>(CLUSTER_COUNT) * (1 + CLUSTER_MAX_LIGHTS) * sizeof(uint32_t);
+    _frames.resize(framesInFlight);
+    for (Frame &frame : _frames) {
+        Utils::createBuffer(physicalDevice, _device, MemoryCategory::Uniform, sizeof(LightParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.paramsBuffer, frame.paramsMemory);
+        vkMapMemory(_device, frame.paramsMemory, 0, sizeof(LightParams), 0, &frame.params);
+        Utils::createBuffer(physicalDevice, _device, MemoryCategory::Storage, lightBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.lightBuffer, frame.lightMemory);
+        vkMapMemory(_device, frame.lightMemory, 0, lightBytes, 0, reinterpret_cast<void **>(&frame.lights));
+        Utils::createBuffer(physicalDevice, _device, MemoryCategory::Storage, clusterBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.clusterBuffer, frame.clusterMemory);
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = _descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &_setLayout;
+        if (vkAllocateDescriptorSets(_device, &allocInfo, &frame.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate light descriptor set!");
+        }
+
+        std::array<VkBuffer, 3> buffers = {frame.paramsBuffer, frame.lightBuffer, frame.clusterBuffer};
+        std::array<VkDescriptorBufferInfo, 3> bufferInfos{};
+        std::array<VkWriteDescriptorSet, 3> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            bufferInfos[i].buffer = buffers[i];
+            bufferInfos[i].offset = 0;
+            bufferInfos[i].range = VK_WHOLE_SIZE;
+
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = frame.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].descriptorCount = 1;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    LOG_INFO("Clustered lighting for ", maxLights, " lights over ", CLUSTER_GRID_X, "x", CLUSTER_GRID_Y, "x", CLUSTER_GRID_Z, " clusters");
+}
+
+void ClusteredLighting::cleanup() {
+    for (Frame &frame : _frames) {
+        vkDestroyBuffer(_device, frame.paramsBuffer, nullptr);
+        Utils::freeMemory(_device, frame.paramsMemory);
+        vkDestroyBuffer(_device, frame.lightBuffer, nullptr);
+        Utils::freeMemory(_device, frame.lightMemory);
+        vkDestroyBuffer(_device, frame.clusterBuffer, nullptr);
+        Utils::freeMemory(_device, frame.clusterMemory);
+    }
+    _frames.clear();
+
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+}
+
+void ClusteredLighting::update(uint32_t frame, uint32_t lightCount, const glm::mat4 &view, const glm::mat4 &proj, const glm::vec3 &ambient) {
+    // glm's default clip space maps view depth near to -1 and far to 1
+    float nearDistance = proj[3][2] / (proj[2][2] - 1.0f);
+    float farDistance = proj[3][2] / (proj[2][2] + 1.0f);
+    float slicesPerLog = CLUSTER_GRID_Z / std::log(farDistance / nearDistance);
+
+    LightParams params{};
+    params.view = view;
+    params.inverseProj = glm::inverse(proj);
+    params.proj = proj;
+    params.grid = glm::uvec4(CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z, std::min(lightCount, _maxLights));
+    params.depth = glm::vec4(nearDistance, farDistance, slicesPerLog, -std::log(nearDistance) * slicesPerLog);
+    params.ambient = glm::vec4(ambient, 0.0f);
+    memcpy(_frames[frame].params, &params, sizeof(params));
+}
+
+void ClusteredLighting::record(VkCommandBuffer commandBuffer, uint32_t frame) {
+    const Frame &resources = _frames[frame];
+
+    // The previous use of this frame's lists was read by its fragment shaders
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = resources.clusterBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &resources.descriptorSet, 0, nullptr);
+    // One workgroup per cluster
+    vkCmdDispatch(commandBuffer, CLUSTER_GRID_X, CLUSTER_GRID_Y, CLUSTER_GRID_Z);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void ClusteredLighting::_createPipeline() {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_setLayout;
+    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light cull pipeline layout!");
+    }
+
+    VkShaderModule shaderModule = Utils::createShaderModule(_device, "shaders/light_cull.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _pipelineLayout;
+
+    auto result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline);
+    vkDestroyShaderModule(_device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create light cull pipeline!");
+    }
+}
@@ -0,0 +1,206 @@
+#include "DeviceCapabilities.h"
+
+#include <algorithm>
+#include <cstring>
+#include "Logger.h"
+#include "utils.h"
+
+#define DEVICE_MAX_API_VERSION VK_API_VERSION_1_3
+
+static bool hasExtension(const std::vector<VkExtensionProperties> &extensions, const char *name) {
+    return std::any_of(extensions.begin(), extensions.end(), [name](const VkExtensionProperties &extension) {
+        return strcmp(extension.extensionName, name) == 0;
+    });
+}
+
+static uint64_t deviceTypeScore(VkPhysicalDeviceType type) {
+    switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+            return 1000000;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+            return 100000;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+            return 10000;
+        default:
+            return 1000;
+    }
+}
+
+VkPhysicalDeviceFeatures2 *DeviceFeatureChain::link(uint32_t apiVersion, bool synchronization2Extension) {
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    vulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    synchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+
+    void **next = &features2.pNext;
+    if (apiVersion >= VK_API_VERSION_1_2) {
+        *next = &vulkan12;
+        next = &vulkan12.pNext;
+    }
+    if (apiVersion >= VK_API_VERSION_1_3) {
+        *next = &vulkan13;
+        next = &vulkan13.pNext;
+    } else if (synchronization2Extension) {
+        *next = &synchronization2;
+        next = &synchronization2.pNext;
+    }
+    *next = nullptr;
+    return &features2;
+}
+
+uint32_t DeviceCapabilities::instanceApiVersion() {
+    // vkEnumerateInstanceVersion does not exist in 1.0 loaders
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    uint32_t version = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion != nullptr) {
+        enumerateInstanceVersion(&version);
+    }
+    return std::min(version, DEVICE_MAX_API_VERSION);
+}
+
+DeviceProfile DeviceCapabilities::probe(VkPhysicalDevice device, uint32_t instanceVersion) {
+    DeviceProfile profile;
+    profile.device = device;
+    vkGetPhysicalDeviceProperties(device, &profile.properties);
+
+    DeviceFeatureTier &tier = profile.tier;
+    tier.apiVersion = std::min(profile.properties.apiVersion, instanceVersion);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            profile.deviceLocalBytes = std::max(profile.deviceLocalBytes, memoryProperties.memoryHeaps[i].size);
+        }
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+    bool synchronization2Extension = hasExtension(extensions, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    // Core in 1.1, VK_KHR_maintenance2 before that
+    tier.extendedImageUsage = tier.apiVersion >= VK_API_VERSION_1_1 || hasExtension(extensions, VK_KHR_MAINTENANCE_2_EXTENSION_NAME);
+    if (tier.apiVersion >= VK_API_VERSION_1_1) {
+        DeviceFeatureChain supported;
+        vkGetPhysicalDeviceFeatures2(device, supported.link(tier.apiVersion, synchronization2Extension));
+
+        tier.storageImageDynamicIndexing = supported.features2.features.shaderStorageImageArrayDynamicIndexing;
+        if (tier.apiVersion >= VK_API_VERSION_1_2) {
+            const VkPhysicalDeviceVulkan12Features &vulkan12 = supported.vulkan12;
+            tier.timelineSemaphores = vulkan12.timelineSemaphore;
+            tier.bufferDeviceAddress = vulkan12.bufferDeviceAddress;
+            tier.descriptorIndexing = vulkan12.descriptorIndexing &&
+                                      vulkan12.runtimeDescriptorArray &&
+                                      vulkan12.descriptorBindingPartiallyBound &&
+                                      vulkan12.descriptorBindingVariableDescriptorCount &&
+                                      vulkan12.descriptorBindingSampledImageUpdateAfterBind &&
+                                      vulkan12.shaderSampledImageArrayNonUniformIndexing;
+        }
+        if (tier.apiVersion >= VK_API_VERSION_1_3) {
+            tier.synchronization2 = supported.vulkan13.synchronization2;
+        } else if (synchronization2Extension) {
+            tier.synchronization2 = supported.synchronization2.synchronization2;
+        }
+        // The budget is read through vkGetPhysicalDeviceMemoryProperties2
+        tier.memoryBudget = hasExtension(extensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    } else {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(device, &features);
+        tier.storageImageDynamicIndexing = features.shaderStorageImageArrayDynamicIndexing;
+    }
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+    for (const auto &queueFamily : queueFamilies) {
+        VkQueueFlags flags = queueFamily.queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            tier.dedicatedTransferQueue = true;
+        }
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+            tier.asyncComputeQueue = true;
+        }
+    }
+
+    // Device type dominates, then memory size (in MiB), then each fast path is worth a bit
+    profile.score = deviceTypeScore(profile.properties.deviceType);
+    profile.score += std::min<uint64_t>(profile.deviceLocalBytes >> 20, 65536);
+    for (bool feature : {tier.timelineSemaphores, tier.synchronization2, tier.bufferDeviceAddress, tier.descriptorIndexing,
+                         tier.memoryBudget, tier.storageImageDynamicIndexing, tier.dedicatedTransferQueue, tier.asyncComputeQueue}) {
+        profile.score += feature ? 1000 : 0;
+    }
+    return profile;
+}
+
+VkPhysicalDeviceFeatures2 *DeviceCapabilities::enableFeatures(const DeviceProfile &profile, DeviceFeatureChain &chain, std::vector<const char *> &extensions) {
+    const DeviceFeatureTier &tier = profile.tier;
+    bool synchronization2Extension = tier.synchronization2 && tier.apiVersion < VK_API_VERSION_1_3;
+
+    chain = DeviceFeatureChain();
+    VkPhysicalDeviceFeatures2 *head = chain.link(tier.apiVersion, synchronization2Extension);
+
+    // Needed by the single pass mip downsampler
+    chain.features2.features.shaderStorageImageArrayDynamicIndexing = tier.storageImageDynamicIndexing;
+
+    chain.vulkan12.timelineSemaphore = tier.timelineSemaphores;
+    chain.vulkan12.bufferDeviceAddress = tier.bufferDeviceAddress;
+    if (tier.descriptorIndexing) {
+        chain.vulkan12.descriptorIndexing = VK_TRUE;
+        chain.vulkan12.runtimeDescriptorArray = VK_TRUE;
+        chain.vulkan12.descriptorBindingPartiallyBound = VK_TRUE;
+        chain.vulkan12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+        chain.vulkan12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        chain.vulkan12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    }
+    chain.vulkan13.synchronization2 = tier.synchronization2;
+    chain.synchronization2.synchronization2 = tier.synchronization2;
+
+    if (synchronization2Extension) {
+        extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    }
+    if (tier.memoryBudget) {
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    if (tier.extendedImageUsage && tier.apiVersion < VK_API_VERSION_1_1) {
+        extensions.push_back(VK_KHR_MAINTENANCE_2_EXTENSION_NAME);
+    }
+    return head;
+}
+
+VkDeviceSize DeviceCapabilities::queryDeviceLocalBudget(VkPhysicalDevice device) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+    memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    memoryProperties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(device, &memoryProperties);
+
+    VkDeviceSize available = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++) {
+        if ((memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && budget.heapBudget[i] > budget.heapUsage[i]) {
+            available = std::max(available, budget.heapBudget[i] - budget.heapUsage[i]);
+        }
+    }
+    return available;
+}
+
+void DeviceCapabilities::log(const DeviceProfile &profile, bool suitable) {
+    const DeviceFeatureTier &tier = profile.tier;
+    if (!suitable) {
+        LOG_INFO(profile.properties.deviceName, " (Vulkan ", VK_API_VERSION_MAJOR(tier.apiVersion), ".", VK_API_VERSION_MINOR(tier.apiVersion),
+                 ", ", profile.deviceLocalBytes >> 20, " MiB) score 0 (unsuitable)");
+        return;
+    }
+    LOG_INFO(profile.properties.deviceName, " (Vulkan ", VK_API_VERSION_MAJOR(tier.apiVersion), ".", VK_API_VERSION_MINOR(tier.apiVersion),
+             ", ", profile.deviceLocalBytes >> 20, " MiB) score ", profile.score,
+             "\n    timeline semaphores ", tier.timelineSemaphores,
+             ", synchronization2 ", tier.synchronization2,
+             ", buffer device address ", tier.bufferDeviceAddress,
+             ", descriptor indexing ", tier.descriptorIndexing,
+             ", memory budget ", tier.memoryBudget,
+             ", transfer queue ", tier.dedicatedTransferQueue,
+             ", async compute ", tier.asyncComputeQueue);
+}
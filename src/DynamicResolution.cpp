@@ -0,0 +1,404 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "Logger.h"
+#include "Profiler.h"
+#include "utils.h"
+
+// Weight of the newest frame time in the smoothed one
+#define DYNAMIC_RESOLUTION_SMOOTHING 0.1f
+// Fraction of the target the scale aims for, leaving room for noise below the budget
+#define DYNAMIC_RESOLUTION_HEADROOM 0.9f
+// Fraction of the distance to the desired scale covered per frame when growing
+#define DYNAMIC_RESOLUTION_GROWTH 0.05f
+
+// Must match upscale_fragment_shader.glsl
+struct UpscaleConstants {
+    // Rendered area over the target's size
+    glm::vec2 uvScale;
+    // One target texel in texture coordinates
+    glm::vec2 texelSize;
+    float sharpness;
+};
+
+void DynamicResolution::init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format, uint32_t framesInFlight, float targetMilliseconds, float minScale,
+                             float sharpness) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _format = format;
+    _latencyFrames = framesInFlight;
+    _targetMilliseconds = targetMilliseconds;
+    _minScale = std::clamp(minScale, 0.1f, 1.0f);
+    _sharpness = std::clamp(sharpness, 0.0f, 1.0f);
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+    if (vkCreateSampler(_device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale sampler!");
+    }
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale descriptor pool!");
+    }
+
+    // The set outlives the target, resize() points it at the new one
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_setLayout;
+    if (vkAllocateDescriptorSets(_device, &allocInfo, &_descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate upscale descriptor set!");
+    }
+
+    _createRenderPass();
+    _createPipeline();
+
+    LOG_INFO("Dynamic resolution targets ", _targetMilliseconds, " ms of GPU time per frame, scaling down to ", _minScale);
+}
+
+void DynamicResolution::cleanup() {
+    _destroyResources();
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyRenderPass(_device, _renderPass, nullptr);
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+    vkDestroySampler(_device, _sampler, nullptr);
+}
+
+void DynamicResolution::resize(VkExtent2D extent, const std::vector<VkImageView> &swapChainViews) {
+    _destroyResources();
+    _extent = extent;
+    _createResources(swapChainViews);
+}
+
+void DynamicResolution::update(float gpuMilliseconds) {
+    // The frames recorded before the last drop still report the old size
+    if (_settleFrames > 0) {
+        _settleFrames--;
+        return;
+    }
+
+    if (gpuMilliseconds > _targetMilliseconds) {
+        // Over budget: drop straight to the scale expected to fit, judged by this frame alone
+        float scale = std::max(_minScale, _scale * std::sqrt(_targetMilliseconds * DYNAMIC_RESOLUTION_HEADROOM / gpuMilliseconds));
+        if (scale < _scale) {
+            _scale = scale;
+            _averageMilliseconds = -1.0f;
+            _settleFrames = _latencyFrames;
+        }
+        return;
+    }
+
+    if (_averageMilliseconds < 0.0f) {
+        _averageMilliseconds = gpuMilliseconds;
+    } else {
+        _averageMilliseconds += (gpuMilliseconds - _averageMilliseconds) * DYNAMIC_RESOLUTION_SMOOTHING;
+    }
+
+    // Under budget with room to spare on average: grow a little towards the scale that would fill it
+    float headroom = _targetMilliseconds * DYNAMIC_RESOLUTION_HEADROOM;
+    if (_averageMilliseconds < headroom && _scale < 1.0f) {
+        float desired = std::min(1.0f, _scale * std::sqrt(headroom / std::max(_averageMilliseconds, 0.01f)));
+        _scale += (desired - _scale) * DYNAMIC_RESOLUTION_GROWTH;
+    }
+}
+
+VkExtent2D DynamicResolution::getRenderExtent() const {
+    if (_pinnedExtent.width > 0 && _pinnedExtent.height > 0) {
+        return {std::min(_pinnedExtent.width, _extent.width), std::min(_pinnedExtent.height, _extent.height)};
+    }
+    VkExtent2D extent;
+    extent.width = std::clamp(static_cast<uint32_t>(std::lround(_extent.width * _scale)), 1u, _extent.width);
+    extent.height = std::clamp(static_cast<uint32_t>(std::lround(_extent.height * _scale)), 1u, _extent.height);
+    return extent;
+}
+
+void DynamicResolution::beginScene(VkCommandBuffer commandBuffer) {
+    // Write after read: the scene pass discards the target, so only the previous upscale's reads must finish
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+}
+
+void DynamicResolution::recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    PROFILE_FUNCTION();
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = _target;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = _renderPass;
+    renderPassInfo.framebuffer = _framebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = _extent;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSet, 0, nullptr);
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(_extent.width);
+    viewport.height = static_cast<float>(_extent.height);
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = _extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    VkExtent2D renderExtent = getRenderExtent();
+    UpscaleConstants constants{};
+    constants.uvScale = glm::vec2(static_cast<float>(renderExtent.width) / _extent.width, static_cast<float>(renderExtent.height) / _extent.height);
+    constants.texelSize = glm::vec2(1.0f / _extent.width, 1.0f / _extent.height);
+    // Nothing to sharpen at native size
+    constants.sharpness = renderExtent.width < _extent.width ? _sharpness : 0.0f;
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void DynamicResolution::_createRenderPass() {
+    // Every pixel is overwritten, so the swap chain image's old contents are not loaded
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = _format;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    // Waits for the acquire semaphore, which the frame's submit signals at this stage
+    VkSubpassDependency dependency{};
+    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency.dstSubpass = 0;
+    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.srcAccessMask = 0;
+    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 1;
+    renderPassInfo.pDependencies = &dependency;
+    if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale render pass!");
+    }
+}
+
+void DynamicResolution::_createPipeline() {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(UpscaleConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale pipeline layout!");
+    }
+
+    VkShaderModule vertShaderModule = Utils::createShaderModule(_device, "shaders/upscale_vert.spv");
+    VkShaderModule fragShaderModule = Utils::createShaderModule(_device, "shaders/upscale_frag.spv");
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
+
+    // A single triangle covering the screen, generated from the vertex index
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = 2;
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineInfo.layout = _pipelineLayout;
+    pipelineInfo.renderPass = _renderPass;
+    pipelineInfo.subpass = 0;
+
+    auto result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline);
+    vkDestroyShaderModule(_device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create upscale pipeline!");
+    }
+}
+
+void DynamicResolution::_createResources(const std::vector<VkImageView> &swapChainViews) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = _format;
+    imageInfo.extent = {_extent.width, _extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Attachment, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _target, _targetMemory);
+    _targetView = Utils::createImageView(_device, _target, _format, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
+
+    VkDescriptorImageInfo targetInfo{};
+    targetInfo.sampler = _sampler;
+    targetInfo.imageView = _targetView;
+    targetInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = _descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &targetInfo;
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+    _framebuffers.resize(swapChainViews.size());
+    for (size_t i = 0; i < swapChainViews.size(); i++) {
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = _renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &swapChainViews[i];
+        framebufferInfo.width = _extent.width;
+        framebufferInfo.height = _extent.height;
+        framebufferInfo.layers = 1;
+        if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_framebuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create upscale framebuffer!");
+        }
+    }
+}
+
+void DynamicResolution::_destroyResources() {
+    for (VkFramebuffer framebuffer : _framebuffers) {
+        vkDestroyFramebuffer(_device, framebuffer, nullptr);
+    }
+    _framebuffers.clear();
+
+    if (_target != VK_NULL_HANDLE) {
+        vkDestroyImageView(_device, _targetView, nullptr);
+        vkDestroyImage(_device, _target, nullptr);
+        Utils::freeMemory(_device, _targetMemory);
+        _target = VK_NULL_HANDLE;
+        _targetView = VK_NULL_HANDLE;
+    }
+}
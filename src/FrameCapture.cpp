@@ -0,0 +1,382 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "utils.h"
+
+#define CAPTURE_ENCODER_THREADS 2
+#define CAPTURE_REPORT_INTERVAL_SECONDS 5
+
+static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+    // Both encoder threads get here, static initialization builds the table exactly once
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void writePngChunk(std::ofstream &file, const char *type, const std::vector<uint8_t> &data) {
+    std::vector<uint8_t> chunk;
+    appendBigEndian(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+    file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+bool FrameCapture::isFormatSupported(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void FrameCapture::init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format, VkExtent2D extent, const std::string &directory, CaptureFormat captureFormat, uint32_t maxFrames, uint32_t slotCount) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _format = format;
+    _extent = extent;
+    _directory = directory;
+    _captureFormat = captureFormat;
+    _maxFrames = maxFrames;
+    _slotCount = slotCount;
+
+    if (!isFormatSupported(format)) {
+        LOG_WARNING("Frame capture does not support swap chain format ", format, ", capture disabled");
+        return;
+    }
+
+    std::filesystem::create_directories(_directory);
+    if (_captureFormat == CaptureFormat::Raw) {
+        std::string filename = _directory + "/capture.rgb";
+        _rawFile.open(filename, std::ios::binary);
+        if (!_rawFile.is_open()) {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        LOG_INFO("Raw capture, encode with: ffmpeg -f rawvideo -pix_fmt rgb24 -s ", _extent.width, "x", _extent.height, " -i ", filename, " capture.mp4");
+    }
+
+    _slots = std::make_unique<Slot[]>(_slotCount);
+    _createSlots();
+    _encoders = std::make_unique<ThreadPool>(CAPTURE_ENCODER_THREADS);
+    _startTime = std::chrono::steady_clock::now();
+    _lastReport = _startTime;
+    _enabled = true;
+
+    LOG_INFO("Capturing frames to ", _directory);
+}
+
+void FrameCapture::cleanup() {
+    if (!_enabled) {
+        return;
+    }
+
+    // The device is idle, everything still recorded can be encoded right away
+    for (uint32_t frameSlot = 0; frameSlot < _slotCount; frameSlot++) {
+        collect(frameSlot);
+    }
+    _waitForEncoders();
+    _encoders.reset();
+    _destroySlots();
+    if (_rawFile.is_open()) {
+        _rawFile.close();
+    }
+
+    report();
+    _enabled = false;
+}
+
+void FrameCapture::resize(VkFormat format, VkExtent2D extent) {
+    if (!_enabled) {
+        return;
+    }
+
+    for (uint32_t frameSlot = 0; frameSlot < _slotCount; frameSlot++) {
+        collect(frameSlot);
+    }
+    _waitForEncoders();
+    _destroySlots();
+
+    if (_captureFormat == CaptureFormat::Raw && (extent.width != _extent.width || extent.height != _extent.height)) {
+        LOG_WARNING("Raw capture resolution changed to ", extent.width, "x", extent.height, " mid stream");
+    }
+    _format = format;
+    _extent = extent;
+    _createSlots();
+}
+
+void FrameCapture::record(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameSlot) {
+    if (!_enabled || (_maxFrames > 0 && _recorded >= _maxFrames)) {
+        return;
+    }
+
+    Slot *slot = nullptr;
+    for (uint32_t i = 0; i < _slotCount; i++) {
+        Slot &candidate = _slots[(_nextSlot + i) % _slotCount];
+        if (candidate.state.load(std::memory_order_acquire) == SLOT_FREE) {
+            slot = &candidate;
+            _nextSlot = (_nextSlot + i + 1) % _slotCount;
+            break;
+        }
+    }
+    if (slot == nullptr) {
+        // Encoders are behind, dropping a frame is better than stalling the render loop
+        _framesDropped++;
+        return;
+    }
+
+    slot->state.store(SLOT_RECORDED, std::memory_order_relaxed);
+    slot->frameSlot = frameSlot;
+    slot->sequence = _recorded++;
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {_extent.width, _extent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = slot->buffer;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+}
+
+void FrameCapture::collect(uint32_t frameSlot) {
+    if (!_enabled) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < _slotCount; i++) {
+        Slot &slot = _slots[i];
+        if (slot.state.load(std::memory_order_relaxed) != SLOT_RECORDED || slot.frameSlot != frameSlot) {
+            continue;
+        }
+
+        slot.state.store(SLOT_ENCODING, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(_encodeMutex);
+            _encoding++;
+        }
+        uint64_t sequence = slot.sequence;
+        _encoders->submit([this, &slot, sequence]() { _encode(slot, sequence); });
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - _lastReport > std::chrono::seconds(CAPTURE_REPORT_INTERVAL_SECONDS)) {
+        _lastReport = now;
+        report();
+    }
+}
+
+void FrameCapture::report() {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - _startTime).count();
+    uint64_t frames = _framesWritten.load();
+    double megabytes = _bytesWritten.load() / (1024.0 * 1024.0);
+    double encodeMs = frames > 0 ? _encodeNanoseconds.load() / 1e6 / frames : 0.0;
+
+    std::ostringstream line;
+    line << "Capture: " << frames << " frames written, " << _framesDropped << " dropped, "
+         << std::fixed << std::setprecision(1) << frames / elapsed << " frames/s, " << megabytes / elapsed << " MiB/s, "
+         << std::setprecision(2) << encodeMs << " ms/frame encode";
+    LOG_INFO(line.str());
+}
+
+void FrameCapture::_createSlots() {
+    VkDeviceSize size = static_cast<VkDeviceSize>(_extent.width) * _extent.height * 4;
+    for (uint32_t i = 0; i < _slotCount; i++) {
+        Slot &slot = _slots[i];
+        // Cached memory makes the CPU side reads much faster where it is available
+        Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Readback, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, slot.buffer, slot.memory, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+        void *mapped;
+        vkMapMemory(_device, slot.memory, 0, size, 0, &mapped);
+        slot.mapped = static_cast<const uint8_t *>(mapped);
+        slot.state.store(SLOT_FREE);
+    }
+}
+
+void FrameCapture::_destroySlots() {
+    for (uint32_t i = 0; i < _slotCount; i++) {
+        Slot &slot = _slots[i];
+        vkUnmapMemory(_device, slot.memory);
+        vkDestroyBuffer(_device, slot.buffer, nullptr);
+        Utils::freeMemory(_device, slot.memory);
+        slot.buffer = VK_NULL_HANDLE;
+        slot.memory = VK_NULL_HANDLE;
+        slot.mapped = nullptr;
+    }
+}
+
+void FrameCapture::_waitForEncoders() {
+    std::unique_lock<std::mutex> lock(_encodeMutex);
+    _encodeCondition.wait(lock, [this] { return _encoding == 0; });
+}
+
+void FrameCapture::_encode(Slot &slot, uint64_t sequence) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<uint8_t> rgb;
+    _toRgb(slot.mapped, rgb);
+    // The pixels are copied out, the GPU can reuse the slot while we write
+    slot.state.store(SLOT_FREE, std::memory_order_release);
+
+    if (_captureFormat == CaptureFormat::Raw) {
+        // Frames must land in the stream in order, encoders take turns
+        std::unique_lock<std::mutex> lock(_encodeMutex);
+        _encodeCondition.wait(lock, [this, sequence] { return _nextRawSequence == sequence; });
+        _rawFile.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+        _nextRawSequence++;
+        _encodeCondition.notify_all();
+    } else {
+        std::ostringstream filename;
+        filename << _directory << "/frame_" << std::setw(6) << std::setfill('0') << sequence
+                 << (_captureFormat == CaptureFormat::PNG ? ".png" : ".ppm");
+        if (_captureFormat == CaptureFormat::PNG) {
+            _writePng(filename.str(), rgb);
+        } else {
+            _writePpm(filename.str(), rgb);
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    _encodeNanoseconds += elapsed.count();
+    _bytesWritten += rgb.size();
+    _framesWritten++;
+
+    std::lock_guard<std::mutex> lock(_encodeMutex);
+    _encoding--;
+    _encodeCondition.notify_all();
+}
+
+void FrameCapture::_toRgb(const uint8_t *pixels, std::vector<uint8_t> &rgb) const {
+    bool bgra = _format == VK_FORMAT_B8G8R8A8_SRGB || _format == VK_FORMAT_B8G8R8A8_UNORM;
+    size_t pixelCount = static_cast<size_t>(_extent.width) * _extent.height;
+
+    rgb.resize(pixelCount * 3);
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t *src = pixels + i * 4;
+        uint8_t *dst = rgb.data() + i * 3;
+        dst[0] = bgra ? src[2] : src[0];
+        dst[1] = src[1];
+        dst[2] = bgra ? src[0] : src[2];
+    }
+}
+
+void FrameCapture::_writePpm(const std::string &filename, const std::vector<uint8_t> &rgb) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        LOG_ERROR("Failed to write ", filename);
+        return;
+    }
+    file << "P6\n"
+         << _extent.width << " " << _extent.height << "\n255\n";
+    file.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+}
+
+void FrameCapture::_writePng(const std::string &filename, const std::vector<uint8_t> &rgb) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        LOG_ERROR("Failed to write ", filename);
+        return;
+    }
+
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+
+    std::vector<uint8_t> header;
+    appendBigEndian(header, _extent.width);
+    appendBigEndian(header, _extent.height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});  // 8 bit RGB, deflate, no filter, no interlace
+    writePngChunk(file, "IHDR", header);
+
+    // Filter byte 0 in front of every row, stored in uncompressed deflate blocks. Compression
+    // would cost more encoder time than the disk bandwidth it saves for our captures.
+    size_t rowSize = static_cast<size_t>(_extent.width) * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * _extent.height);
+    for (uint32_t y = 0; y < _extent.height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * rowSize, rgb.begin() + (y + 1) * rowSize);
+    }
+
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535) {
+        uint16_t blockSize = static_cast<uint16_t>(std::min<size_t>(65535, raw.size() - offset));
+        bool last = offset + blockSize >= raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(blockSize));
+        zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+        zlib.push_back(static_cast<uint8_t>(~blockSize));
+        zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        for (size_t i = offset; i < offset + blockSize; i++) {
+            adlerA = (adlerA + raw[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        if (last) {
+            break;
+        }
+    }
+    appendBigEndian(zlib, (adlerB << 16) | adlerA);
+    writePngChunk(file, "IDAT", zlib);
+    writePngChunk(file, "IEND", {});
+}
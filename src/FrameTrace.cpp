@@ -0,0 +1,150 @@
+#include "FrameTrace.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Logger.h"
+
+static const char FRAME_TRACE_MAGIC[8] = {'V', 'K', 'F', 'T', 'R', 'A', 'C', 'E'};
+
+template <typename T>
+static void appendValue(std::vector<char> &payload, const T &value) {
+    const char *bytes = reinterpret_cast<const char *>(&value);
+    payload.insert(payload.end(), bytes, bytes + sizeof(value));
+}
+
+template <typename T>
+static T readValue(const std::vector<char> &payload, size_t &offset) {
+    if (offset + sizeof(T) > payload.size()) {
+        throw std::runtime_error("Truncated frame trace chunk");
+    }
+    T value;
+    std::memcpy(&value, payload.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+FrameTrace FrameTrace::load(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open frame trace " + filename);
+    }
+
+    char magic[sizeof(FRAME_TRACE_MAGIC)];
+    uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&version), sizeof(version));
+    if (!file || std::memcmp(magic, FRAME_TRACE_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error(filename + " is not a frame trace");
+    }
+    if (version != FRAME_TRACE_VERSION) {
+        throw std::runtime_error(filename + " is trace version " + std::to_string(version) + ", expected " + std::to_string(FRAME_TRACE_VERSION));
+    }
+
+    FrameTrace trace;
+    bool hasConfig = false;
+    while (true) {
+        uint32_t type = 0;
+        uint32_t size = 0;
+        file.read(reinterpret_cast<char *>(&type), sizeof(type));
+        file.read(reinterpret_cast<char *>(&size), sizeof(size));
+        if (!file) {
+            break;
+        }
+        std::vector<char> payload(size);
+        file.read(payload.data(), size);
+        if (!file) {
+            // A capture cut short by a crash still replays up to its last whole frame
+            LOG_WARNING("Frame trace ", filename, " ends in a partial chunk");
+            break;
+        }
+
+        size_t offset = 0;
+        switch (static_cast<Chunk>(type)) {
+            case Chunk::Config:
+                trace.config = readValue<TraceConfig>(payload, offset);
+                hasConfig = true;
+                break;
+            case Chunk::Buffer: {
+                TraceBuffer buffer;
+                uint32_t nameLength = readValue<uint32_t>(payload, offset);
+                if (offset + nameLength > payload.size()) {
+                    throw std::runtime_error("Truncated frame trace chunk");
+                }
+                buffer.name.assign(payload.data() + offset, nameLength);
+                offset += nameLength;
+                buffer.stride = readValue<uint32_t>(payload, offset);
+                buffer.data.assign(payload.begin() + offset, payload.end());
+                trace.buffers.push_back(std::move(buffer));
+                break;
+            }
+            case Chunk::Frame:
+                trace.frames.push_back(readValue<TraceFrame>(payload, offset));
+                break;
+            default:
+                // Chunks from newer writers are skipped
+                break;
+        }
+    }
+
+    if (!hasConfig) {
+        throw std::runtime_error(filename + " has no config chunk");
+    }
+    LOG_INFO("Loaded frame trace ", filename, ": ", trace.frames.size(), " frames at ", trace.config.width, "x", trace.config.height);
+    return trace;
+}
+
+const TraceBuffer *FrameTrace::findBuffer(const std::string &name) const {
+    for (const TraceBuffer &buffer : buffers) {
+        if (buffer.name == name) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+void FrameTraceWriter::open(const std::string &filename, const TraceConfig &config) {
+    _file.open(filename, std::ios::binary);
+    if (!_file) {
+        throw std::runtime_error("Failed to open " + filename + " for writing");
+    }
+    _filename = filename;
+    _frameCount = 0;
+
+    uint32_t version = FRAME_TRACE_VERSION;
+    _file.write(FRAME_TRACE_MAGIC, sizeof(FRAME_TRACE_MAGIC));
+    _file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+
+    _writeChunk(FrameTrace::Chunk::Config, &config, sizeof(config));
+    LOG_INFO("Recording frame trace to ", filename);
+}
+
+void FrameTraceWriter::close() {
+    if (!_file.is_open()) {
+        return;
+    }
+    _file.close();
+    LOG_INFO("Recorded ", _frameCount, " frames to ", _filename);
+}
+
+void FrameTraceWriter::writeBuffer(const std::string &name, uint32_t stride, const void *data, size_t size) {
+    std::vector<char> payload;
+    appendValue(payload, static_cast<uint32_t>(name.size()));
+    payload.insert(payload.end(), name.begin(), name.end());
+    appendValue(payload, stride);
+    const char *bytes = static_cast<const char *>(data);
+    payload.insert(payload.end(), bytes, bytes + size);
+    _writeChunk(FrameTrace::Chunk::Buffer, payload.data(), payload.size());
+}
+
+void FrameTraceWriter::writeFrame(const TraceFrame &frame) {
+    _writeChunk(FrameTrace::Chunk::Frame, &frame, sizeof(frame));
+    _frameCount++;
+}
+
+void FrameTraceWriter::_writeChunk(FrameTrace::Chunk type, const void *payload, size_t size) {
+    uint32_t chunkSize = static_cast<uint32_t>(size);
+    _file.write(reinterpret_cast<const char *>(&type), sizeof(type));
+    _file.write(reinterpret_cast<const char *>(&chunkSize), sizeof(chunkSize));
+    _file.write(static_cast<const char *>(payload), size);
+}
@@ -0,0 +1,85 @@
+#include "GeometryBuffer.h"
+
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Profiler.h"
+#include "utils.h"
+
+// Keeps every mesh's vertices 16 byte aligned for vectorized shader loads
+#define GEOMETRY_ALIGNMENT 16
+
+void GeometryBuffer::init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, VkDeviceSize capacity) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _queue = queue;
+    _capacity = capacity;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create geometry upload command pool!");
+    }
+
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Vertex, _capacity,
+                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _buffer, _memory, 0, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT);
+
+    VkBufferDeviceAddressInfo addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = _buffer;
+    _address = vkGetBufferDeviceAddress(_device, &addressInfo);
+
+    LOG_INFO("Created ", (_capacity >> 20), " MiB geometry buffer");
+}
+
+void GeometryBuffer::cleanup() {
+    vkDestroyBuffer(_device, _buffer, nullptr);
+    Utils::freeMemory(_device, _memory);
+    vkDestroyCommandPool(_device, _commandPool, nullptr);
+    _meshes.clear();
+    _used = 0;
+}
+
+uint32_t GeometryBuffer::addMesh(const void *vertices, uint32_t vertexCount, uint32_t vertexLayout, const uint32_t *indices, uint32_t indexCount) {
+    PROFILE_FUNCTION();
+    MeshRange mesh;
+    mesh.vertexCount = vertexCount;
+    mesh.indexCount = indexCount;
+    mesh.vertexStride = vertexStride(vertexLayout);
+    mesh.vertexLayout = vertexLayout;
+
+    VkDeviceSize vertexSize = (VkDeviceSize)vertexCount * mesh.vertexStride * sizeof(float);
+    VkDeviceSize indexSize = (VkDeviceSize)indexCount * sizeof(uint32_t);
+    VkDeviceSize vertexOffset = _allocate(vertexSize);
+    mesh.indexOffset = _allocate(indexSize);
+    mesh.vertexAddress = _address + vertexOffset;
+
+    Utils::uploadBuffer(_physicalDevice, _device, _queue, _commandPool, _buffer, vertexOffset, vertices, vertexSize);
+    Utils::uploadBuffer(_physicalDevice, _device, _queue, _commandPool, _buffer, mesh.indexOffset, indices, indexSize);
+
+    _meshes.push_back(mesh);
+    return static_cast<uint32_t>(_meshes.size() - 1);
+}
+
+uint32_t GeometryBuffer::vertexStride(uint32_t vertexLayout) {
+    uint32_t stride = (vertexLayout & VERTEX_LAYOUT_POSITION_3D) ? 3 : 2;
+    if (vertexLayout & VERTEX_LAYOUT_COLOR) {
+        stride += 3;
+    }
+    if (vertexLayout & VERTEX_LAYOUT_TEXCOORD) {
+        stride += 2;
+    }
+    return stride;
+}
+
+VkDeviceSize GeometryBuffer::_allocate(VkDeviceSize size) {
+    VkDeviceSize offset = (_used + GEOMETRY_ALIGNMENT - 1) & ~(VkDeviceSize)(GEOMETRY_ALIGNMENT - 1);
+    if (offset + size > _capacity) {
+        throw std::runtime_error("Geometry buffer is full!");
+    }
+    _used = offset + size;
+    return offset;
+}
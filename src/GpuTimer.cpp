@@ -0,0 +1,160 @@
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "utils.h"
+
+void GpuTimer::init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t framesInFlight) {
+    _device = device;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+    if (validBits == 0) {
+        LOG_WARNING("Queue cannot write timestamps, GPU zones disabled");
+        return;
+    }
+    _validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    _period = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = framesInFlight * GPU_TIMER_MAX_ZONES * 2;
+    if (vkCreateQueryPool(_device, &poolInfo, nullptr, &_queryPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp query pool!");
+    }
+
+    _frames.resize(framesInFlight);
+    _track = Profiler::get().createTrack("GPU");
+    _calibrate(queue, queueFamily);
+}
+
+void GpuTimer::cleanup() {
+    if (_queryPool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(_device, _queryPool, nullptr);
+        _queryPool = VK_NULL_HANDLE;
+    }
+    _frames.clear();
+}
+
+bool GpuTimer::collect(uint32_t frame) {
+    if (_queryPool == VK_NULL_HANDLE || _frames[frame].names.empty()) {
+        return false;
+    }
+
+    FrameZones &zones = _frames[frame];
+    std::vector<uint64_t> timestamps(zones.names.size() * 2);
+    auto result = vkGetQueryPoolResults(_device, _queryPool, frame * GPU_TIMER_MAX_ZONES * 2, static_cast<uint32_t>(timestamps.size()),
+                                        timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result == VK_SUCCESS) {
+        for (size_t i = 0; i < zones.names.size(); i++) {
+            uint64_t begin = _anchorNanoseconds + static_cast<uint64_t>(((timestamps[i * 2] - _anchorTicks) & _validMask) * _period);
+            uint64_t end = _anchorNanoseconds + static_cast<uint64_t>(((timestamps[i * 2 + 1] - _anchorTicks) & _validMask) * _period);
+            Profiler::get().record(*_track, zones.names[i], begin, end);
+        }
+
+        float frameTime = static_cast<float>(((timestamps[1] - timestamps[0]) & _validMask) * _period / 1e6);
+        if (_frameTimes.size() < GPU_TIMER_HISTORY) {
+            _frameTimes.push_back(frameTime);
+        } else {
+            _frameTimes[_frameTimeCount % GPU_TIMER_HISTORY] = frameTime;
+        }
+        _frameTimeCount++;
+        _lastFrameTime = frameTime;
+    }
+    zones.names.clear();
+    return result == VK_SUCCESS;
+}
+
+std::vector<float> GpuTimer::getFrameTimes() const {
+    std::vector<float> frameTimes = _frameTimes;
+    if (_frameTimeCount > GPU_TIMER_HISTORY) {
+        std::rotate(frameTimes.begin(), frameTimes.begin() + _frameTimeCount % GPU_TIMER_HISTORY, frameTimes.end());
+    }
+    return frameTimes;
+}
+
+void GpuTimer::beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+    if (_queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    _frames[frame].names.clear();
+    vkCmdResetQueryPool(commandBuffer, _queryPool, frame * GPU_TIMER_MAX_ZONES * 2, GPU_TIMER_MAX_ZONES * 2);
+}
+
+void GpuTimer::reuseFrame(uint32_t frame, const std::vector<const char *> &zones) {
+    if (_queryPool == VK_NULL_HANDLE) {
+        return;
+    }
+    // The recording resets its own queries
+    _frames[frame].names = zones;
+}
+
+uint32_t GpuTimer::beginZone(VkCommandBuffer commandBuffer, uint32_t frame, const char *name) {
+    if (_queryPool == VK_NULL_HANDLE || _frames[frame].names.size() == GPU_TIMER_MAX_ZONES) {
+        return UINT32_MAX;
+    }
+    uint32_t zone = static_cast<uint32_t>(_frames[frame].names.size());
+    _frames[frame].names.push_back(name);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, (frame * GPU_TIMER_MAX_ZONES + zone) * 2);
+    return zone;
+}
+
+void GpuTimer::endZone(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t zone) {
+    if (zone == UINT32_MAX) {
+        return;
+    }
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, (frame * GPU_TIMER_MAX_ZONES + zone) * 2 + 1);
+}
+
+void GpuTimer::_calibrate(VkQueue queue, uint32_t queueFamily) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create timestamp calibration command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(_device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    vkCmdResetQueryPool(commandBuffer, _queryPool, 0, 1);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, 0);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    // The timestamp was taken somewhere between submit and idle, the midpoint is the best guess
+    uint64_t before = Profiler::nanoseconds();
+    vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkQueueWaitIdle(queue);
+    uint64_t after = Profiler::nanoseconds();
+
+    vkGetQueryPoolResults(_device, _queryPool, 0, 1, sizeof(uint64_t), &_anchorTicks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    _anchorNanoseconds = before + (after - before) / 2;
+
+    vkDestroyCommandPool(_device, commandPool, nullptr);
+    LOG_INFO("GPU timestamps calibrated within ", (after - before) / 1000, " us");
+}
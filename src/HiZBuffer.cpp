@@ -0,0 +1,376 @@
+#include "HiZBuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "utils.h"
+
+#define HIZ_GROUP_SIZE 8
+
+// Must match hiz_build_shader.glsl
+struct HiZBuildParams {
+    int32_t sourceSize[2];
+    int32_t destinationSize[2];
+    uint32_t fromDepth;
+};
+
+static void computeBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+static uint32_t floorPowerOfTwo(uint32_t value) {
+    uint32_t result = 1;
+    while (result * 2 <= value) {
+        result *= 2;
+    }
+    return result;
+}
+
+bool HiZBuffer::isSupported(VkPhysicalDevice physicalDevice, VkFormat depthFormat) {
+    VkFormatProperties depthProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &depthProperties);
+    VkFormatProperties pyramidProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R32_SFLOAT, &pyramidProperties);
+    return (depthProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+           (pyramidProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) &&
+           (pyramidProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+}
+
+void HiZBuffer::createRenderPass(VkDevice device, VkFormat depthFormat) {
+    _device = device;
+    _depthFormat = depthFormat;
+
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = depthFormat;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 0;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    // The previous frame's pyramid build may still be reading the depth image,
+    // and this frame's build reads it once the pass is done
+    std::array<VkSubpassDependency, 2> dependencies{};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[0].srcAccessMask = 0;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &depthAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+    if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pre-pass render pass!");
+    }
+}
+
+void HiZBuffer::init(VkPhysicalDevice physicalDevice, VkExtent2D extent) {
+    _physicalDevice = physicalDevice;
+    _extent = extent;
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    if (vkCreateSampler(_device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Hi-Z sampler!");
+    }
+
+    _createPipeline();
+    _createResources();
+}
+
+void HiZBuffer::cleanup() {
+    _destroyResources();
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
+    vkDestroySampler(_device, _sampler, nullptr);
+    vkDestroyRenderPass(_device, _renderPass, nullptr);
+}
+
+void HiZBuffer::resize(VkExtent2D extent) {
+    _destroyResources();
+    _extent = extent;
+    _createResources();
+}
+
+void HiZBuffer::beginDepthPass(VkCommandBuffer commandBuffer) {
+    VkClearValue clearValue{};
+    clearValue.depthStencil = {1.0f, 0};
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = _renderPass;
+    renderPassInfo.framebuffer = _framebuffer;
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = _extent;
+    renderPassInfo.clearValueCount = 1;
+    renderPassInfo.pClearValues = &clearValue;
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(_extent.width);
+    viewport.height = static_cast<float>(_extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = _extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void HiZBuffer::build(VkCommandBuffer commandBuffer) {
+    // Last frame's cull may still be reading the pyramid
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = _pyramidInitialized ? VK_ACCESS_SHADER_READ_BIT : 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = _pyramidInitialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = _pyramid;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, _mipCount, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    _pyramidInitialized = true;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+
+    uint32_t sourceWidth = _extent.width;
+    uint32_t sourceHeight = _extent.height;
+    for (uint32_t level = 0; level < _mipCount; level++) {
+        uint32_t width = std::max(_size.width >> level, 1u);
+        uint32_t height = std::max(_size.height >> level, 1u);
+
+        HiZBuildParams params{};
+        params.sourceSize[0] = static_cast<int32_t>(sourceWidth);
+        params.sourceSize[1] = static_cast<int32_t>(sourceHeight);
+        params.destinationSize[0] = static_cast<int32_t>(width);
+        params.destinationSize[1] = static_cast<int32_t>(height);
+        params.fromDepth = level == 0 ? 1 : 0;
+
+        if (level > 0) {
+            computeBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        }
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_levelSets[level], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+        vkCmdDispatch(commandBuffer, (width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+        sourceWidth = width;
+        sourceHeight = height;
+    }
+
+    computeBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void HiZBuffer::_createPipeline() {
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    for (uint32_t i = 1; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Hi-Z descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(HiZBuildParams);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Hi-Z pipeline layout!");
+    }
+
+    VkShaderModule shaderModule = Utils::createShaderModule(_device, "shaders/hiz_build.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _pipelineLayout;
+
+    auto result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline);
+    vkDestroyShaderModule(_device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Hi-Z pipeline!");
+    }
+}
+
+void HiZBuffer::_createResources() {
+    VkImageCreateInfo depthInfo{};
+    depthInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    depthInfo.imageType = VK_IMAGE_TYPE_2D;
+    depthInfo.format = _depthFormat;
+    depthInfo.extent = {_extent.width, _extent.height, 1};
+    depthInfo.mipLevels = 1;
+    depthInfo.arrayLayers = 1;
+    depthInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    depthInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    depthInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    depthInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Attachment, depthInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthImageMemory);
+    _depthImageView = Utils::createImageView(_device, _depthImage, _depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = _renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &_depthImageView;
+    framebufferInfo.width = _extent.width;
+    framebufferInfo.height = _extent.height;
+    framebufferInfo.layers = 1;
+    if (vkCreateFramebuffer(_device, &framebufferInfo, nullptr, &_framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pre-pass framebuffer!");
+    }
+
+    _size.width = floorPowerOfTwo(_extent.width);
+    _size.height = floorPowerOfTwo(_extent.height);
+    _mipCount = 1;
+    while ((_size.width >> _mipCount) > 0 || (_size.height >> _mipCount) > 0) {
+        _mipCount++;
+    }
+
+    VkImageCreateInfo pyramidInfo = depthInfo;
+    pyramidInfo.format = VK_FORMAT_R32_SFLOAT;
+    pyramidInfo.extent = {_size.width, _size.height, 1};
+    pyramidInfo.mipLevels = _mipCount;
+    pyramidInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Attachment, pyramidInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _pyramid, _pyramidMemory);
+    _pyramidView = Utils::createImageView(_device, _pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, _mipCount);
+    for (uint32_t level = 0; level < _mipCount; level++) {
+        _levelViews.push_back(Utils::createImageView(_device, _pyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+    }
+    _pyramidInitialized = false;
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = _mipCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = _mipCount * 2;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = _mipCount;
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Hi-Z descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(_mipCount, _descriptorSetLayout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = _mipCount;
+    allocInfo.pSetLayouts = layouts.data();
+    _levelSets.resize(_mipCount);
+    if (vkAllocateDescriptorSets(_device, &allocInfo, _levelSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate Hi-Z descriptor sets!");
+    }
+
+    // Level 0 reads the depth image, its source image binding is unused but must be valid
+    for (uint32_t level = 0; level < _mipCount; level++) {
+        VkDescriptorImageInfo depthImageInfo{};
+        depthImageInfo.sampler = _sampler;
+        depthImageInfo.imageView = _depthImageView;
+        depthImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+        VkDescriptorImageInfo sourceInfo{};
+        sourceInfo.imageView = _levelViews[level > 0 ? level - 1 : 0];
+        sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destinationInfo{};
+        destinationInfo.imageView = _levelViews[level];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkDescriptorImageInfo *, 3> infos = {&depthImageInfo, &sourceInfo, &destinationInfo};
+        std::array<VkWriteDescriptorSet, 3> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = _levelSets[level];
+            writes[i].dstBinding = i;
+            writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].descriptorCount = 1;
+            writes[i].pImageInfo = infos[i];
+        }
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    LOG_INFO("Hi-Z pyramid ", _size.width, "x", _size.height, " with ", _mipCount, " levels");
+}
+
+void HiZBuffer::_destroyResources() {
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    _levelSets.clear();
+    for (VkImageView view : _levelViews) {
+        vkDestroyImageView(_device, view, nullptr);
+    }
+    _levelViews.clear();
+    vkDestroyImageView(_device, _pyramidView, nullptr);
+    vkDestroyImage(_device, _pyramid, nullptr);
+    Utils::freeMemory(_device, _pyramidMemory);
+
+    vkDestroyFramebuffer(_device, _framebuffer, nullptr);
+    vkDestroyImageView(_device, _depthImageView, nullptr);
+    vkDestroyImage(_device, _depthImage, nullptr);
+    Utils::freeMemory(_device, _depthImageMemory);
+}
@@ -0,0 +1,252 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+#include "Logger.h"
+#include "Profiler.h"
+#include "utils.h"
+
+#define JOB_RANGES_PER_THREAD 4
+
+static thread_local const JobSystem *t_owner = nullptr;
+static thread_local uint32_t t_index = 0;
+
+JobSystem::JobSystem(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        _queues.push_back(std::make_unique<Queue>());
+    }
+    // One extra slot collects the timings of jobs run by threads outside the system
+    for (uint32_t i = 0; i <= threadCount; i++) {
+        _stats.push_back(std::make_unique<ThreadStats>());
+    }
+
+    t_owner = this;
+    t_index = 0;
+    for (uint32_t i = 1; i < threadCount; i++) {
+        _workers.emplace_back(&JobSystem::_workerLoop, this, i);
+    }
+
+    LOG_INFO("Job system started with ", threadCount, " threads");
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+    if (t_owner == this) {
+        t_owner = nullptr;
+    }
+}
+
+void JobSystem::run(const char *name, std::function<void()> function, JobCounter *counter, JobCounter *dependency) {
+    Job job;
+    job.name = name;
+    job.function = std::move(function);
+    job.counter = counter;
+
+    if (counter != nullptr) {
+        counter->_value.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (dependency != nullptr) {
+        std::lock_guard<std::mutex> lock(dependency->_mutex);
+        if (dependency->_value.load(std::memory_order_acquire) != 0) {
+            dependency->_dependents.push_back(std::move(job));
+            return;
+        }
+    }
+    _push(std::move(job));
+}
+
+void JobSystem::wait(JobCounter &counter) {
+    uint32_t index = _currentIndex();
+    while (!counter.isDone()) {
+        if (!_tryExecute(index)) {
+            std::this_thread::yield();
+        }
+    }
+    // The job that finished the counter may still hold its mutex, wait for it
+    // before the caller is allowed to destroy the counter
+    std::lock_guard<std::mutex> lock(counter._mutex);
+}
+
+void JobSystem::parallelFor(const char *name, uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)> &body) {
+    if (count == 0) {
+        return;
+    }
+    if (grainSize == 0) {
+        grainSize = std::max(1u, count / (getThreadCount() * JOB_RANGES_PER_THREAD));
+    }
+
+    JobCounter counter;
+    for (uint32_t begin = 0; begin < count; begin += grainSize) {
+        uint32_t end = std::min(count, begin + grainSize);
+        run(name, [&body, begin, end]() { body(begin, end); }, &counter);
+    }
+    wait(counter);
+}
+
+std::vector<JobStats> JobSystem::collectStats() {
+    std::unordered_map<std::string, JobStats> merged;
+    for (auto &threadStats : _stats) {
+        std::lock_guard<std::mutex> lock(threadStats->mutex);
+        for (const auto &[name, stats] : threadStats->jobs) {
+            JobStats &total = merged[stats.name];
+            total.name = stats.name;
+            total.count += stats.count;
+            total.totalNanoseconds += stats.totalNanoseconds;
+            total.maxNanoseconds = std::max(total.maxNanoseconds, stats.maxNanoseconds);
+        }
+        threadStats->jobs.clear();
+    }
+
+    std::vector<JobStats> result;
+    for (auto &[name, stats] : merged) {
+        result.push_back(std::move(stats));
+    }
+    std::sort(result.begin(), result.end(), [](const JobStats &a, const JobStats &b) {
+        return a.totalNanoseconds > b.totalNanoseconds;
+    });
+    return result;
+}
+
+void JobSystem::report() {
+    for (const JobStats &stats : collectStats()) {
+        std::ostringstream line;
+        line << "Job " << stats.name << ": " << stats.count << " runs, "
+             << std::fixed << std::setprecision(1)
+             << stats.totalNanoseconds / 1e3 / stats.count << " us avg, "
+             << stats.maxNanoseconds / 1e3 << " us max, "
+             << stats.totalNanoseconds / 1e6 << " ms total";
+        LOG_INFO(line.str());
+    }
+}
+
+void JobSystem::_workerLoop(uint32_t index) {
+    t_owner = this;
+    t_index = index;
+    Profiler::get().setThreadName("job worker " + std::to_string(index));
+
+    while (true) {
+        if (_tryExecute(index)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wake.wait(lock, [this] { return _stop || _queuedJobs.load(std::memory_order_acquire) > 0; });
+        if (_stop) {
+            return;
+        }
+    }
+}
+
+void JobSystem::_push(Job job) {
+    uint32_t index = _currentIndex();
+    if (index == UINT32_MAX) {
+        index = _nextQueue.fetch_add(1, std::memory_order_relaxed) % getThreadCount();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+        _queues[index]->jobs.push_back(std::move(job));
+    }
+    _queuedJobs.fetch_add(1, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    _wake.notify_one();
+}
+
+bool JobSystem::_pop(uint32_t index, Job &job) {
+    Queue &queue = *_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+        return false;
+    }
+    // Newest first, its data is most likely still in cache
+    job = std::move(queue.jobs.back());
+    queue.jobs.pop_back();
+    return true;
+}
+
+bool JobSystem::_steal(uint32_t index, Job &job) {
+    uint32_t threadCount = getThreadCount();
+    uint32_t start = index == UINT32_MAX ? 0 : index + 1;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        Queue &queue = *_queues[(start + i) % threadCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::_tryExecute(uint32_t index) {
+    Job job;
+    if ((index != UINT32_MAX && _pop(index, job)) || _steal(index, job)) {
+        _queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        _execute(index, job);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::_execute(uint32_t index, Job &job) {
+    auto start = std::chrono::steady_clock::now();
+    {
+        PROFILE_ZONE(job.name);
+        job.function();
+    }
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    ThreadStats &threadStats = *_stats[index == UINT32_MAX ? getThreadCount() : index];
+    {
+        std::lock_guard<std::mutex> lock(threadStats.mutex);
+        JobStats &stats = threadStats.jobs[job.name];
+        if (stats.count == 0) {
+            stats.name = job.name;
+        }
+        stats.count++;
+        stats.totalNanoseconds += elapsed;
+        stats.maxNanoseconds = std::max(stats.maxNanoseconds, elapsed);
+    }
+
+    _finish(job.counter);
+}
+
+void JobSystem::_finish(JobCounter *counter) {
+    if (counter == nullptr) {
+        return;
+    }
+
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->_mutex);
+        if (counter->_value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ready.swap(counter->_dependents);
+        }
+    }
+    for (Job &job : ready) {
+        _push(std::move(job));
+    }
+}
+
+uint32_t JobSystem::_currentIndex() const {
+    return t_owner == this ? t_index : UINT32_MAX;
+}
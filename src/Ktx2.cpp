@@ -0,0 +1,90 @@
+#include "Ktx2.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct Ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be tightly packed");
+}  // namespace
+
+Ktx2File Ktx2File::open(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open KTX2 file " + filename);
+    }
+
+    Ktx2Header header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        throw std::runtime_error("Not a KTX2 file: " + filename);
+    }
+    if (header.supercompressionScheme != 0) {
+        throw std::runtime_error("Supercompressed KTX2 files are not supported: " + filename);
+    }
+    // Basis Universal and other formats described only by the DFD
+    if (header.vkFormat == VK_FORMAT_UNDEFINED) {
+        throw std::runtime_error("KTX2 file has an unsupported format (VK_FORMAT_UNDEFINED): " + filename);
+    }
+    if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+        throw std::runtime_error("Only 2D KTX2 textures are supported: " + filename);
+    }
+
+    Ktx2File ktx;
+    ktx.filename = filename;
+    ktx.format = static_cast<VkFormat>(header.vkFormat);
+    ktx.width = header.pixelWidth;
+    ktx.height = std::max(header.pixelHeight, 1u);
+    // A level count of 0 asks the loader to generate mips, we only have the base level
+    ktx.levelCount = std::max(header.levelCount, 1u);
+    ktx.levels.resize(ktx.levelCount);
+
+    file.read(reinterpret_cast<char *>(ktx.levels.data()), sizeof(Ktx2Level) * ktx.levelCount);
+    if (!file) {
+        throw std::runtime_error("Truncated KTX2 level index: " + filename);
+    }
+
+    return ktx;
+}
+
+std::vector<char> Ktx2File::readLevel(uint32_t level) const {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open KTX2 file " + filename);
+    }
+
+    const Ktx2Level &entry = levels.at(level);
+    std::vector<char> data(entry.byteLength);
+    file.seekg(static_cast<std::streamoff>(entry.byteOffset));
+    file.read(data.data(), static_cast<std::streamsize>(entry.byteLength));
+    if (!file) {
+        throw std::runtime_error("Truncated KTX2 level data: " + filename);
+    }
+
+    return data;
+}
+
+VkExtent2D Ktx2File::levelExtent(uint32_t level) const {
+    return {std::max(width >> level, 1u), std::max(height >> level, 1u)};
+}
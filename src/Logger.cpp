@@ -0,0 +1,289 @@
+#include "Logger.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "utils.h"
+
+static uint64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+static T readValue(const char *&cursor) {
+    T value;
+    std::memcpy(&value, cursor, sizeof(value));
+    cursor += sizeof(value);
+    return value;
+}
+
+Logger &Logger::get() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : _startNanoseconds(steadyNanoseconds()) {
+    static_assert((LOG_QUEUE_SIZE & (LOG_QUEUE_SIZE - 1)) == 0, "LOG_QUEUE_SIZE must be a power of two");
+    _slots = std::make_unique<Slot[]>(LOG_QUEUE_SIZE);
+    for (uint64_t i = 0; i < LOG_QUEUE_SIZE; i++) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _repeats = std::make_unique<std::atomic<uint32_t>[]>(LOG_REPEAT_SLOTS);
+    for (uint32_t i = 0; i < LOG_REPEAT_SLOTS; i++) {
+        _repeats[i].store(0, std::memory_order_relaxed);
+    }
+    _writer = std::thread(&Logger::_writerLoop, this);
+}
+
+Logger::~Logger() {
+    shutdown();
+}
+
+bool Logger::allowRepeat(uint64_t key) {
+    uint32_t count = _repeats[key % LOG_REPEAT_SLOTS].fetch_add(1, std::memory_order_relaxed) + 1;
+    if (count <= LOG_REPEAT_LIMIT) {
+        return true;
+    }
+    if (count == LOG_REPEAT_LIMIT + 1) {
+        LOG_INFO("Message repeated ", LOG_REPEAT_LIMIT, " times, suppressing further repeats");
+    }
+    _suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool Logger::openBinaryLog(const std::string &filename) {
+    flush();
+    if (_binaryLogOpen.load(std::memory_order_acquire)) {
+        return false;
+    }
+    _binaryLog.open(filename, std::ios::binary);
+    if (!_binaryLog) {
+        LOG_WARNING("Cannot write binary log to ", filename);
+        return false;
+    }
+    _binaryLog.write("VKLOG\1\0\0", 8);
+    _binaryLogOpen.store(true, std::memory_order_release);
+    LOG_INFO("Writing binary log to ", filename);
+    return true;
+}
+
+void Logger::flush() {
+    uint64_t target = _tail.load(std::memory_order_acquire);
+    while (!_stop.load(std::memory_order_acquire) && _written.load(std::memory_order_acquire) < target) {
+        std::this_thread::yield();
+    }
+}
+
+void Logger::shutdown() {
+    if (_stop.exchange(true)) {
+        return;
+    }
+    _writer.join();
+    _joined.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in _push: either this drain sees a message published after
+    // the writer's last drain, or its producer sees _joined and drains it itself
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        std::lock_guard<std::mutex> lock(_directMutex);
+        _drain();
+    }
+
+    uint64_t suppressed = _suppressed.load();
+    if (suppressed > 0) {
+        LOG_INFO(suppressed, " repeated messages were suppressed");
+    }
+    std::lock_guard<std::mutex> lock(_directMutex);
+    if (_binaryLogOpen.load()) {
+        _binaryLog.close();
+        _binaryLogOpen.store(false);
+    }
+}
+
+std::string &Logger::_scratch() {
+    static thread_local std::string payload;
+    return payload;
+}
+
+uint32_t Logger::_threadIndex() {
+    static std::atomic<uint32_t> nextIndex{0};
+    static thread_local uint32_t index = nextIndex.fetch_add(1);
+    return index;
+}
+
+// Multi-producer side of a bounded queue where every slot carries a sequence number,
+// producers claim a position with one compare exchange and publish it by bumping the sequence
+void Logger::_push(LogLevel level, const std::string &payload) {
+    if (_joined.load(std::memory_order_relaxed)) {
+        // The writer is gone, write on the caller's thread. Until it is joined it is
+        // still draining the queue, so messages keep going through it.
+        std::lock_guard<std::mutex> lock(_directMutex);
+        Slot slot;
+        slot.time = steadyNanoseconds();
+        slot.thread = _threadIndex();
+        slot.level = level;
+        slot.size = static_cast<uint32_t>(payload.size());
+        slot.overflow = std::make_unique<char[]>(payload.size());
+        std::memcpy(slot.overflow.get(), payload.data(), payload.size());
+        _write(slot);
+        return;
+    }
+
+    Slot *slot = nullptr;
+    uint64_t position = _tail.load(std::memory_order_relaxed);
+    while (true) {
+        slot = &_slots[position & (LOG_QUEUE_SIZE - 1)];
+        int64_t difference = static_cast<int64_t>(slot->sequence.load(std::memory_order_acquire)) - static_cast<int64_t>(position);
+        if (difference == 0) {
+            if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // Full. Warnings and errors wait for the writer, everything else is dropped.
+            if (level < LogLevel::Warning) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (_joined.load(std::memory_order_relaxed)) {
+                // No writer left to make room
+                std::lock_guard<std::mutex> lock(_directMutex);
+                _drain();
+            }
+            std::this_thread::yield();
+            position = _tail.load(std::memory_order_relaxed);
+        } else {
+            position = _tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->time = steadyNanoseconds();
+    slot->thread = _threadIndex();
+    slot->level = level;
+    slot->size = static_cast<uint32_t>(payload.size());
+    if (payload.size() <= LOG_INLINE_PAYLOAD) {
+        std::memcpy(slot->payload, payload.data(), payload.size());
+    } else {
+        slot->overflow = std::make_unique<char[]>(payload.size());
+        std::memcpy(slot->overflow.get(), payload.data(), payload.size());
+    }
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    // Shutdown may have drained for the last time before this was published
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_joined.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_directMutex);
+        _drain();
+    }
+}
+
+bool Logger::_pop(Slot *&slot) {
+    slot = &_slots[_head & (LOG_QUEUE_SIZE - 1)];
+    return slot->sequence.load(std::memory_order_acquire) == _head + 1;
+}
+
+bool Logger::_drain() {
+    bool wrote = false;
+    Slot *slot = nullptr;
+    while (_pop(slot)) {
+        _write(*slot);
+        slot->overflow.reset();
+        slot->sequence.store(_head + LOG_QUEUE_SIZE, std::memory_order_release);
+        _head++;
+        _written.fetch_add(1, std::memory_order_release);
+        wrote = true;
+    }
+    if (wrote) {
+        std::cout.flush();
+    }
+
+    uint64_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::cerr << UNI_YELLOW << "Warning: " << UNI_RESET << "Log queue full, dropped " << dropped << " messages\n";
+    }
+    return wrote;
+}
+
+void Logger::_write(const Slot &slot) {
+    const char *payload = slot.overflow ? slot.overflow.get() : slot.payload;
+
+    if (_binaryLogOpen.load(std::memory_order_acquire)) {
+        uint64_t time = slot.time - _startNanoseconds;
+        uint8_t level = static_cast<uint8_t>(slot.level);
+        _binaryLog.write(reinterpret_cast<const char *>(&time), sizeof(time));
+        _binaryLog.write(reinterpret_cast<const char *>(&slot.thread), sizeof(slot.thread));
+        _binaryLog.write(reinterpret_cast<const char *>(&level), sizeof(level));
+        _binaryLog.write(reinterpret_cast<const char *>(&slot.size), sizeof(slot.size));
+        _binaryLog.write(payload, slot.size);
+    }
+
+    std::ostringstream line;
+    switch (slot.level) {
+        case LogLevel::Verbose:
+            line << UNI_BLUE << "Verbose: " << UNI_RESET;
+            break;
+        case LogLevel::Info:
+            line << UNI_GREEN << "Info: " << UNI_RESET;
+            break;
+        case LogLevel::Warning:
+            line << UNI_YELLOW << "Warning: " << UNI_RESET;
+            break;
+        case LogLevel::Error:
+            line << UNI_RED << "Error: " << UNI_RESET;
+            break;
+    }
+
+    const char *cursor = payload;
+    const char *end = payload + slot.size;
+    while (cursor < end) {
+        switch (static_cast<ArgTag>(*cursor++)) {
+            case ArgTag::Int:
+                line << readValue<int64_t>(cursor);
+                break;
+            case ArgTag::UInt:
+                line << readValue<uint64_t>(cursor);
+                break;
+            case ArgTag::Float:
+                line << readValue<double>(cursor);
+                break;
+            case ArgTag::Bool:
+                line << (readValue<uint8_t>(cursor) ? "true" : "false");
+                break;
+            case ArgTag::Char:
+                line << readValue<char>(cursor);
+                break;
+            case ArgTag::String: {
+                uint32_t length = readValue<uint32_t>(cursor);
+                line.write(cursor, length);
+                cursor += length;
+                break;
+            }
+            case ArgTag::Pointer:
+                line << "0x" << std::hex << readValue<uint64_t>(cursor) << std::dec;
+                break;
+        }
+    }
+    line << '\n';
+
+    std::string text = line.str();
+    if (slot.level >= LogLevel::Warning) {
+        // Keep the order of the two streams on a shared terminal
+        std::cout.flush();
+        std::cerr.write(text.data(), text.size());
+    } else {
+        std::cout.write(text.data(), text.size());
+    }
+}
+
+void Logger::_writerLoop() {
+    while (true) {
+        bool stopping = _stop.load(std::memory_order_acquire);
+        if (!_drain()) {
+            if (stopping) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITER_IDLE_MS));
+        }
+    }
+    std::cout.flush();
+}
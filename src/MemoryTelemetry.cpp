@@ -0,0 +1,243 @@
+#include "MemoryTelemetry.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "Logger.h"
+#include "utils.h"
+
+// Share of the heap we assume is ours when the driver cannot tell
+#define MEMORY_FALLBACK_BUDGET_RATIO 0.8
+// Warn once usage reaches this share of the budget, and again after it dropped below
+#define MEMORY_BUDGET_WARNING_RATIO 0.9
+
+static double mebibytes(VkDeviceSize bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+MemoryTelemetry &MemoryTelemetry::get() {
+    static MemoryTelemetry telemetry;
+    return telemetry;
+}
+
+const char *MemoryTelemetry::categoryName(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::Vertex:
+            return "vertex";
+        case MemoryCategory::Index:
+            return "index";
+        case MemoryCategory::Uniform:
+            return "uniform";
+        case MemoryCategory::Staging:
+            return "staging";
+        case MemoryCategory::Texture:
+            return "texture";
+        case MemoryCategory::Attachment:
+            return "attachment";
+        case MemoryCategory::Storage:
+            return "storage";
+        case MemoryCategory::Readback:
+            return "readback";
+        default:
+            return "unknown";
+    }
+}
+
+void MemoryTelemetry::init(VkPhysicalDevice physicalDevice, bool memoryBudget) {
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _physicalDevice = physicalDevice;
+        _memoryBudget = memoryBudget;
+        _typeHeaps.clear();
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            _typeHeaps.push_back(memoryProperties.memoryTypes[i].heapIndex);
+        }
+        _heaps.assign(memoryProperties.memoryHeapCount, Heap());
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            _heaps[i].size = memoryProperties.memoryHeaps[i].size;
+            _heaps[i].deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+            _heaps[i].budget = static_cast<VkDeviceSize>(_heaps[i].size * MEMORY_FALLBACK_BUDGET_RATIO);
+        }
+    }
+
+    pollBudget();
+}
+
+void MemoryTelemetry::track(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size, MemoryCategory category) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t heap = memoryTypeIndex < _typeHeaps.size() ? _typeHeaps[memoryTypeIndex] : 0;
+    _allocations[memory] = {size, heap, category};
+    _add(_categories[static_cast<size_t>(category)], size);
+    _add(_total, size);
+    if (heap < _heaps.size()) {
+        _add(_heaps[heap].counters, size);
+        _checkBudget(heap);
+    }
+}
+
+void MemoryTelemetry::untrack(VkDeviceMemory memory) {
+    if (memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _allocations.find(memory);
+    if (it == _allocations.end()) {
+        return;
+    }
+    const Allocation &allocation = it->second;
+    MemoryCounters &category = _categories[static_cast<size_t>(allocation.category)];
+    category.liveBytes -= allocation.size;
+    category.liveAllocations--;
+    _total.liveBytes -= allocation.size;
+    _total.liveAllocations--;
+    if (allocation.heap < _heaps.size()) {
+        Heap &heap = _heaps[allocation.heap];
+        heap.counters.liveBytes -= allocation.size;
+        heap.counters.liveAllocations--;
+        // Frees between polls are not seen by the driver numbers yet, so keep the estimate conservative
+        heap.polledLiveBytes = std::min(heap.polledLiveBytes, heap.counters.liveBytes);
+        _checkBudget(allocation.heap);
+    }
+    _allocations.erase(it);
+}
+
+void MemoryTelemetry::pollBudget() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_memoryBudget) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+        memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memoryProperties.pNext = &budget;
+        vkGetPhysicalDeviceMemoryProperties2(_physicalDevice, &memoryProperties);
+
+        for (uint32_t i = 0; i < _heaps.size(); i++) {
+            _heaps[i].budget = budget.heapBudget[i];
+            _heaps[i].polledUsage = budget.heapUsage[i];
+            _heaps[i].polledLiveBytes = _heaps[i].counters.liveBytes;
+        }
+    }
+
+    for (uint32_t i = 0; i < _heaps.size(); i++) {
+        _checkBudget(i);
+    }
+}
+
+MemoryCounters MemoryTelemetry::getCategoryCounters(MemoryCategory category) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _categories[static_cast<size_t>(category)];
+}
+
+MemoryCounters MemoryTelemetry::getTotalCounters() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _total;
+}
+
+MemoryCounters MemoryTelemetry::getHeapCounters(uint32_t heap) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _heaps[heap].counters;
+}
+
+uint32_t MemoryTelemetry::getHeapCount() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return static_cast<uint32_t>(_heaps.size());
+}
+
+VkDeviceSize MemoryTelemetry::getHeapBudget(uint32_t heap) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _heaps[heap].budget;
+}
+
+VkDeviceSize MemoryTelemetry::getHeapUsage(uint32_t heap) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _usage(_heaps[heap]);
+}
+
+void MemoryTelemetry::resetPeaks() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (MemoryCounters &counters : _categories) {
+        counters.peakBytes = counters.liveBytes;
+    }
+    for (Heap &heap : _heaps) {
+        heap.counters.peakBytes = heap.counters.liveBytes;
+    }
+    _total.peakBytes = _total.liveBytes;
+}
+
+void MemoryTelemetry::report() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::ostringstream table;
+    table << "Device memory by category (live, peak, allocations):";
+    for (size_t i = 0; i < _categories.size(); i++) {
+        const MemoryCounters &counters = _categories[i];
+        if (counters.totalAllocations == 0) {
+            continue;
+        }
+        table << "\n    " << std::left << std::setw(12) << categoryName(static_cast<MemoryCategory>(i)) << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << mebibytes(counters.liveBytes) << " MiB "
+              << std::setw(10) << mebibytes(counters.peakBytes) << " MiB "
+              << std::setw(8) << counters.totalAllocations;
+    }
+    LOG_INFO(table.str());
+
+    table.str("");
+    table << "Device memory by heap (live, peak, usage, budget):";
+    for (size_t i = 0; i < _heaps.size(); i++) {
+        const Heap &heap = _heaps[i];
+        table << "\n    heap " << i << std::left << std::setw(7) << (heap.deviceLocal ? " local" : "") << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << mebibytes(heap.counters.liveBytes) << " MiB "
+              << std::setw(10) << mebibytes(heap.counters.peakBytes) << " MiB "
+              << std::setw(10) << mebibytes(_usage(heap)) << " MiB "
+              << std::setw(10) << mebibytes(heap.budget) << " MiB";
+    }
+    LOG_INFO(table.str());
+}
+
+size_t MemoryTelemetry::reportLeaks() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_allocations.empty()) {
+        LOG_INFO("No device memory leaked");
+        return 0;
+    }
+
+    std::ostringstream table;
+    table << _allocations.size() << " device memory allocations were never freed:";
+    for (const auto &[memory, allocation] : _allocations) {
+        table << "\n    " << memory << " " << std::left << std::setw(12) << categoryName(allocation.category) << std::right
+              << allocation.size << " bytes on heap " << allocation.heap;
+    }
+    LOG_WARNING(table.str());
+    return _allocations.size();
+}
+
+void MemoryTelemetry::_add(MemoryCounters &counters, VkDeviceSize size) {
+    counters.liveBytes += size;
+    counters.peakBytes = std::max(counters.peakBytes, counters.liveBytes);
+    counters.liveAllocations++;
+    counters.totalAllocations++;
+}
+
+VkDeviceSize MemoryTelemetry::_usage(const Heap &heap) const {
+    if (!_memoryBudget) {
+        return heap.counters.liveBytes;
+    }
+    return heap.polledUsage + (heap.counters.liveBytes - heap.polledLiveBytes);
+}
+
+void MemoryTelemetry::_checkBudget(uint32_t heapIndex) {
+    Heap &heap = _heaps[heapIndex];
+    VkDeviceSize usage = _usage(heap);
+    bool close = usage >= static_cast<VkDeviceSize>(heap.budget * MEMORY_BUDGET_WARNING_RATIO);
+    if (close && !heap.warned) {
+        std::ostringstream line;
+        line << "Memory heap " << heapIndex << (heap.deviceLocal ? " (device local)" : "")
+             << " at " << std::fixed << std::setprecision(1) << mebibytes(usage) << " of " << mebibytes(heap.budget) << " MiB budget";
+        LOG_WARNING(line.str());
+    }
+    heap.warned = close;
+}
@@ -0,0 +1,341 @@
+#include "MeshLod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+// Border planes outweigh face planes so a vertex on an open border or seam is
+// only moved along it
+#define BORDER_QUADRIC_WEIGHT 1000.0
+// A level has to remove at least this fraction of the previous one's triangles
+#define LOD_MIN_REDUCTION 0.85f
+// Levels that deviate further than this fraction of the bounding radius are not worth keeping
+#define LOD_MAX_RELATIVE_ERROR 0.5f
+
+namespace {
+
+// Symmetric 4x4 matrix of the summed squared plane distances, plus the summed
+// plane weights so the error can be reported as a mean squared distance
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    double a11 = 0, a12 = 0, a13 = 0;
+    double a22 = 0, a23 = 0;
+    double a33 = 0;
+    double weight = 0;
+
+    static Quadric fromPlane(double a, double b, double c, double d, double weight) {
+        Quadric q;
+        q.a00 = a * a * weight;
+        q.a01 = a * b * weight;
+        q.a02 = a * c * weight;
+        q.a03 = a * d * weight;
+        q.a11 = b * b * weight;
+        q.a12 = b * c * weight;
+        q.a13 = b * d * weight;
+        q.a22 = c * c * weight;
+        q.a23 = c * d * weight;
+        q.a33 = d * d * weight;
+        q.weight = weight;
+        return q;
+    }
+
+    void add(const Quadric &other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a03 += other.a03;
+        a11 += other.a11;
+        a12 += other.a12;
+        a13 += other.a13;
+        a22 += other.a22;
+        a23 += other.a23;
+        a33 += other.a33;
+        weight += other.weight;
+    }
+
+    double evaluate(const glm::vec3 &p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                        a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                        a22 * z * z + 2 * a23 * z +
+                        a33;
+        return weight > 0.0 ? std::max(result, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t fromVersion;
+    uint32_t toVersion;
+
+    bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+class Simplifier {
+   public:
+    Simplifier(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices)
+        : _positions(positions), _indices(indices) {
+        size_t vertexCount = positions.size();
+        size_t triangleCount = indices.size() / 3;
+        _quadrics.resize(vertexCount);
+        _vertexTriangles.resize(vertexCount);
+        _version.resize(vertexCount, 0);
+        _removed.resize(vertexCount, false);
+        _triangleAlive.resize(triangleCount, true);
+        _liveTriangles = triangleCount;
+
+        for (uint32_t t = 0; t < triangleCount; t++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                _vertexTriangles[_indices[t * 3 + k]].push_back(t);
+            }
+
+            glm::vec3 p0 = positions[_indices[t * 3]];
+            glm::vec3 normal = glm::cross(positions[_indices[t * 3 + 1]] - p0, positions[_indices[t * 3 + 2]] - p0);
+            float length = glm::length(normal);
+            if (length == 0.0f) {
+                continue;
+            }
+            normal /= length;
+            Quadric plane = Quadric::fromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0), _triangleArea(t));
+            for (uint32_t k = 0; k < 3; k++) {
+                _quadrics[_indices[t * 3 + k]].add(plane);
+            }
+        }
+
+        _addBorderQuadrics();
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            _pushNeighbours(v);
+        }
+    }
+
+    void run(size_t targetIndexCount) {
+        while (_liveTriangles * 3 > targetIndexCount && !_queue.empty()) {
+            Collapse collapse = _queue.top();
+            _queue.pop();
+            if (_removed[collapse.from] || _removed[collapse.to] ||
+                _version[collapse.from] != collapse.fromVersion || _version[collapse.to] != collapse.toVersion) {
+                continue;
+            }
+            if (_flipsTriangle(collapse.from, collapse.to)) {
+                continue;
+            }
+            _collapse(collapse.from, collapse.to);
+            _maxCost = std::max(_maxCost, collapse.cost);
+        }
+    }
+
+    std::vector<uint32_t> result() const {
+        std::vector<uint32_t> indices;
+        for (size_t t = 0; t < _triangleAlive.size(); t++) {
+            if (_triangleAlive[t]) {
+                indices.insert(indices.end(), _indices.begin() + t * 3, _indices.begin() + t * 3 + 3);
+            }
+        }
+        return indices;
+    }
+
+    float error() const { return static_cast<float>(std::sqrt(_maxCost)); }
+
+   private:
+    double _triangleArea(uint32_t t) const {
+        glm::vec3 p0 = _positions[_indices[t * 3]];
+        return glm::length(glm::cross(_positions[_indices[t * 3 + 1]] - p0, _positions[_indices[t * 3 + 2]] - p0)) * 0.5;
+    }
+
+    void _addBorderQuadrics() {
+        // An edge used by a single triangle is an open border or a seam between split vertices
+        for (uint32_t t = 0; t < _triangleAlive.size(); t++) {
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t a = _indices[t * 3 + k];
+                uint32_t b = _indices[t * 3 + (k + 1) % 3];
+                if (_edgeTriangleCount(a, b) != 1) {
+                    continue;
+                }
+
+                glm::vec3 p0 = _positions[_indices[t * 3]];
+                glm::vec3 faceNormal = glm::cross(_positions[_indices[t * 3 + 1]] - p0, _positions[_indices[t * 3 + 2]] - p0);
+                glm::vec3 edge = _positions[b] - _positions[a];
+                glm::vec3 normal = glm::cross(edge, faceNormal);
+                float length = glm::length(normal);
+                if (length == 0.0f) {
+                    continue;
+                }
+                normal /= length;
+                Quadric plane = Quadric::fromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, _positions[a]), BORDER_QUADRIC_WEIGHT * glm::dot(edge, edge));
+                _quadrics[a].add(plane);
+                _quadrics[b].add(plane);
+            }
+        }
+    }
+
+    uint32_t _edgeTriangleCount(uint32_t a, uint32_t b) const {
+        uint32_t count = 0;
+        for (uint32_t t : _vertexTriangles[a]) {
+            if (!_triangleAlive[t]) {
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                if (_indices[t * 3 + k] == b) {
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+
+    void _pushNeighbours(uint32_t v) {
+        for (uint32_t t : _vertexTriangles[v]) {
+            if (!_triangleAlive[t]) {
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t other = _indices[t * 3 + k];
+                if (other == v) {
+                    continue;
+                }
+                Quadric q = _quadrics[v];
+                q.add(_quadrics[other]);
+                _queue.push({q.evaluate(_positions[other]), v, other, _version[v], _version[other]});
+            }
+        }
+    }
+
+    bool _flipsTriangle(uint32_t from, uint32_t to) const {
+        for (uint32_t t : _vertexTriangles[from]) {
+            if (!_triangleAlive[t]) {
+                continue;
+            }
+            glm::vec3 corners[3];
+            glm::vec3 moved[3];
+            bool sharesEdge = false;
+            for (uint32_t k = 0; k < 3; k++) {
+                uint32_t index = _indices[t * 3 + k];
+                sharesEdge |= index == to;
+                corners[k] = _positions[index];
+                moved[k] = index == from ? _positions[to] : corners[k];
+            }
+            if (sharesEdge) {
+                continue;  // Becomes degenerate and is removed
+            }
+            glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _collapse(uint32_t from, uint32_t to) {
+        for (uint32_t t : _vertexTriangles[from]) {
+            if (!_triangleAlive[t]) {
+                continue;
+            }
+            bool degenerate = false;
+            for (uint32_t k = 0; k < 3; k++) {
+                degenerate |= _indices[t * 3 + k] == to;
+            }
+            if (degenerate) {
+                _triangleAlive[t] = false;
+                _liveTriangles--;
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                if (_indices[t * 3 + k] == from) {
+                    _indices[t * 3 + k] = to;
+                }
+            }
+            _vertexTriangles[to].push_back(t);
+        }
+        _vertexTriangles[from].clear();
+        _removed[from] = true;
+        _quadrics[to].add(_quadrics[from]);
+
+        // Costs around `to` changed, stale queue entries are skipped by version
+        _version[to]++;
+        _pushNeighbours(to);
+    }
+
+    const std::vector<glm::vec3> &_positions;
+    std::vector<uint32_t> _indices;
+    std::vector<Quadric> _quadrics;
+    std::vector<std::vector<uint32_t>> _vertexTriangles;
+    std::vector<uint32_t> _version;
+    std::vector<bool> _removed;
+    std::vector<bool> _triangleAlive;
+    size_t _liveTriangles = 0;
+    double _maxCost = 0.0;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> _queue;
+};
+
+}  // namespace
+
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, size_t targetIndexCount, float &error) {
+    Simplifier simplifier(positions, indices);
+    simplifier.run(targetIndexCount);
+    error = simplifier.error();
+    return simplifier.result();
+}
+
+MeshLodChain buildLodChain(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices) {
+    MeshLodChain chain;
+
+    glm::vec3 minimum(INFINITY);
+    glm::vec3 maximum(-INFINITY);
+    for (const glm::vec3 &position : positions) {
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    if (!positions.empty()) {
+        chain.center = (minimum + maximum) * 0.5f;
+        for (const glm::vec3 &position : positions) {
+            chain.radius = std::max(chain.radius, glm::length(position - chain.center));
+        }
+    }
+
+    chain.indices = indices;
+    chain.lods.push_back({0, static_cast<uint32_t>(indices.size()), 0.0f});
+
+    std::vector<uint32_t> current = indices;
+    float error = 0.0f;
+    while (chain.lods.size() < MESH_LOD_MAX_LEVELS) {
+        float levelError = 0.0f;
+        std::vector<uint32_t> simplified = simplifyMesh(positions, current, current.size() / 6 * 3, levelError);
+        if (simplified.empty() || simplified.size() > current.size() * LOD_MIN_REDUCTION) {
+            break;
+        }
+
+        // Errors add up across levels, each one is measured against the previous level only
+        error += levelError;
+        if (error > chain.radius * LOD_MAX_RELATIVE_ERROR) {
+            break;
+        }
+        MeshLod lod;
+        lod.firstIndex = static_cast<uint32_t>(chain.indices.size());
+        lod.indexCount = static_cast<uint32_t>(simplified.size());
+        lod.error = error;
+        chain.indices.insert(chain.indices.end(), simplified.begin(), simplified.end());
+        chain.lods.push_back(lod);
+        current = std::move(simplified);
+    }
+
+    return chain;
+}
+
+LodSelector::LodSelector(float thresholdPixels, float hysteresis) : _thresholdPixels(thresholdPixels), _hysteresis(hysteresis) {
+}
+
+uint32_t LodSelector::select(const MeshLodChain &chain, float distance, float projectionScale, uint32_t current) const {
+    // Error is measured at the nearest point of the bounding sphere
+    float nearest = std::max(distance - chain.radius, 1e-3f);
+    for (uint32_t level = static_cast<uint32_t>(chain.lods.size()) - 1; level > 0; level--) {
+        float pixels = chain.lods[level].error * projectionScale / nearest;
+        float limit = level > current ? _thresholdPixels * (1.0f - _hysteresis) : _thresholdPixels;
+        if (pixels <= limit) {
+            return level;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "Meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+
+static void computeBounds(const std::vector<glm::vec3> &positions, const MeshletMesh &mesh, Meshlet &meshlet) {
+    glm::vec3 minimum(INFINITY);
+    glm::vec3 maximum(-INFINITY);
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const glm::vec3 &position = positions[mesh.vertices[meshlet.vertexOffset + i]];
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    meshlet.center = (minimum + maximum) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        meshlet.radius = std::max(meshlet.radius, glm::length(positions[mesh.vertices[meshlet.vertexOffset + i]] - meshlet.center));
+    }
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 normalSum(0.0f);
+    for (uint32_t i = 0; i < meshlet.triangleCount; i++) {
+        uint32_t triangle = mesh.triangles[meshlet.triangleOffset + i];
+        const glm::vec3 &a = positions[mesh.vertices[meshlet.vertexOffset + (triangle & 0xFF)]];
+        const glm::vec3 &b = positions[mesh.vertices[meshlet.vertexOffset + ((triangle >> 8) & 0xFF)]];
+        const glm::vec3 &c = positions[mesh.vertices[meshlet.vertexOffset + ((triangle >> 16) & 0xFF)]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length > 0.0f) {
+            normals.push_back(normal / length);
+            normalSum += normal / length;
+        }
+    }
+
+    meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    if (normals.empty() || glm::length(normalSum) == 0.0f) {
+        return;
+    }
+    meshlet.coneAxis = glm::normalize(normalSum);
+
+    float minimumDot = 1.0f;
+    for (const glm::vec3 &normal : normals) {
+        minimumDot = std::min(minimumDot, glm::dot(meshlet.coneAxis, normal));
+    }
+    // Normals spread over more than ~84 degrees from the axis, the cone test would never cull
+    if (minimumDot <= 0.1f) {
+        return;
+    }
+    meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+}
+
+MeshletMesh buildMeshlets(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices) {
+    MeshletMesh mesh;
+    // Meshlet local index of every mesh vertex, -1 when not in the current meshlet
+    std::vector<int32_t> localIndex(positions.size(), -1);
+
+    Meshlet current{};
+    auto flush = [&]() {
+        if (current.triangleCount == 0) {
+            return;
+        }
+        for (uint32_t i = 0; i < current.vertexCount; i++) {
+            localIndex[mesh.vertices[current.vertexOffset + i]] = -1;
+        }
+        computeBounds(positions, mesh, current);
+        mesh.meshlets.push_back(current);
+
+        current = Meshlet{};
+        current.vertexOffset = static_cast<uint32_t>(mesh.vertices.size());
+        current.triangleOffset = static_cast<uint32_t>(mesh.triangles.size());
+    };
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t corners[3] = {indices[i], indices[i + 1], indices[i + 2]};
+
+        uint32_t newVertices = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            bool repeated = (k > 0 && corners[k] == corners[0]) || (k > 1 && corners[k] == corners[1]);
+            if (localIndex[corners[k]] < 0 && !repeated) {
+                newVertices++;
+            }
+        }
+        if (current.vertexCount + newVertices > MESHLET_MAX_VERTICES || current.triangleCount + 1 > MESHLET_MAX_TRIANGLES) {
+            flush();
+        }
+
+        uint32_t packed = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            if (localIndex[corners[k]] < 0) {
+                localIndex[corners[k]] = static_cast<int32_t>(current.vertexCount++);
+                mesh.vertices.push_back(corners[k]);
+            }
+            packed |= static_cast<uint32_t>(localIndex[corners[k]]) << (8 * k);
+        }
+        mesh.triangles.push_back(packed);
+        current.triangleCount++;
+    }
+    flush();
+
+    return mesh;
+}
+
+MeshletRange appendMeshlets(MeshletMesh &mesh, const MeshletMesh &other) {
+    MeshletRange range;
+    range.firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+    range.meshletCount = static_cast<uint32_t>(other.meshlets.size());
+
+    uint32_t vertexBase = static_cast<uint32_t>(mesh.vertices.size());
+    uint32_t triangleBase = static_cast<uint32_t>(mesh.triangles.size());
+    for (Meshlet meshlet : other.meshlets) {
+        meshlet.vertexOffset += vertexBase;
+        meshlet.triangleOffset += triangleBase;
+        mesh.meshlets.push_back(meshlet);
+    }
+    mesh.vertices.insert(mesh.vertices.end(), other.vertices.begin(), other.vertices.end());
+    mesh.triangles.insert(mesh.triangles.end(), other.triangles.begin(), other.triangles.end());
+    return range;
+}
@@ -0,0 +1,308 @@
+#include "MeshletCuller.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include "Bounds.h"
+#include "Logger.h"
+#include "utils.h"
+
+// Meshlets, vertices, triangles, indices, draw command and parameters, then the
+// visibility flags and the depth pyramid with occlusion
+#define MESHLET_BINDING_COUNT 6
+#define MESHLET_OCCLUSION_BINDING_COUNT 8
+
+// Phase bits, must match meshlet_cull_shader.glsl
+#define MESHLET_CULL_LAST_VISIBLE 1u
+#define MESHLET_CULL_OCCLUSION 2u
+
+// Object space frustum and eye, the full transform for the Hi-Z test and the
+// pyramid's level 0 size and mip count. std140, must match meshlet_cull_shader.glsl.
+struct CullParams {
+    glm::vec4 planes[6];
+    glm::vec4 cameraPosition;
+    glm::mat4 modelViewProjection;
+    glm::vec4 hizSize;
+};
+
+struct CullConstants {
+    uint32_t firstMeshlet;
+    uint32_t mode;
+};
+
+static void bufferBarrier(VkCommandBuffer commandBuffer, VkBuffer buffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void MeshletCuller::init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t framesInFlight, const MeshletMesh &mesh, bool occlusion) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _queue = queue;
+    _occlusion = occlusion;
+    _meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create meshlet upload command pool!");
+    }
+
+    _createPipeline();
+    _createStaticBuffer(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet), _meshletBuffer, _meshletBufferMemory);
+    _createStaticBuffer(mesh.vertices.data(), mesh.vertices.size() * sizeof(uint32_t), _vertexBuffer, _vertexBufferMemory);
+    _createStaticBuffer(mesh.triangles.data(), mesh.triangles.size() * sizeof(uint32_t), _triangleBuffer, _triangleBufferMemory);
+    if (_occlusion) {
+        // Everything counts as visible before the first frame, so the first prepass draws all of it
+        std::vector<uint32_t> visibility(std::max(_meshletCount, 1u), 1);
+        _createStaticBuffer(visibility.data(), visibility.size() * sizeof(uint32_t), _visibilityBuffer, _visibilityBufferMemory);
+    }
+
+    uint32_t passCount = framesInFlight * (_occlusion ? 2 : 1);
+    std::array<VkDescriptorPoolSize, 3> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = passCount * (_occlusion ? 6 : 5);
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount = passCount;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = passCount;
+
+    VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.poolSizeCount = _occlusion ? 3 : 2;
+    descriptorPoolInfo.pPoolSizes = poolSizes.data();
+    descriptorPoolInfo.maxSets = passCount;
+    if (vkCreateDescriptorPool(_device, &descriptorPoolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create meshlet descriptor pool!");
+    }
+
+    // Every triangle survives in the worst case
+    VkDeviceSize indexBufferSize = std::max<VkDeviceSize>(mesh.triangles.size() * 3 * sizeof(uint32_t), sizeof(uint32_t));
+    _frames.resize(framesInFlight);
+    for (FrameResources &frame : _frames) {
+        Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Uniform, sizeof(CullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.paramsBuffer, frame.paramsBufferMemory);
+        vkMapMemory(_device, frame.paramsBufferMemory, 0, sizeof(CullParams), 0, &frame.paramsMapped);
+
+        _createPass(frame, indexBufferSize, frame.main);
+        if (_occlusion) {
+            _createPass(frame, indexBufferSize, frame.prepass);
+        }
+    }
+
+    LOG_INFO("Meshlet culling over ", _meshletCount, " meshlets, ", mesh.triangles.size(), " triangles", (_occlusion ? " with occlusion" : ""));
+}
+
+void MeshletCuller::cleanup() {
+    for (FrameResources &frame : _frames) {
+        vkDestroyBuffer(_device, frame.paramsBuffer, nullptr);
+        Utils::freeMemory(_device, frame.paramsBufferMemory);
+        _destroyPass(frame.main);
+        _destroyPass(frame.prepass);
+    }
+    _frames.clear();
+
+    vkDestroyBuffer(_device, _meshletBuffer, nullptr);
+    Utils::freeMemory(_device, _meshletBufferMemory);
+    vkDestroyBuffer(_device, _vertexBuffer, nullptr);
+    Utils::freeMemory(_device, _vertexBufferMemory);
+    vkDestroyBuffer(_device, _triangleBuffer, nullptr);
+    Utils::freeMemory(_device, _triangleBufferMemory);
+    vkDestroyBuffer(_device, _visibilityBuffer, nullptr);
+    Utils::freeMemory(_device, _visibilityBufferMemory);
+
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
+    vkDestroyCommandPool(_device, _commandPool, nullptr);
+}
+
+void MeshletCuller::setHiZ(VkImageView view, VkSampler sampler, VkExtent2D size, uint32_t mipCount) {
+    _hizSize = size;
+    _hizMipCount = mipCount;
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = sampler;
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    // The prepass never samples the pyramid, but its set still needs a valid descriptor
+    std::vector<VkWriteDescriptorSet> writes;
+    for (const FrameResources &frame : _frames) {
+        for (VkDescriptorSet set : {frame.main.descriptorSet, frame.prepass.descriptorSet}) {
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = MESHLET_OCCLUSION_BINDING_COUNT - 1;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.descriptorCount = 1;
+            write.pImageInfo = &imageInfo;
+            writes.push_back(write);
+        }
+    }
+    vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void MeshletCuller::recordPrepass(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &proj, MeshletRange range) {
+    updateParams(frame, model, view, proj);
+
+    // Last frame's final pass wrote the visibility flags
+    bufferBarrier(commandBuffer, _visibilityBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    _dispatch(commandBuffer, _frames[frame].prepass, range, MESHLET_CULL_LAST_VISIBLE);
+}
+
+void MeshletCuller::record(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &proj, MeshletRange range) {
+    updateParams(frame, model, view, proj);
+
+    if (_occlusion) {
+        // The prepass read the flags this pass overwrites
+        bufferBarrier(commandBuffer, _visibilityBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+    }
+    _dispatch(commandBuffer, _frames[frame].main, range, _occlusion ? MESHLET_CULL_OCCLUSION : 0);
+}
+
+void MeshletCuller::updateParams(uint32_t frame, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &proj) {
+    // Frustum planes of the full transform are already in object space, so the
+    // shader never has to transform a bounding sphere
+    CullParams params{};
+    Frustum frustum = Frustum::fromMatrix(proj * view * model);
+    std::copy(std::begin(frustum.planes), std::end(frustum.planes), params.planes);
+    params.cameraPosition = glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    params.modelViewProjection = proj * view * model;
+    params.hizSize = glm::vec4(static_cast<float>(_hizSize.width), static_cast<float>(_hizSize.height), static_cast<float>(_hizMipCount), 0.0f);
+    memcpy(_frames[frame].paramsMapped, &params, sizeof(params));
+}
+
+void MeshletCuller::_dispatch(VkCommandBuffer commandBuffer, const PassResources &pass, MeshletRange range, uint32_t mode) {
+    VkDrawIndexedIndirectCommand draw{};
+    draw.indexCount = 0;
+    draw.instanceCount = 1;
+    vkCmdUpdateBuffer(commandBuffer, pass.drawBuffer, 0, sizeof(draw), &draw);
+    bufferBarrier(commandBuffer, pass.drawBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    CullConstants constants{range.firstMeshlet, mode};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &pass.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    // One workgroup per meshlet, one invocation per triangle
+    vkCmdDispatch(commandBuffer, range.meshletCount, 1, 1);
+
+    bufferBarrier(commandBuffer, pass.indexBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+    bufferBarrier(commandBuffer, pass.drawBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void MeshletCuller::_createPass(const FrameResources &frame, VkDeviceSize indexBufferSize, PassResources &pass) {
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Index, indexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pass.indexBuffer, pass.indexBufferMemory);
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Storage, sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pass.drawBuffer, pass.drawBufferMemory);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_descriptorSetLayout;
+    if (vkAllocateDescriptorSets(_device, &allocInfo, &pass.descriptorSet) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate meshlet descriptor set!");
+    }
+
+    // The pyramid binding is written by setHiZ
+    uint32_t bufferCount = _occlusion ? MESHLET_OCCLUSION_BINDING_COUNT - 1 : MESHLET_BINDING_COUNT;
+    std::array<VkBuffer, MESHLET_OCCLUSION_BINDING_COUNT - 1> buffers = {_meshletBuffer, _vertexBuffer, _triangleBuffer, pass.indexBuffer, pass.drawBuffer, frame.paramsBuffer, _visibilityBuffer};
+    std::array<VkDescriptorBufferInfo, MESHLET_OCCLUSION_BINDING_COUNT - 1> bufferInfos{};
+    std::array<VkWriteDescriptorSet, MESHLET_OCCLUSION_BINDING_COUNT - 1> writes{};
+    for (uint32_t i = 0; i < bufferCount; i++) {
+        bufferInfos[i].buffer = buffers[i];
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = pass.descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = i == MESHLET_BINDING_COUNT - 1 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(_device, bufferCount, writes.data(), 0, nullptr);
+}
+
+void MeshletCuller::_destroyPass(PassResources &pass) {
+    vkDestroyBuffer(_device, pass.indexBuffer, nullptr);
+    Utils::freeMemory(_device, pass.indexBufferMemory);
+    vkDestroyBuffer(_device, pass.drawBuffer, nullptr);
+    Utils::freeMemory(_device, pass.drawBufferMemory);
+}
+
+void MeshletCuller::_createPipeline() {
+    std::array<VkDescriptorSetLayoutBinding, MESHLET_OCCLUSION_BINDING_COUNT> bindings{};
+    for (uint32_t i = 0; i < MESHLET_OCCLUSION_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[MESHLET_BINDING_COUNT - 1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[MESHLET_OCCLUSION_BINDING_COUNT - 1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = _occlusion ? MESHLET_OCCLUSION_BINDING_COUNT : MESHLET_BINDING_COUNT;
+    layoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create meshlet descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create meshlet pipeline layout!");
+    }
+
+    VkShaderModule shaderModule = Utils::createShaderModule(_device, _occlusion ? "shaders/meshlet_cull_occlusion.spv" : "shaders/meshlet_cull.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = _pipelineLayout;
+
+    auto result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipeline);
+    vkDestroyShaderModule(_device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create meshlet cull pipeline!");
+    }
+}
+
+void MeshletCuller::_createStaticBuffer(const void *data, VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory) {
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Storage, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+    Utils::uploadBuffer(_physicalDevice, _device, _queue, _commandPool, buffer, 0, data, size);
+}
@@ -0,0 +1,353 @@
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "utils.h"
+
+// Must match MAX_MIPS in downsample_shader.glsl
+#define DOWNSAMPLE_MAX_MIPS 13
+#define DOWNSAMPLE_TILE_SIZE 64
+#define MAX_GENERATE_CALLS 16
+
+struct DownsampleParams {
+    uint32_t mipCount;
+    uint32_t workgroupCount;
+    uint32_t filterMode;
+    uint32_t srgb;
+};
+
+static void mipBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t baseMip, uint32_t mipCount, VkImageLayout oldLayout, VkImageLayout newLayout,
+                       VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = baseMip;
+    barrier.subresourceRange.levelCount = mipCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void MipGenerator::init(VkPhysicalDevice physicalDevice, VkDevice device, bool dynamicIndexing, bool extendedUsage) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _extendedUsage = extendedUsage;
+
+    // The downsampler indexes its mip array with a loop counter
+    _computeAvailable = dynamicIndexing;
+    if (!_computeAvailable) {
+        LOG_WARNING("Storage image dynamic indexing unsupported, mips are generated with blits");
+        return;
+    }
+
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[0].descriptorCount = DOWNSAMPLE_MAX_MIPS;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    auto result = vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_descriptorSetLayout);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downsample descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DownsampleParams);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    result = vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downsample pipeline layout!");
+    }
+
+    const char *shaderFiles[STORAGE_FORMAT_COUNT] = {"shaders/downsample_rgba8.spv", "shaders/downsample_rgba16f.spv", "shaders/downsample_r32f.spv"};
+    for (uint32_t i = 0; i < STORAGE_FORMAT_COUNT; i++) {
+        VkShaderModule shaderModule = Utils::createShaderModule(_device, shaderFiles[i]);
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = _pipelineLayout;
+
+        result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipelines[i]);
+        vkDestroyShaderModule(_device, shaderModule, nullptr);
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create downsample pipeline!");
+        }
+    }
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[0].descriptorCount = MAX_GENERATE_CALLS * DOWNSAMPLE_MAX_MIPS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = MAX_GENERATE_CALLS;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = MAX_GENERATE_CALLS;
+
+    result = vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create downsample descriptor pool!");
+    }
+
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Storage, sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _counterBuffer, _counterBufferMemory);
+
+    LOG_INFO("Created compute mip generator");
+}
+
+void MipGenerator::cleanup() {
+    releaseTransientResources();
+
+    if (!_computeAvailable) {
+        return;
+    }
+    vkDestroyBuffer(_device, _counterBuffer, nullptr);
+    Utils::freeMemory(_device, _counterBufferMemory);
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    for (auto pipeline : _pipelines) {
+        vkDestroyPipeline(_device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
+}
+
+void MipGenerator::prepareImageInfo(VkImageCreateInfo &imageInfo) const {
+    imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    VkFormat viewFormat;
+    bool srgb;
+    if (_storageFormat(imageInfo.format, viewFormat, srgb) != STORAGE_UNSUPPORTED) {
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+        if (srgb) {
+            // sRGB formats cannot be storage images, the shader writes through a UNORM view.
+            // Extended usage lets the image carry STORAGE although its own format lacks it.
+            imageInfo.flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+        }
+    }
+}
+
+VkImageUsageFlags MipGenerator::sampledViewUsage(const VkImageCreateInfo &imageInfo) const {
+    // Views of an extended usage image may only use what their own format supports
+    return (imageInfo.flags & VK_IMAGE_CREATE_EXTENDED_USAGE_BIT) ? VK_IMAGE_USAGE_SAMPLED_BIT : 0;
+}
+
+void MipGenerator::generate(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, MipFilter filter) {
+    if (mipLevels <= 1) {
+        mipBarrier(commandBuffer, image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        return;
+    }
+
+    VkFormat viewFormat;
+    bool srgb;
+    if (mipLevels <= DOWNSAMPLE_MAX_MIPS && _storageFormat(format, viewFormat, srgb) != STORAGE_UNSUPPORTED) {
+        _generateCompute(commandBuffer, image, format, width, height, mipLevels, filter);
+        return;
+    }
+
+    if (filter != MipFilter::Box) {
+        LOG_WARNING("Min/max mip filters need the compute path, falling back to a box filter");
+    }
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(_physicalDevice, format, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+        throw std::runtime_error("Texture format does not support linear blitting!");
+    }
+    _generateBlit(commandBuffer, image, width, height, mipLevels);
+}
+
+void MipGenerator::releaseTransientResources() {
+    for (auto view : _transientViews) {
+        vkDestroyImageView(_device, view, nullptr);
+    }
+    _transientViews.clear();
+
+    if (_descriptorPool != VK_NULL_HANDLE) {
+        vkResetDescriptorPool(_device, _descriptorPool, 0);
+    }
+}
+
+MipGenerator::StorageFormat MipGenerator::_storageFormat(VkFormat format, VkFormat &viewFormat, bool &srgb) const {
+    if (!_computeAvailable) {
+        return STORAGE_UNSUPPORTED;
+    }
+
+    StorageFormat storage;
+    viewFormat = format;
+    srgb = false;
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            storage = STORAGE_RGBA8;
+            break;
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            if (!_extendedUsage) {
+                return STORAGE_UNSUPPORTED;
+            }
+            storage = STORAGE_RGBA8;
+            viewFormat = VK_FORMAT_R8G8B8A8_UNORM;
+            srgb = true;
+            break;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            storage = STORAGE_RGBA16F;
+            break;
+        case VK_FORMAT_R32_SFLOAT:
+            storage = STORAGE_R32F;
+            break;
+        default:
+            return STORAGE_UNSUPPORTED;
+    }
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(_physicalDevice, viewFormat, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+        return STORAGE_UNSUPPORTED;
+    }
+    return storage;
+}
+
+void MipGenerator::_generateCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, MipFilter filter) {
+    VkFormat viewFormat;
+    bool srgb;
+    StorageFormat storage = _storageFormat(format, viewFormat, srgb);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_descriptorSetLayout;
+
+    VkDescriptorSet descriptorSet;
+    auto result = vkAllocateDescriptorSets(_device, &allocInfo, &descriptorSet);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Out of downsample descriptor sets, release transient resources more often");
+    }
+
+    // Unused array slots still need a valid descriptor, they repeat the smallest level
+    std::array<VkDescriptorImageInfo, DOWNSAMPLE_MAX_MIPS> imageInfos{};
+    for (uint32_t level = 0; level < DOWNSAMPLE_MAX_MIPS; level++) {
+        if (level < mipLevels) {
+            _transientViews.push_back(Utils::createImageView(_device, image, viewFormat, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+        }
+        imageInfos[level].imageView = _transientViews.back();
+        imageInfos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    VkDescriptorBufferInfo counterInfo{};
+    counterInfo.buffer = _counterBuffer;
+    counterInfo.offset = 0;
+    counterInfo.range = sizeof(uint32_t);
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = descriptorSet;
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[0].descriptorCount = DOWNSAMPLE_MAX_MIPS;
+    descriptorWrites[0].pImageInfo = imageInfos.data();
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = descriptorSet;
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &counterInfo;
+    vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    // The workgroup counter is shared between calls, wait for any earlier dispatch before clearing it
+    VkBufferMemoryBarrier counterBarrier{};
+    counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    counterBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    counterBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.buffer = _counterBuffer;
+    counterBarrier.offset = 0;
+    counterBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &counterBarrier, 0, nullptr);
+    vkCmdFillBuffer(commandBuffer, _counterBuffer, 0, sizeof(uint32_t), 0);
+
+    counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &counterBarrier, 0, nullptr);
+
+    mipBarrier(commandBuffer, image, 0, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    uint32_t groupsX = (width + DOWNSAMPLE_TILE_SIZE - 1) / DOWNSAMPLE_TILE_SIZE;
+    uint32_t groupsY = (height + DOWNSAMPLE_TILE_SIZE - 1) / DOWNSAMPLE_TILE_SIZE;
+
+    DownsampleParams params{};
+    params.mipCount = mipLevels - 1;
+    params.workgroupCount = groupsX * groupsY;
+    params.filterMode = static_cast<uint32_t>(filter);
+    params.srgb = srgb ? 1 : 0;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelines[storage]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+    mipBarrier(commandBuffer, image, 0, mipLevels, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void MipGenerator::_generateBlit(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels) {
+    int32_t mipWidth = static_cast<int32_t>(width);
+    int32_t mipHeight = static_cast<int32_t>(height);
+
+    for (uint32_t level = 1; level < mipLevels; level++) {
+        mipBarrier(commandBuffer, image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+        VkImageBlit blit{};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {std::max(mipWidth / 2, 1), std::max(mipHeight / 2, 1), 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        mipBarrier(commandBuffer, image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        mipWidth = std::max(mipWidth / 2, 1);
+        mipHeight = std::max(mipHeight / 2, 1);
+    }
+
+    mipBarrier(commandBuffer, image, mipLevels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+               VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
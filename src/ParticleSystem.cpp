@@ -0,0 +1,608 @@
+#include "ParticleSystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "Logger.h"
+#include "Profiler.h"
+#include "utils.h"
+
+#define PARTICLE_GROUP_SIZE 256
+// Elements one sort workgroup orders in shared memory, must match particle_sort_shader.glsl
+#define PARTICLE_SORT_BLOCK 1024
+// Seconds, the middle of the lifetime range in particle_simulate_shader.glsl.
+// Emission keeps the pool full when particles live this long on average.
+#define PARTICLE_MEAN_LIFETIME 2.0f
+#define PARTICLE_SIZE 0.01f
+
+// Must match particle_simulate_shader.glsl
+#define PARTICLE_PASS_SIMULATE 0u
+#define PARTICLE_PASS_EMIT_PREPARE 1u
+#define PARTICLE_PASS_EMIT 2u
+#define PARTICLE_PASS_FINALIZE 3u
+
+// Positions, velocities, alive list and arguments of the set read, the same of
+// the set written plus its sort pairs, then the free list and the counters
+#define PARTICLE_SIMULATE_BINDING_COUNT 11
+// Positions, velocities and sort pairs of the set drawn
+#define PARTICLE_DRAW_BINDING_COUNT 3
+
+// Per set, written by the finalize pass. Must match particle_simulate_shader.glsl.
+struct ParticleArgs {
+    uint32_t aliveCount;
+    VkDispatchIndirectCommand simulate;
+    VkDrawIndirectCommand draw;
+};
+
+// Shared by both sets, only touched by the steps
+struct ParticleCounters {
+    uint32_t deadCount;
+    uint32_t emitCount;
+};
+
+struct SimulateConstants {
+    glm::vec4 cameraPosition;
+    glm::vec4 cameraForward;
+    float deltaTime;
+    float time;
+    uint32_t emitCount;
+    uint32_t pass;
+};
+
+struct SortConstants {
+    uint32_t k;
+    uint32_t j;
+};
+
+struct DrawConstants {
+    glm::mat4 viewProjection;
+    // Camera right with the particle size in w, and camera up
+    glm::vec4 right;
+    glm::vec4 up;
+};
+
+static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+static void computeBarrier(VkCommandBuffer commandBuffer) {
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+static VkDescriptorSetLayout createStorageLayout(VkDevice device, uint32_t bindingCount, VkShaderStageFlags stages) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = stages;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle descriptor set layout!");
+    }
+    return layout;
+}
+
+static VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout setLayout, VkShaderStageFlags stages, uint32_t constantsSize) {
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = stages;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = constantsSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle pipeline layout!");
+    }
+    return layout;
+}
+
+static VkSemaphore createTimeline(VkDevice device) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    VkSemaphore semaphore;
+    if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle timeline semaphore!");
+    }
+    return semaphore;
+}
+
+void ParticleSystem::init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamily, VkQueue computeQueue, uint32_t computeFamily,
+                          uint32_t framesInFlight, uint32_t capacity, VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _graphicsQueue = graphicsQueue;
+    _computeQueue = computeQueue;
+    _capacity = std::max(capacity, 1u);
+    _sortSize = PARTICLE_SORT_BLOCK;
+    while (_sortSize < _capacity) {
+        _sortSize *= 2;
+    }
+    _queueFamilies = {graphicsFamily};
+    if (isAsync() && computeFamily != graphicsFamily) {
+        _queueFamilies.push_back(computeFamily);
+    }
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = graphicsFamily;
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_uploadPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle upload command pool!");
+    }
+
+    if (isAsync()) {
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = computeFamily;
+        if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_computePool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create particle compute command pool!");
+        }
+
+        _computeCommandBuffers.resize(framesInFlight);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = _computePool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = framesInFlight;
+        if (vkAllocateCommandBuffers(_device, &allocInfo, _computeCommandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate particle compute command buffers!");
+        }
+
+        _computeTimeline = createTimeline(_device);
+        _graphicsTimeline = createTimeline(_device);
+    }
+
+    _createBuffers();
+    _createDescriptors();
+    _createComputePipelines();
+    _createDrawPipeline(renderPass, samples);
+
+    LOG_INFO("Particles: ", _capacity, " at most, simulated ", isAsync() ? "on the async compute queue" : "on the graphics queue");
+}
+
+void ParticleSystem::cleanup() {
+    for (ParticleSet &set : _sets) {
+        vkDestroyBuffer(_device, set.positions, nullptr);
+        Utils::freeMemory(_device, set.positionsMemory);
+        vkDestroyBuffer(_device, set.velocities, nullptr);
+        Utils::freeMemory(_device, set.velocitiesMemory);
+        vkDestroyBuffer(_device, set.alive, nullptr);
+        Utils::freeMemory(_device, set.aliveMemory);
+        vkDestroyBuffer(_device, set.sorted, nullptr);
+        Utils::freeMemory(_device, set.sortedMemory);
+        vkDestroyBuffer(_device, set.args, nullptr);
+        Utils::freeMemory(_device, set.argsMemory);
+    }
+    vkDestroyBuffer(_device, _dead, nullptr);
+    Utils::freeMemory(_device, _deadMemory);
+    vkDestroyBuffer(_device, _counters, nullptr);
+    Utils::freeMemory(_device, _countersMemory);
+
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    vkDestroyPipeline(_device, _simulatePipeline, nullptr);
+    vkDestroyPipeline(_device, _sortPipeline, nullptr);
+    vkDestroyPipeline(_device, _drawPipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _simulateLayout, nullptr);
+    vkDestroyPipelineLayout(_device, _sortLayout, nullptr);
+    vkDestroyPipelineLayout(_device, _drawLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _simulateSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _sortSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _drawSetLayout, nullptr);
+
+    vkDestroySemaphore(_device, _computeTimeline, nullptr);
+    vkDestroySemaphore(_device, _graphicsTimeline, nullptr);
+    vkDestroyCommandPool(_device, _computePool, nullptr);
+    vkDestroyCommandPool(_device, _uploadPool, nullptr);
+}
+
+void ParticleSystem::beginFrame(float deltaTime, const glm::mat4 &view) {
+    _step++;
+    _deltaTime = deltaTime;
+    _time += deltaTime;
+
+    // Emit at the rate that replaces the particles dying on average, the free list caps it
+    float emit = _capacity / PARTICLE_MEAN_LIFETIME * deltaTime + _emitRemainder;
+    _emitCount = std::min(static_cast<uint32_t>(emit), _capacity);
+    _emitRemainder = emit - std::floor(emit);
+
+    glm::mat4 cameraToWorld = glm::inverse(view);
+    _cameraPosition = glm::vec3(cameraToWorld[3]);
+    _cameraForward = -glm::normalize(glm::vec3(cameraToWorld[2]));
+}
+
+void ParticleSystem::submit() {
+    PROFILE_FUNCTION();
+    VkCommandBuffer commandBuffer = _computeCommandBuffers[_step % _computeCommandBuffers.size()];
+
+    // The command buffer was last submitted by the step framesInFlight steps ago
+    if (_step > _computeCommandBuffers.size()) {
+        uint64_t value = _step - _computeCommandBuffers.size();
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &_computeTimeline;
+        waitInfo.pValues = &value;
+        vkWaitSemaphores(_device, &waitInfo, UINT64_MAX);
+    }
+
+    vkResetCommandBuffer(commandBuffer, 0);
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin particle command buffer");
+    }
+    _recordStep(commandBuffer);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record particle command buffer");
+    }
+
+    // Frame n - 1 draws the set this step overwrites
+    uint64_t waitValue = _step - 1;
+    uint64_t signalValue = _step;
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &_graphicsTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &_computeTimeline;
+    if (vkQueueSubmit(_computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit particle step");
+    }
+}
+
+void ParticleSystem::record(VkCommandBuffer commandBuffer) {
+    PROFILE_FUNCTION();
+    _recordStep(commandBuffer);
+
+    // The draw later in the same command buffer reads the sorted set and the indirect arguments
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+}
+
+void ParticleSystem::draw(VkCommandBuffer commandBuffer, const glm::mat4 &view, const glm::mat4 &proj) {
+    // The async step of this frame may still be running, the previous one is done
+    const ParticleSet &set = _sets[(isAsync() ? _step - 1 : _step) % 2];
+
+    DrawConstants constants{};
+    constants.viewProjection = proj * view;
+    constants.right = glm::vec4(view[0][0], view[1][0], view[2][0], PARTICLE_SIZE);
+    constants.up = glm::vec4(view[0][1], view[1][1], view[2][1], 0.0f);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _drawPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _drawLayout, 0, 1, &set.drawSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _drawLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+    vkCmdDrawIndirect(commandBuffer, set.args, offsetof(ParticleArgs, draw), 1, sizeof(VkDrawIndirectCommand));
+}
+
+void ParticleSystem::_recordStep(VkCommandBuffer commandBuffer) {
+    const ParticleSet &output = _sets[_step % 2];
+    const ParticleSet &input = _sets[(_step - 1) % 2];
+
+    // The previous step wrote the input set and this step's dispatch size. On a
+    // single queue the frame before last also drew the set this step overwrites.
+    VkPipelineStageFlags previousStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    if (!isAsync()) {
+        previousStages |= VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    }
+    memoryBarrier(commandBuffer, previousStages, VK_ACCESS_SHADER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    vkCmdFillBuffer(commandBuffer, output.args, offsetof(ParticleArgs, aliveCount), sizeof(uint32_t), 0);
+    memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    SimulateConstants constants{};
+    constants.cameraPosition = glm::vec4(_cameraPosition, 1.0f);
+    constants.cameraForward = glm::vec4(_cameraForward, 0.0f);
+    constants.deltaTime = _deltaTime;
+    constants.time = _time;
+    constants.emitCount = _emitCount;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _simulatePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _simulateLayout, 0, 1, &output.simulateSet, 0, nullptr);
+
+    // Survivors are compacted into the output alive list, the dead go back to the free list
+    constants.pass = PARTICLE_PASS_SIMULATE;
+    vkCmdPushConstants(commandBuffer, _simulateLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatchIndirect(commandBuffer, input.args, offsetof(ParticleArgs, simulate));
+    computeBarrier(commandBuffer);
+
+    if (_emitCount > 0) {
+        // One invocation clamps the emission to the free list, then the new particles are appended
+        constants.pass = PARTICLE_PASS_EMIT_PREPARE;
+        vkCmdPushConstants(commandBuffer, _simulateLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+        computeBarrier(commandBuffer);
+
+        constants.pass = PARTICLE_PASS_EMIT;
+        vkCmdPushConstants(commandBuffer, _simulateLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (_emitCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE, 1, 1);
+        computeBarrier(commandBuffer);
+    }
+
+    // Writes the draw, the next step's dispatch and a sort key for every slot of the sort
+    constants.pass = PARTICLE_PASS_FINALIZE;
+    vkCmdPushConstants(commandBuffer, _simulateLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, _sortSize / PARTICLE_GROUP_SIZE, 1, 1);
+    computeBarrier(commandBuffer);
+
+    // Bitonic sort, every block is sorted in shared memory first. Each merge then takes one
+    // pass per distance of at least a block and finishes the shorter distances in shared memory.
+    uint32_t groupCount = _sortSize / PARTICLE_SORT_BLOCK;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _sortPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _sortLayout, 0, 1, &output.sortSet, 0, nullptr);
+    SortConstants sort{0, 0};
+    vkCmdPushConstants(commandBuffer, _sortLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sort), &sort);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    computeBarrier(commandBuffer);
+    for (uint32_t k = PARTICLE_SORT_BLOCK * 2; k <= _sortSize; k *= 2) {
+        for (uint32_t j = k / 2; j >= PARTICLE_SORT_BLOCK; j /= 2) {
+            sort = {k, j};
+            vkCmdPushConstants(commandBuffer, _sortLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sort), &sort);
+            vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+            computeBarrier(commandBuffer);
+        }
+        sort = {k, 0};
+        vkCmdPushConstants(commandBuffer, _sortLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sort), &sort);
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+        computeBarrier(commandBuffer);
+    }
+}
+
+void ParticleSystem::_createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory) {
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Storage, size, usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory, 0, 0, _queueFamilies);
+}
+
+void ParticleSystem::_createBuffers() {
+    for (ParticleSet &set : _sets) {
+        _createBuffer(_capacity * sizeof(glm::vec4), 0, set.positions, set.positionsMemory);
+        _createBuffer(_capacity * sizeof(glm::vec4), 0, set.velocities, set.velocitiesMemory);
+        _createBuffer(_capacity * sizeof(uint32_t), 0, set.alive, set.aliveMemory);
+        _createBuffer(_sortSize * sizeof(uint32_t) * 2, 0, set.sorted, set.sortedMemory);
+        _createBuffer(sizeof(ParticleArgs), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, set.args, set.argsMemory);
+
+        // Nothing alive and nothing to draw before the first step
+        ParticleArgs args{};
+        args.simulate = {0, 1, 1};
+        args.draw = {6, 0, 0, 0};
+        Utils::uploadBuffer(_physicalDevice, _device, _graphicsQueue, _uploadPool, set.args, 0, &args, sizeof(args));
+    }
+
+    // Every particle starts out free
+    _createBuffer(_capacity * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT, _dead, _deadMemory);
+    std::vector<uint32_t> dead(_capacity);
+    std::iota(dead.begin(), dead.end(), 0u);
+    Utils::uploadBuffer(_physicalDevice, _device, _graphicsQueue, _uploadPool, _dead, 0, dead.data(), dead.size() * sizeof(uint32_t));
+
+    _createBuffer(sizeof(ParticleCounters), VK_BUFFER_USAGE_TRANSFER_DST_BIT, _counters, _countersMemory);
+    ParticleCounters counters{_capacity, 0};
+    Utils::uploadBuffer(_physicalDevice, _device, _graphicsQueue, _uploadPool, _counters, 0, &counters, sizeof(counters));
+}
+
+void ParticleSystem::_createDescriptors() {
+    _simulateSetLayout = createStorageLayout(_device, PARTICLE_SIMULATE_BINDING_COUNT, VK_SHADER_STAGE_COMPUTE_BIT);
+    _sortSetLayout = createStorageLayout(_device, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+    _drawSetLayout = createStorageLayout(_device, PARTICLE_DRAW_BINDING_COUNT, VK_SHADER_STAGE_VERTEX_BIT);
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(_sets.size()) * (PARTICLE_SIMULATE_BINDING_COUNT + 1 + PARTICLE_DRAW_BINDING_COUNT);
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = static_cast<uint32_t>(_sets.size()) * 3;
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle descriptor pool!");
+    }
+
+    for (size_t i = 0; i < _sets.size(); i++) {
+        ParticleSet &set = _sets[i];
+        const ParticleSet &input = _sets[(i + 1) % _sets.size()];
+
+        std::array<VkDescriptorSetLayout, 3> layouts = {_simulateSetLayout, _sortSetLayout, _drawSetLayout};
+        std::array<VkDescriptorSet, 3> descriptorSets{};
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = _descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(_device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate particle descriptor sets!");
+        }
+        set.simulateSet = descriptorSets[0];
+        set.sortSet = descriptorSets[1];
+        set.drawSet = descriptorSets[2];
+
+        // Binding order must match the shaders
+        std::vector<std::pair<VkDescriptorSet, std::vector<VkBuffer>>> contents = {
+            {set.simulateSet, {input.positions, input.velocities, input.alive, input.args, set.positions, set.velocities, set.alive, set.args, set.sorted, _dead, _counters}},
+            {set.sortSet, {set.sorted}},
+            {set.drawSet, {set.positions, set.velocities, set.sorted}},
+        };
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+        bufferInfos.reserve(PARTICLE_SIMULATE_BINDING_COUNT + 1 + PARTICLE_DRAW_BINDING_COUNT);
+        std::vector<VkWriteDescriptorSet> writes;
+        for (const auto &[descriptorSet, buffers] : contents) {
+            for (uint32_t binding = 0; binding < buffers.size(); binding++) {
+                bufferInfos.push_back({buffers[binding], 0, VK_WHOLE_SIZE});
+
+                VkWriteDescriptorSet write{};
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet = descriptorSet;
+                write.dstBinding = binding;
+                write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write.descriptorCount = 1;
+                write.pBufferInfo = &bufferInfos.back();
+                writes.push_back(write);
+            }
+        }
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+VkPipeline ParticleSystem::_createComputePipeline(const char *filename, VkPipelineLayout layout) {
+    VkShaderModule shaderModule = Utils::createShaderModule(_device, filename);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    auto result = vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(_device, shaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(std::string("Failed to create particle pipeline from ") + filename);
+    }
+    return pipeline;
+}
+
+void ParticleSystem::_createComputePipelines() {
+    _simulateLayout = createPipelineLayout(_device, _simulateSetLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(SimulateConstants));
+    _sortLayout = createPipelineLayout(_device, _sortSetLayout, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(SortConstants));
+    _simulatePipeline = _createComputePipeline("shaders/particle_simulate.spv", _simulateLayout);
+    _sortPipeline = _createComputePipeline("shaders/particle_sort.spv", _sortLayout);
+}
+
+void ParticleSystem::_createDrawPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+    _drawLayout = createPipelineLayout(_device, _drawSetLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(DrawConstants));
+
+    VkShaderModule vertShaderModule = Utils::createShaderModule(_device, "shaders/particle_vert.spv");
+    VkShaderModule fragShaderModule = Utils::createShaderModule(_device, "shaders/particle_frag.spv");
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
+
+    // Quads are expanded from the vertex index, nothing comes from vertex buffers
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = samples;
+    multisampling.minSampleShading = 1.0f;
+
+    // Tested against the scene but never written, the sort orders the particles among themselves
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = 2;
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineInfo.layout = _drawLayout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+
+    auto result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_drawPipeline);
+    vkDestroyShaderModule(_device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create particle draw pipeline!");
+    }
+}
@@ -0,0 +1,96 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include "Logger.h"
+#include "utils.h"
+
+Profiler::Profiler() : _startTicks(ticks()), _startNanoseconds(nanoseconds()) {}
+
+void Profiler::setThreadName(const std::string &name) {
+    Track &track = threadTrack();
+    std::lock_guard<std::mutex> lock(_mutex);
+    track.name = name;
+}
+
+Profiler::Track *Profiler::createTrack(const std::string &name) {
+    return _addTrack(name, true);
+}
+
+bool Profiler::exportChromeTrace(const std::string &filename) {
+    uint64_t endTicks = ticks();
+    uint64_t endNanoseconds = nanoseconds();
+    double nanosecondsPerTick = endTicks > _startTicks ? static_cast<double>(endNanoseconds - _startNanoseconds) / static_cast<double>(endTicks - _startTicks) : 1.0;
+
+    std::ofstream file(filename);
+    if (!file) {
+        LOG_WARNING("Cannot write trace to ", filename);
+        return false;
+    }
+
+    // Microseconds since the profiler started
+    auto toMicroseconds = [&](const Track &track, uint64_t time) {
+        double nanoseconds = track.steadyClock ? static_cast<double>(time) - static_cast<double>(_startNanoseconds)
+                                               : (static_cast<double>(time) - static_cast<double>(_startTicks)) * nanosecondsPerTick;
+        return nanoseconds / 1000.0;
+    };
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    file << "{\"traceEvents\":[\n";
+    file << std::fixed << std::setprecision(3);
+    bool first = true;
+    size_t eventCount = 0;
+    for (const auto &track : _tracks) {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track->id
+             << ",\"args\":{\"name\":\"" << Utils::escapeJson(track->name) << "\"}}";
+        first = false;
+
+        // Events older than one ring behind the head may be overwritten while we copy them
+        uint64_t head = track->head.load(std::memory_order_acquire);
+        uint64_t begin = head > PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE : 0;
+        std::vector<std::pair<const char *, std::pair<uint64_t, uint64_t>>> events;
+        for (uint64_t i = begin; i < head; i++) {
+            const Event &event = track->events[i & (PROFILER_RING_SIZE - 1)];
+            events.push_back({event.name.load(std::memory_order_relaxed), {event.begin.load(std::memory_order_relaxed), event.end.load(std::memory_order_relaxed)}});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t newHead = track->head.load(std::memory_order_relaxed);
+        uint64_t firstValid = newHead >= PROFILER_RING_SIZE ? newHead - PROFILER_RING_SIZE + 1 : 0;
+
+        for (uint64_t i = std::max(begin, firstValid); i < head; i++) {
+            const auto &[name, times] = events[i - begin];
+            if (name == nullptr) {
+                continue;
+            }
+            double start = toMicroseconds(*track, times.first);
+            double duration = std::max(0.0, toMicroseconds(*track, times.second) - start);
+            file << ",\n{\"name\":\"" << Utils::escapeJson(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track->id
+                 << ",\"ts\":" << start << ",\"dur\":" << duration << "}";
+            eventCount++;
+        }
+    }
+    file << "\n]}\n";
+
+    LOG_INFO("Wrote ", eventCount, " trace events from ", _tracks.size(), " tracks to ", filename);
+    return true;
+}
+
+Profiler::Track *Profiler::_createThreadTrack() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto track = std::make_unique<Track>();
+    track->id = static_cast<uint32_t>(_tracks.size()) + 1;
+    track->name = "thread " + std::to_string(track->id);
+    track->events = std::make_unique<Event[]>(PROFILER_RING_SIZE);
+    _tracks.push_back(std::move(track));
+    return _tracks.back().get();
+}
+
+Profiler::Track *Profiler::_addTrack(const std::string &name, bool steadyClock) {
+    Track *track = _createThreadTrack();
+    std::lock_guard<std::mutex> lock(_mutex);
+    track->name = name;
+    track->steadyClock = steadyClock;
+    return track;
+}
@@ -0,0 +1,487 @@
+#include "SceneBvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "JobSystem.h"
+
+#define BVH_BINS 16
+#define BVH_LEAF_BIT 0x80000000u
+#define BVH_EMPTY_SLOT 0xFFFFFFFFu
+#define BVH_NO_PARENT 0xFFFFFFFFu
+#define FRUSTUM_ALL_PLANES 0x3Fu
+// Below this the top-level split costs more than the traversal itself
+#define BVH_PARALLEL_MIN_OBJECTS 4096
+#define BVH_TASKS_PER_THREAD 4
+// Refit scans every node instead of sorting once more than 1 in this many are dirty
+#define BVH_REFIT_SCAN_RATIO 16
+
+uint32_t SceneBvh::add(const Aabb &bounds) {
+    _bounds.push_back(bounds);
+    _needsBuild = true;
+    return static_cast<uint32_t>(_bounds.size() - 1);
+}
+
+void SceneBvh::setBounds(uint32_t object, const Aabb &bounds) {
+    _bounds[object] = bounds;
+    if (_needsBuild) {
+        return;
+    }
+
+    uint32_t node = _objectNode[object];
+    _setSlot(_nodes[node], _objectSlot[object], bounds);
+    // Every ancestor's slot for its child has to grow or shrink with it
+    while (node != BVH_NO_PARENT && !_nodeDirty[node]) {
+        _nodeDirty[node] = true;
+        _dirtyNodes.push_back(node);
+        node = _nodes[node].parent;
+    }
+}
+
+void SceneBvh::update() {
+    if (_needsBuild) {
+        build();
+    } else {
+        _refit();
+    }
+}
+
+void SceneBvh::build() {
+    _nodes.clear();
+    _dirtyNodes.clear();
+    _needsBuild = false;
+
+    uint32_t count = static_cast<uint32_t>(_bounds.size());
+    _order.resize(count);
+    std::iota(_order.begin(), _order.end(), 0);
+    _objectNode.assign(count, 0);
+    _objectSlot.assign(count, 0);
+    if (count > 0) {
+        std::vector<BuildNode> nodes;
+        _collapse(nodes, _buildBinary(nodes));
+    }
+    _nodeDirty.assign(_nodes.size(), false);
+}
+
+void SceneBvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible, JobSystem *jobSystem) {
+    if (_nodes.empty()) {
+        return;
+    }
+
+    CullTask root{0, FRUSTUM_ALL_PLANES};
+    if (jobSystem == nullptr || _bounds.size() < BVH_PARALLEL_MIN_OBJECTS) {
+        _cullNode(frustum, root, visible, nullptr);
+        return;
+    }
+
+    // Expand the top of the tree on this thread until there are enough
+    // partially visible subtrees to keep every worker busy
+    uint32_t target = jobSystem->getThreadCount() * BVH_TASKS_PER_THREAD;
+    _frontier.assign(1, root);
+    size_t next = 0;
+    while (next < _frontier.size() && _frontier.size() - next < target) {
+        CullTask task = _frontier[next++];
+        _cullNode(frustum, task, visible, &_frontier);
+    }
+
+    uint32_t taskCount = static_cast<uint32_t>(_frontier.size() - next);
+    if (_taskResults.size() < taskCount) {
+        _taskResults.resize(taskCount);
+    }
+    jobSystem->parallelFor("bvh cull", taskCount, 1, [this, &frustum, next](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+            _taskResults[i].clear();
+            _cullNode(frustum, _frontier[next + i], _taskResults[i], nullptr);
+        }
+    });
+
+    for (uint32_t i = 0; i < taskCount; i++) {
+        visible.insert(visible.end(), _taskResults[i].begin(), _taskResults[i].end());
+    }
+}
+
+RayHit SceneBvh::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, const std::function<float(uint32_t object)> &intersect) const {
+    RayHit hit;
+    hit.distance = maxDistance;
+    if (_nodes.empty()) {
+        return hit;
+    }
+
+    glm::vec3 inverse = 1.0f / direction;
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const Node &node = _nodes[stack.back()];
+        stack.pop_back();
+
+        // Slab test per child, inner children are pushed far to near so the nearest is visited first
+        uint32_t children[BVH_WIDTH];
+        float entries[BVH_WIDTH];
+        uint32_t childCount = 0;
+        for (uint32_t slot = 0; slot < BVH_WIDTH; slot++) {
+            uint32_t child = node.child[slot];
+            if (child == BVH_EMPTY_SLOT) {
+                continue;
+            }
+
+            glm::vec3 t0 = (glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]) - origin) * inverse;
+            glm::vec3 t1 = (glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]) - origin) * inverse;
+            glm::vec3 near = glm::min(t0, t1);
+            glm::vec3 far = glm::max(t0, t1);
+            float entry = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+            float exit = std::min(std::min(far.x, far.y), far.z);
+            if (exit < entry || entry >= hit.distance) {
+                continue;
+            }
+
+            if (child & BVH_LEAF_BIT) {
+                uint32_t object = _order[child & ~BVH_LEAF_BIT];
+                float distance = intersect ? intersect(object) : entry;
+                if (distance >= 0.0f && distance < hit.distance) {
+                    hit.object = object;
+                    hit.distance = distance;
+                }
+                continue;
+            }
+
+            uint32_t position = childCount++;
+            while (position > 0 && entries[position - 1] < entry) {
+                children[position] = children[position - 1];
+                entries[position] = entries[position - 1];
+                position--;
+            }
+            children[position] = child;
+            entries[position] = entry;
+        }
+        stack.insert(stack.end(), children, children + childCount);
+    }
+    return hit;
+}
+
+uint32_t SceneBvh::_buildBinary(std::vector<BuildNode> &nodes) {
+    uint32_t count = static_cast<uint32_t>(_bounds.size());
+    std::vector<glm::vec3> centroids(count);
+    Aabb rootBounds = _bounds[0];
+    for (uint32_t i = 0; i < count; i++) {
+        centroids[i] = _bounds[i].center();
+        rootBounds.expand(_bounds[i]);
+    }
+
+    nodes.reserve(2 * count);
+    nodes.push_back({rootBounds, 0, count, 0, 0});
+
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        BuildNode node = nodes[index];
+        if (node.count <= 1) {
+            continue;
+        }
+
+        uint32_t *begin = _order.data() + node.first;
+        uint32_t *end = begin + node.count;
+        Aabb centroidBounds{centroids[*begin], centroids[*begin]};
+        for (uint32_t *object = begin; object != end; object++) {
+            centroidBounds.min = glm::min(centroidBounds.min, centroids[*object]);
+            centroidBounds.max = glm::max(centroidBounds.max, centroids[*object]);
+        }
+        glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        uint32_t *middle = begin;
+        if (extent[axis] > 0.0f) {
+            // Bin the centroids and take the cheapest of the BVH_BINS - 1 splits between bins
+            float minimum = centroidBounds.min[axis];
+            float scale = BVH_BINS / extent[axis];
+            auto binOf = [&](uint32_t object) {
+                return std::min(BVH_BINS - 1, static_cast<int>((centroids[object][axis] - minimum) * scale));
+            };
+
+            Aabb binBounds[BVH_BINS];
+            uint32_t binCounts[BVH_BINS] = {};
+            for (Aabb &bounds : binBounds) {
+                bounds.min = glm::vec3(FLT_MAX);
+                bounds.max = glm::vec3(-FLT_MAX);
+            }
+            for (uint32_t *object = begin; object != end; object++) {
+                int bin = binOf(*object);
+                binBounds[bin].expand(_bounds[*object]);
+                binCounts[bin]++;
+            }
+
+            float rightCost[BVH_BINS];
+            Aabb accumulated = binBounds[BVH_BINS - 1];
+            uint32_t accumulatedCount = binCounts[BVH_BINS - 1];
+            for (int bin = BVH_BINS - 2; bin >= 0; bin--) {
+                rightCost[bin] = accumulated.surfaceArea() * accumulatedCount;
+                accumulated.expand(binBounds[bin]);
+                accumulatedCount += binCounts[bin];
+            }
+
+            int bestSplit = 0;
+            float bestCost = FLT_MAX;
+            accumulated = binBounds[0];
+            accumulatedCount = binCounts[0];
+            for (int bin = 0; bin < BVH_BINS - 1; bin++) {
+                float cost = accumulated.surfaceArea() * accumulatedCount + rightCost[bin];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestSplit = bin;
+                }
+                accumulated.expand(binBounds[bin + 1]);
+                accumulatedCount += binCounts[bin + 1];
+            }
+
+            middle = std::partition(begin, end, [&](uint32_t object) { return binOf(object) <= bestSplit; });
+        }
+        if (middle == begin || middle == end) {
+            // Centroids too close together to bin, split at the median instead
+            middle = begin + node.count / 2;
+            std::nth_element(begin, middle, end, [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+        BuildNode children[2] = {{_bounds[*begin], node.first, leftCount, 0, 0},
+                                 {_bounds[*middle], node.first + leftCount, node.count - leftCount, 0, 0}};
+        for (BuildNode &child : children) {
+            for (uint32_t i = child.first; i < child.first + child.count; i++) {
+                child.bounds.expand(_bounds[_order[i]]);
+            }
+        }
+
+        nodes[index].left = static_cast<uint32_t>(nodes.size());
+        nodes[index].right = nodes[index].left + 1;
+        stack.push_back(nodes[index].left);
+        stack.push_back(nodes[index].right);
+        nodes.push_back(children[0]);
+        nodes.push_back(children[1]);
+    }
+    return 0;
+}
+
+void SceneBvh::_collapse(const std::vector<BuildNode> &nodes, uint32_t root) {
+    struct Pending {
+        uint32_t binary;
+        uint32_t wide;
+    };
+
+    _nodes.reserve(nodes.size() / 2 + 1);
+    _nodes.emplace_back();
+    _nodes[0].parent = BVH_NO_PARENT;
+    _nodes[0].parentSlot = 0;
+
+    std::vector<Pending> stack{{root, 0}};
+    while (!stack.empty()) {
+        Pending pending = stack.back();
+        stack.pop_back();
+        const BuildNode &binary = nodes[pending.binary];
+
+        // Pull up grandchildren, largest first, until the node is full
+        uint32_t children[BVH_WIDTH];
+        uint32_t childCount = 0;
+        if (binary.count == 1) {
+            children[childCount++] = pending.binary;
+        } else {
+            children[childCount++] = binary.left;
+            children[childCount++] = binary.right;
+        }
+        while (childCount < BVH_WIDTH) {
+            int largest = -1;
+            float largestArea = -1.0f;
+            for (uint32_t i = 0; i < childCount; i++) {
+                const BuildNode &child = nodes[children[i]];
+                if (child.count > 1 && child.bounds.surfaceArea() > largestArea) {
+                    largest = static_cast<int>(i);
+                    largestArea = child.bounds.surfaceArea();
+                }
+            }
+            if (largest < 0) {
+                break;
+            }
+            const BuildNode &expanded = nodes[children[largest]];
+            children[largest] = expanded.left;
+            children[childCount++] = expanded.right;
+        }
+
+        uint32_t wide = pending.wide;
+        _nodes[wide].first = binary.first;
+        _nodes[wide].count = binary.count;
+        Aabb empty{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        for (uint32_t slot = 0; slot < BVH_WIDTH; slot++) {
+            // Inverted bounds fail every plane test, so empty slots need no special case
+            _setSlot(_nodes[wide], slot, empty);
+            _nodes[wide].child[slot] = BVH_EMPTY_SLOT;
+        }
+
+        for (uint32_t slot = 0; slot < childCount; slot++) {
+            const BuildNode &child = nodes[children[slot]];
+            _setSlot(_nodes[wide], slot, child.bounds);
+            if (child.count == 1) {
+                _nodes[wide].child[slot] = BVH_LEAF_BIT | child.first;
+                _objectNode[_order[child.first]] = wide;
+                _objectSlot[_order[child.first]] = static_cast<uint8_t>(slot);
+            } else {
+                uint32_t childNode = static_cast<uint32_t>(_nodes.size());
+                _nodes.emplace_back();
+                _nodes[childNode].parent = wide;
+                _nodes[childNode].parentSlot = slot;
+                _nodes[wide].child[slot] = childNode;
+                stack.push_back({children[slot], childNode});
+            }
+        }
+    }
+}
+
+void SceneBvh::_setSlot(Node &node, uint32_t slot, const Aabb &bounds) {
+    node.minX[slot] = bounds.min.x;
+    node.minY[slot] = bounds.min.y;
+    node.minZ[slot] = bounds.min.z;
+    node.maxX[slot] = bounds.max.x;
+    node.maxY[slot] = bounds.max.y;
+    node.maxZ[slot] = bounds.max.z;
+}
+
+Aabb SceneBvh::_nodeBounds(const Node &node) const {
+    Aabb bounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+    for (uint32_t slot = 0; slot < BVH_WIDTH; slot++) {
+        if (node.child[slot] != BVH_EMPTY_SLOT) {
+            bounds.expand({glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]), glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot])});
+        }
+    }
+    return bounds;
+}
+
+void SceneBvh::_refit() {
+    // Children always come after their parent, so walking back to front
+    // finishes every child before its parent reads it. Past a point scanning
+    // every flag is cheaper than sorting the dirty list.
+    auto refitNode = [this](uint32_t index) {
+        _nodeDirty[index] = false;
+        const Node &node = _nodes[index];
+        if (node.parent != BVH_NO_PARENT) {
+            _setSlot(_nodes[node.parent], node.parentSlot, _nodeBounds(node));
+        }
+    };
+
+    if (_dirtyNodes.size() * BVH_REFIT_SCAN_RATIO > _nodes.size()) {
+        for (uint32_t index = static_cast<uint32_t>(_nodes.size()); index-- > 0;) {
+            if (_nodeDirty[index]) {
+                refitNode(index);
+            }
+        }
+    } else {
+        std::sort(_dirtyNodes.begin(), _dirtyNodes.end(), std::greater<uint32_t>());
+        for (uint32_t index : _dirtyNodes) {
+            refitNode(index);
+        }
+    }
+    _dirtyNodes.clear();
+}
+
+uint32_t SceneBvh::_testChildren(const Node &node, const Frustum &frustum, uint32_t planeMask, uint32_t *insideMasks) const {
+    const uint32_t allSlots = (1u << BVH_WIDTH) - 1;
+    uint32_t visible = allSlots;
+
+    for (uint32_t p = 0; p < 6; p++) {
+        insideMasks[p] = allSlots;
+        if (!(planeMask & (1u << p))) {
+            continue;
+        }
+
+        // The corner furthest along the normal decides if a box is outside,
+        // the nearest one if it is entirely inside
+        const glm::vec4 &plane = frustum.planes[p];
+        const float *farX = plane.x >= 0.0f ? node.maxX : node.minX;
+        const float *farY = plane.y >= 0.0f ? node.maxY : node.minY;
+        const float *farZ = plane.z >= 0.0f ? node.maxZ : node.minZ;
+        const float *nearX = plane.x >= 0.0f ? node.minX : node.maxX;
+        const float *nearY = plane.y >= 0.0f ? node.minY : node.maxY;
+        const float *nearZ = plane.z >= 0.0f ? node.minZ : node.maxZ;
+
+        uint32_t outside = 0;
+        uint32_t inside = 0;
+#if defined(__AVX2__)
+        __m256 a = _mm256_set1_ps(plane.x);
+        __m256 b = _mm256_set1_ps(plane.y);
+        __m256 c = _mm256_set1_ps(plane.z);
+        __m256 d = _mm256_set1_ps(plane.w);
+        __m256 zero = _mm256_setzero_ps();
+        __m256 farDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(farX), a), _mm256_mul_ps(_mm256_loadu_ps(farY), b)),
+                                           _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(farZ), c), d));
+        __m256 nearDistance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(nearX), a), _mm256_mul_ps(_mm256_loadu_ps(nearY), b)),
+                                            _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(nearZ), c), d));
+        outside = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(farDistance, zero, _CMP_LT_OQ)));
+        inside = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(nearDistance, zero, _CMP_GE_OQ)));
+#elif defined(BVH_SSE)
+        __m128 a = _mm_set1_ps(plane.x);
+        __m128 b = _mm_set1_ps(plane.y);
+        __m128 c = _mm_set1_ps(plane.z);
+        __m128 d = _mm_set1_ps(plane.w);
+        __m128 zero = _mm_setzero_ps();
+        __m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(farX), a), _mm_mul_ps(_mm_loadu_ps(farY), b)),
+                                        _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(farZ), c), d));
+        __m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(nearX), a), _mm_mul_ps(_mm_loadu_ps(nearY), b)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(nearZ), c), d));
+        outside = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(farDistance, zero)));
+        inside = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(nearDistance, zero)));
+#else
+        for (uint32_t slot = 0; slot < BVH_WIDTH; slot++) {
+            float farDistance = farX[slot] * plane.x + farY[slot] * plane.y + farZ[slot] * plane.z + plane.w;
+            float nearDistance = nearX[slot] * plane.x + nearY[slot] * plane.y + nearZ[slot] * plane.z + plane.w;
+            outside |= static_cast<uint32_t>(farDistance < 0.0f) << slot;
+            inside |= static_cast<uint32_t>(nearDistance >= 0.0f) << slot;
+        }
+#endif
+        visible &= ~outside;
+        insideMasks[p] = inside;
+    }
+    return visible;
+}
+
+void SceneBvh::_cullNode(const Frustum &frustum, CullTask task, std::vector<uint32_t> &visible, std::vector<CullTask> *deferred) const {
+    std::vector<CullTask> stack{task};
+    while (!stack.empty()) {
+        CullTask current = stack.back();
+        stack.pop_back();
+        const Node &node = _nodes[current.node];
+
+        uint32_t insideMasks[6];
+        uint32_t visibleSlots = _testChildren(node, frustum, current.planeMask, insideMasks);
+        for (uint32_t slot = 0; slot < BVH_WIDTH; slot++) {
+            if (!(visibleSlots & (1u << slot))) {
+                continue;
+            }
+
+            // Planes the child is entirely inside of are skipped further down
+            uint32_t childMask = 0;
+            for (uint32_t p = 0; p < 6; p++) {
+                if ((current.planeMask & (1u << p)) && !(insideMasks[p] & (1u << slot))) {
+                    childMask |= 1u << p;
+                }
+            }
+
+            uint32_t child = node.child[slot];
+            if (child & BVH_LEAF_BIT) {
+                visible.push_back(_order[child & ~BVH_LEAF_BIT]);
+            } else if (childMask == 0) {
+                _emitRange(_nodes[child].first, _nodes[child].count, visible);
+            } else if (deferred != nullptr) {
+                deferred->push_back({child, childMask});
+            } else {
+                stack.push_back({child, childMask});
+            }
+        }
+    }
+}
+
+void SceneBvh::_emitRange(uint32_t first, uint32_t count, std::vector<uint32_t> &visible) const {
+    visible.insert(visible.end(), _order.begin() + first, _order.begin() + first + count);
+}
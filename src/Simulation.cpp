@@ -0,0 +1,79 @@
+#include "Simulation.h"
+
+#include <algorithm>
+
+#include "Logger.h"
+#include "utils.h"
+
+// After a long stall (debugger, suspended machine) skip ahead instead of replaying every missed tick
+#define SIMULATION_MAX_CATCHUP_TICKS 5
+
+void Simulation::start(uint32_t tickRate) {
+    _tickInterval = std::chrono::nanoseconds(1000000000ull / std::max(1u, tickRate));
+
+    // The renderer can sample before the first tick lands
+    _state = SceneState();
+    _publish(_state, std::chrono::steady_clock::now());
+
+    _running = true;
+    _thread = std::thread(&Simulation::_threadLoop, this);
+
+    LOG_INFO("Simulation running at ", tickRate, " ticks per second");
+}
+
+void Simulation::stop() {
+    if (!_running) {
+        return;
+    }
+    _running = false;
+    _thread.join();
+}
+
+SceneState Simulation::sample(std::chrono::steady_clock::time_point time) {
+    _snapshots.update();
+    const SimulationSnapshot &snapshot = _snapshots.read();
+
+    float alpha = std::chrono::duration<float>(time - snapshot.tickTime).count() / std::chrono::duration<float>(_tickInterval).count();
+    alpha = std::clamp(alpha, 0.0f, 1.0f);
+
+    SceneState state;
+    state.rotation = glm::mix(snapshot.previous.rotation, snapshot.current.rotation, alpha);
+    state.cameraPosition = glm::mix(snapshot.previous.cameraPosition, snapshot.current.cameraPosition, alpha);
+    state.cameraTarget = glm::mix(snapshot.previous.cameraTarget, snapshot.current.cameraTarget, alpha);
+    return state;
+}
+
+void Simulation::_threadLoop() {
+    float deltaTime = std::chrono::duration<float>(_tickInterval).count();
+    auto nextTick = std::chrono::steady_clock::now();
+
+    while (_running) {
+        nextTick += _tickInterval;
+        std::this_thread::sleep_until(nextTick);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - nextTick > _tickInterval * SIMULATION_MAX_CATCHUP_TICKS) {
+            nextTick = now;
+        }
+        if (_paused.load(std::memory_order_relaxed)) {
+            continue;
+        }
+
+        SceneState previous = _state;
+        _step(_state, deltaTime);
+        _publish(previous, nextTick);
+    }
+}
+
+void Simulation::_step(SceneState &state, float deltaTime) {
+    state.rotation += deltaTime * glm::radians(90.0f);
+}
+
+void Simulation::_publish(const SceneState &previous, std::chrono::steady_clock::time_point tickTime) {
+    SimulationSnapshot &snapshot = _snapshots.writeBuffer();
+    snapshot.previous = previous;
+    snapshot.current = _state;
+    snapshot.tick = _tickCount.fetch_add(1, std::memory_order_relaxed);
+    snapshot.tickTime = tickTime;
+    _snapshots.publish();
+}
@@ -0,0 +1,438 @@
+#include "SpriteBatcher.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include <glm/gtc/packing.hpp>
+
+#include "Logger.h"
+#include "Profiler.h"
+#include "utils.h"
+
+// Distinct textures one frame can draw with, further ones fall back to the white texture
+#define SPRITE_MAX_TEXTURES 64
+
+// Maps pixels to clip space, must match sprite_vertex_shader.glsl
+struct SpriteConstants {
+    glm::vec2 scale;
+    glm::vec2 offset;
+};
+
+uint32_t SpriteVertex::packTexCoord(const glm::vec2 &texCoord) {
+    return glm::packUnorm2x16(texCoord);
+}
+
+uint32_t SpriteVertex::packColor(const glm::vec4 &color) {
+    return glm::packUnorm4x8(color);
+}
+
+void SpriteBatcher::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, uint32_t maxQuads, VkRenderPass renderPass, VkSampleCountFlagBits samples,
+                         VkSampler sampler, VkImageView whiteTexture) {
+    _device = device;
+    _sampler = sampler;
+    _whiteTexture = whiteTexture;
+    _maxQuads = maxQuads;
+    _vertexCapacity = maxQuads * 4;
+    _indexCapacity = maxQuads * 6;
+    _frames.resize(framesInFlight);
+
+    // Written once by the CPU and read once by the GPU, so plain host memory is used rather
+    // than competing for the small device local window of GPUs without resizable BAR
+    VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(_vertexCapacity) * sizeof(SpriteVertex) * framesInFlight;
+    VkDeviceSize indexBytes = static_cast<VkDeviceSize>(_indexCapacity) * sizeof(uint32_t) * framesInFlight;
+    Utils::createBuffer(physicalDevice, device, MemoryCategory::Vertex, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _vertexBuffer, _vertexMemory);
+    Utils::createBuffer(physicalDevice, device, MemoryCategory::Index, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _indexBuffer, _indexMemory);
+    vkMapMemory(_device, _vertexMemory, 0, vertexBytes, 0, reinterpret_cast<void **>(&_vertices));
+    vkMapMemory(_device, _indexMemory, 0, indexBytes, 0, reinterpret_cast<void **>(&_indices));
+
+    _createDescriptors();
+    _createPipelines(renderPass, samples);
+
+    LOG_INFO("Sprite batcher streams up to ", maxQuads, " quads per frame through ", (vertexBytes + indexBytes) >> 20, " MiB of mapped memory");
+}
+
+void SpriteBatcher::cleanup() {
+    for (VkPipeline pipeline : _pipelines) {
+        vkDestroyPipeline(_device, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    for (Frame &frame : _frames) {
+        vkDestroyDescriptorPool(_device, frame.descriptorPool, nullptr);
+    }
+    vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+
+    vkUnmapMemory(_device, _vertexMemory);
+    vkUnmapMemory(_device, _indexMemory);
+    vkDestroyBuffer(_device, _vertexBuffer, nullptr);
+    Utils::freeMemory(_device, _vertexMemory);
+    vkDestroyBuffer(_device, _indexBuffer, nullptr);
+    Utils::freeMemory(_device, _indexMemory);
+}
+
+void SpriteBatcher::beginFrame(uint32_t frame) {
+    _frame = frame;
+    Frame &current = _frames[frame];
+    vkResetDescriptorPool(_device, current.descriptorPool, 0);
+    current.textureSets.clear();
+    current.batches.clear();
+    current.vertexCount = 0;
+    current.indexCount = 0;
+
+    // Allocated first, so it is left to fall back on when the pool runs out
+    _getTextureSet(_whiteTexture);
+}
+
+SpriteVertex *SpriteBatcher::reserveQuads(VkImageView texture, uint32_t count) {
+    if (count == 0 || count > _maxQuads) {
+        return nullptr;
+    }
+    uint32_t *indices;
+    uint32_t baseVertex;
+    SpriteVertex *vertices = _reserve(TOPOLOGY_TRIANGLES, texture, count * 4, count * 6, indices, baseVertex);
+    if (vertices == nullptr) {
+        return nullptr;
+    }
+
+    for (uint32_t quad = 0; quad < count; quad++) {
+        uint32_t first = baseVertex + quad * 4;
+        indices[0] = first;
+        indices[1] = first + 1;
+        indices[2] = first + 2;
+        indices[3] = first + 2;
+        indices[4] = first + 3;
+        indices[5] = first;
+        indices += 6;
+    }
+    return vertices;
+}
+
+void SpriteBatcher::drawSprite(VkImageView texture, const glm::vec2 &center, const glm::vec2 &size, float rotation, const glm::vec4 &uvRect, uint32_t color) {
+    SpriteVertex *vertices = reserveQuads(texture, 1);
+    if (vertices == nullptr) {
+        return;
+    }
+
+    glm::vec2 right = glm::vec2(std::cos(rotation), std::sin(rotation)) * (size.x * 0.5f);
+    glm::vec2 down = glm::vec2(-std::sin(rotation), std::cos(rotation)) * (size.y * 0.5f);
+    vertices[0] = {center - right - down, SpriteVertex::packTexCoord({uvRect.x, uvRect.y}), color};
+    vertices[1] = {center + right - down, SpriteVertex::packTexCoord({uvRect.z, uvRect.y}), color};
+    vertices[2] = {center + right + down, SpriteVertex::packTexCoord({uvRect.z, uvRect.w}), color};
+    vertices[3] = {center - right + down, SpriteVertex::packTexCoord({uvRect.x, uvRect.w}), color};
+}
+
+void SpriteBatcher::fillRect(const glm::vec2 &min, const glm::vec2 &max, uint32_t color) {
+    drawSprite(_whiteTexture, (min + max) * 0.5f, max - min, 0.0f, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), color);
+}
+
+void SpriteBatcher::drawLine(const glm::vec2 &from, const glm::vec2 &to, uint32_t color) {
+    uint32_t *indices;
+    uint32_t baseVertex;
+    SpriteVertex *vertices = _reserve(TOPOLOGY_LINES, _whiteTexture, 2, 2, indices, baseVertex);
+    if (vertices == nullptr) {
+        return;
+    }
+    vertices[0] = {from, 0, color};
+    vertices[1] = {to, 0, color};
+    indices[0] = baseVertex;
+    indices[1] = baseVertex + 1;
+}
+
+void SpriteBatcher::drawRect(const glm::vec2 &min, const glm::vec2 &max, uint32_t color) {
+    uint32_t *indices;
+    uint32_t baseVertex;
+    SpriteVertex *vertices = _reserve(TOPOLOGY_LINES, _whiteTexture, 4, 8, indices, baseVertex);
+    if (vertices == nullptr) {
+        return;
+    }
+    vertices[0] = {min, 0, color};
+    vertices[1] = {{max.x, min.y}, 0, color};
+    vertices[2] = {max, 0, color};
+    vertices[3] = {{min.x, max.y}, 0, color};
+    for (uint32_t i = 0; i < 4; i++) {
+        indices[2 * i] = baseVertex + i;
+        indices[2 * i + 1] = baseVertex + (i + 1) % 4;
+    }
+}
+
+void SpriteBatcher::drawCircle(const glm::vec2 &center, float radius, uint32_t color, uint32_t segments) {
+    segments = std::max(segments, 3u);
+    uint32_t *indices;
+    uint32_t baseVertex;
+    SpriteVertex *vertices = _reserve(TOPOLOGY_LINES, _whiteTexture, segments, segments * 2, indices, baseVertex);
+    if (vertices == nullptr) {
+        return;
+    }
+    for (uint32_t i = 0; i < segments; i++) {
+        float angle = 6.2831853f * i / segments;
+        vertices[i] = {center + glm::vec2(std::cos(angle), std::sin(angle)) * radius, 0, color};
+        indices[2 * i] = baseVertex + i;
+        indices[2 * i + 1] = baseVertex + (i + 1) % segments;
+    }
+}
+
+void SpriteBatcher::record(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+    PROFILE_FUNCTION();
+    const Frame &frame = _frames[_frame];
+    if (frame.batches.empty()) {
+        return;
+    }
+
+    VkDeviceSize vertexOffset = static_cast<VkDeviceSize>(_frame) * _vertexCapacity * sizeof(SpriteVertex);
+    VkDeviceSize indexOffset = static_cast<VkDeviceSize>(_frame) * _indexCapacity * sizeof(uint32_t);
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &_vertexBuffer, &vertexOffset);
+    vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, indexOffset, VK_INDEX_TYPE_UINT32);
+
+    // Pixels with the origin in the top left corner, Vulkan's clip space already points y down
+    SpriteConstants constants{glm::vec2(2.0f / extent.width, 2.0f / extent.height), glm::vec2(-1.0f)};
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+    Topology boundTopology = TOPOLOGY_COUNT;
+    VkDescriptorSet boundSet = VK_NULL_HANDLE;
+    for (const Batch &batch : frame.batches) {
+        if (batch.topology != boundTopology) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelines[batch.topology]);
+            boundTopology = batch.topology;
+        }
+        if (batch.textureSet != boundSet) {
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &batch.textureSet, 0, nullptr);
+            boundSet = batch.textureSet;
+        }
+        vkCmdDrawIndexed(commandBuffer, batch.indexCount, 1, batch.firstIndex, 0, 0);
+    }
+}
+
+SpriteVertex *SpriteBatcher::_reserve(Topology topology, VkImageView texture, uint32_t vertexCount, uint32_t indexCount, uint32_t *&indices, uint32_t &baseVertex) {
+    Frame &frame = _frames[_frame];
+    if (vertexCount > _vertexCapacity - frame.vertexCount || indexCount > _indexCapacity - frame.indexCount) {
+        if (!_warnedFull) {
+            LOG_WARNING("Sprite batcher is out of room for this frame's geometry, ", _maxQuads, " quads fit, dropping the rest");
+            _warnedFull = true;
+        }
+        return nullptr;
+    }
+
+    VkDescriptorSet textureSet = _getTextureSet(texture);
+    if (frame.batches.empty() || frame.batches.back().topology != topology || frame.batches.back().textureSet != textureSet) {
+        frame.batches.push_back({topology, textureSet, frame.indexCount, 0});
+    }
+    frame.batches.back().indexCount += indexCount;
+
+    baseVertex = frame.vertexCount;
+    indices = _indices + static_cast<size_t>(_frame) * _indexCapacity + frame.indexCount;
+    SpriteVertex *vertices = _vertices + static_cast<size_t>(_frame) * _vertexCapacity + frame.vertexCount;
+    frame.vertexCount += vertexCount;
+    frame.indexCount += indexCount;
+    return vertices;
+}
+
+// Image views change as textures stream in and out, so sets are written per frame
+// and released together when the frame's pool is reset
+VkDescriptorSet SpriteBatcher::_getTextureSet(VkImageView texture) {
+    Frame &frame = _frames[_frame];
+    for (const auto &[view, set] : frame.textureSets) {
+        if (view == texture) {
+            return set;
+        }
+    }
+    if (frame.textureSets.size() == SPRITE_MAX_TEXTURES) {
+        if (!_warnedTextures) {
+            LOG_WARNING("More than ", SPRITE_MAX_TEXTURES, " sprite textures in one frame, drawing the rest untextured");
+            _warnedTextures = true;
+        }
+        return frame.textureSets.front().second;
+    }
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = frame.descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_setLayout;
+
+    VkDescriptorSet set;
+    if (vkAllocateDescriptorSets(_device, &allocInfo, &set) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate sprite descriptor set!");
+    }
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = _sampler;
+    imageInfo.imageView = texture;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.descriptorCount = 1;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(_device, 1, &write, 0, nullptr);
+
+    frame.textureSets.emplace_back(texture, set);
+    return set;
+}
+
+void SpriteBatcher::_createDescriptors() {
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &binding;
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create sprite descriptor set layout!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = SPRITE_MAX_TEXTURES;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = SPRITE_MAX_TEXTURES;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    for (Frame &frame : _frames) {
+        if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &frame.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create sprite descriptor pool!");
+        }
+    }
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(SpriteConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &_setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create sprite pipeline layout!");
+    }
+}
+
+void SpriteBatcher::_createPipelines(VkRenderPass renderPass, VkSampleCountFlagBits samples) {
+    VkShaderModule vertShaderModule = Utils::createShaderModule(_device, "shaders/sprite_vert.spv");
+    VkShaderModule fragShaderModule = Utils::createShaderModule(_device, "shaders/sprite_frag.spv");
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
+
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(SpriteVertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[0].offset = offsetof(SpriteVertex, position);
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R16G16_UNORM;
+    attributeDescriptions[1].offset = offsetof(SpriteVertex, texCoord);
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescriptions[2].offset = offsetof(SpriteVertex, color);
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = samples;
+    multisampling.minSampleShading = 1.0f;
+
+    // Drawn over the scene in submission order
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_FALSE;
+    depthStencil.depthWriteEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo{};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = 2;
+    dynamicStateCreateInfo.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    pipelineInfo.pStages = shaderStages.data();
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineInfo.layout = _pipelineLayout;
+    pipelineInfo.renderPass = renderPass;
+    pipelineInfo.subpass = 0;
+
+    // Only the topology differs between the two
+    VkResult result = VK_SUCCESS;
+    const VkPrimitiveTopology topologies[TOPOLOGY_COUNT] = {VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_PRIMITIVE_TOPOLOGY_LINE_LIST};
+    for (uint32_t i = 0; i < TOPOLOGY_COUNT && result == VK_SUCCESS; i++) {
+        inputAssembly.topology = topologies[i];
+        result = vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_pipelines[i]);
+    }
+    vkDestroyShaderModule(_device, fragShaderModule, nullptr);
+    vkDestroyShaderModule(_device, vertShaderModule, nullptr);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create sprite pipelines!");
+    }
+}
@@ -0,0 +1,62 @@
+#include "StartupProfiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "Logger.h"
+#include "utils.h"
+
+static double milliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void StartupProfiler::begin() {
+    _start = std::chrono::steady_clock::now();
+    _mainThread = std::this_thread::get_id();
+    _finished = false;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _records.clear();
+}
+
+void StartupProfiler::markFirstFrame() {
+    if (_finished) {
+        return;
+    }
+    _firstFrame = std::chrono::steady_clock::now();
+    _finished = true;
+    report();
+}
+
+double StartupProfiler::getTimeToFirstFrame() const {
+    return _finished ? milliseconds(_firstFrame - _start) : 0.0;
+}
+
+void StartupProfiler::report() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<Record> records = _records;
+    std::sort(records.begin(), records.end(), [](const Record &a, const Record &b) { return a.start < b.start; });
+
+    double stepTotal = 0.0;
+    std::ostringstream table;
+    table << "Startup timings (start offset, duration):";
+    for (const Record &record : records) {
+        double duration = milliseconds(record.end - record.start);
+        stepTotal += duration;
+        table << "\n    " << std::left << std::setw(28) << record.name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(9) << milliseconds(record.start - _start) << " ms "
+              << std::setw(9) << duration << " ms"
+              << (record.mainThread ? "" : "  (async)");
+    }
+    table << "\n    " << std::left << std::setw(28) << "sum of steps" << std::right << std::setw(22) << stepTotal << " ms";
+    LOG_INFO(table.str());
+    if (_finished) {
+        LOG_INFO("Time to first frame: ", milliseconds(_firstFrame - _start), " ms");
+    }
+}
+
+void StartupProfiler::_record(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _records.push_back({name, start, end, std::this_thread::get_id() == _mainThread});
+}
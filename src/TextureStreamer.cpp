@@ -0,0 +1,617 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "Logger.h"
+#include "Profiler.h"
+#include "utils.h"
+
+// Mips at or below this size form the tail that is never evicted
+#define TEXTURE_TAIL_SIZE 128
+#define TEXTURE_IO_THREADS 2
+#define MAX_CONCURRENT_LOADS 4
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout,
+                         VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void TextureStreamer::init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, MipGenerator *mipGenerator, uint32_t framesInFlight, VkDeviceSize budget) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _queue = queue;
+    _mipGenerator = mipGenerator;
+    _framesInFlight = framesInFlight;
+    _budget = budget;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = queueFamily;
+
+    auto result = vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture upload command pool!");
+    }
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerInfo.unnormalizedCoordinates = VK_FALSE;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    result = vkCreateSampler(_device, &samplerInfo, nullptr, &_sampler);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture sampler!");
+    }
+
+    _createPlaceholder();
+    _ioPool = std::make_unique<ThreadPool>(TEXTURE_IO_THREADS);
+
+    LOG_INFO("Texture streamer created with a budget of ", (_budget >> 20), " MiB");
+}
+
+void TextureStreamer::cleanup() {
+    // Joins the I/O threads, results that are still queued are simply dropped
+    _ioPool.reset();
+    vkQueueWaitIdle(_queue);
+
+    for (auto &upload : _uploads) {
+        _destroyImage(upload.image);
+        vkDestroyBuffer(_device, upload.stagingBuffer, nullptr);
+        Utils::freeMemory(_device, upload.stagingMemory);
+        vkDestroyFence(_device, upload.fence, nullptr);
+    }
+    _uploads.clear();
+
+    for (auto &pending : _pendingDeletes) {
+        _destroyImage(pending.image);
+    }
+    _pendingDeletes.clear();
+
+    for (auto &texture : _textures) {
+        _destroyImage(texture.resident);
+    }
+    _textures.clear();
+
+    _destroyImage(_placeholder);
+    vkDestroySampler(_device, _sampler, nullptr);
+    vkDestroyCommandPool(_device, _commandPool, nullptr);
+}
+
+uint32_t TextureStreamer::load(const std::string &filename) {
+    Texture texture;
+    texture.ktx = Ktx2File::open(filename);
+
+    texture.tailLevel = texture.ktx.levelCount - 1;
+    for (uint32_t level = 0; level < texture.ktx.levelCount; level++) {
+        VkExtent2D extent = texture.ktx.levelExtent(level);
+        if (std::max(extent.width, extent.height) <= TEXTURE_TAIL_SIZE) {
+            texture.tailLevel = level;
+            break;
+        }
+    }
+    texture.requestedLevel = texture.tailLevel;
+    texture.lastUsedFrame = _frame;
+
+    uint32_t index = static_cast<uint32_t>(_textures.size());
+    _textures.push_back(std::move(texture));
+    _queueLoad(index, _textures[index].tailLevel, _textures[index].ktx.levelCount - 1);
+
+    LOG_INFO("Streaming texture ", filename, " (", _textures[index].ktx.levelCount, " mips)");
+    return index;
+}
+
+uint32_t TextureStreamer::create(uint32_t width, uint32_t height, VkFormat format, const void *pixels, VkDeviceSize size, MipFilter filter) {
+    PROFILE_FUNCTION();
+    uint32_t mipLevels = 1;
+    while ((std::max(width, height) >> mipLevels) > 0) {
+        mipLevels++;
+    }
+
+    Texture texture;
+    texture.streamed = false;
+    texture.busy = true;
+    texture.lastUsedFrame = _frame;
+    uint32_t index = static_cast<uint32_t>(_textures.size());
+    _textures.push_back(std::move(texture));
+
+    Upload upload;
+    upload.texture = index;
+    upload.generatedMips = true;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {width, height, 1};
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    _mipGenerator->prepareImageInfo(imageInfo);
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Texture, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, upload.image.image, upload.image.memory);
+    upload.image.view = Utils::createImageView(_device, upload.image.image, format, VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, _mipGenerator->sampledViewUsage(imageInfo));
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(_device, upload.image.image, &memRequirements);
+    upload.image.size = memRequirements.size;
+    _residentBytes += upload.image.size;
+
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Staging, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, upload.stagingBuffer, upload.stagingMemory);
+    void *data;
+    vkMapMemory(_device, upload.stagingMemory, 0, size, 0, &data);
+    memcpy(data, pixels, (size_t)size);
+    vkUnmapMemory(_device, upload.stagingMemory);
+
+    _beginUpload(upload);
+
+    imageBarrier(upload.commandBuffer, upload.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {width, height, 1};
+    vkCmdCopyBufferToImage(upload.commandBuffer, upload.stagingBuffer, upload.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    _mipGenerator->generate(upload.commandBuffer, upload.image.image, format, width, height, mipLevels, filter);
+    _mipUploadsInFlight++;
+
+    _submitUpload(upload);
+    return index;
+}
+
+void TextureStreamer::request(uint32_t texture, uint32_t mip, float priority) {
+    if (texture == INVALID_TEXTURE) {
+        return;
+    }
+    Texture &tex = _textures[texture];
+    tex.requestedLevel = std::min(mip, tex.tailLevel);
+    tex.priority = priority;
+    tex.lastUsedFrame = _frame;
+}
+
+void TextureStreamer::update() {
+    PROFILE_FUNCTION();
+    _frame++;
+    _retireUploads();
+    _releaseDeleted();
+    _collectLoads();
+    _schedule();
+}
+
+VkImageView TextureStreamer::getImageView(uint32_t texture) const {
+    if (texture == INVALID_TEXTURE || _textures[texture].resident.view == VK_NULL_HANDLE) {
+        return _placeholder.view;
+    }
+    return _textures[texture].resident.view;
+}
+
+void TextureStreamer::_createPlaceholder() {
+    const uint32_t white = 0xFFFFFFFF;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = {1, 1, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Texture, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _placeholder.image, _placeholder.memory);
+    _placeholder.view = Utils::createImageView(_device, _placeholder.image, imageInfo.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Staging, sizeof(white), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void *data;
+    vkMapMemory(_device, stagingBufferMemory, 0, sizeof(white), 0, &data);
+    memcpy(data, &white, sizeof(white));
+    vkUnmapMemory(_device, stagingBufferMemory);
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    vkAllocateCommandBuffers(_device, &allocInfo, &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+    imageBarrier(commandBuffer, _placeholder.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {1, 1, 1};
+    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, _placeholder.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+    imageBarrier(commandBuffer, _placeholder.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    vkEndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    auto result = vkQueueSubmit(_queue, 1, &submitInfo, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit placeholder texture upload");
+    }
+    vkQueueWaitIdle(_queue);
+
+    vkFreeCommandBuffers(_device, _commandPool, 1, &commandBuffer);
+    vkDestroyBuffer(_device, stagingBuffer, nullptr);
+    Utils::freeMemory(_device, stagingBufferMemory);
+}
+
+void TextureStreamer::_queueLoad(uint32_t texture, uint32_t firstLevel, uint32_t lastLevel) {
+    _textures[texture].busy = true;
+    _loadsInFlight++;
+
+    // The texture vector can grow while the job runs, so the job gets its own copy of the header
+    Ktx2File ktx = _textures[texture].ktx;
+    _ioPool->submit([this, ktx, texture, firstLevel, lastLevel]() {
+        LoadResult loaded;
+        loaded.texture = texture;
+        loaded.baseLevel = firstLevel;
+        try {
+            for (uint32_t level = firstLevel; level <= lastLevel; level++) {
+                loaded.levels.push_back(ktx.readLevel(level));
+            }
+        } catch (const std::exception &e) {
+            loaded.error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        _results.push_back(std::move(loaded));
+    });
+}
+
+void TextureStreamer::_collectLoads() {
+    std::vector<LoadResult> results;
+    {
+        std::lock_guard<std::mutex> lock(_resultsMutex);
+        results.swap(_results);
+    }
+
+    for (auto &loaded : results) {
+        _loadsInFlight--;
+        Texture &texture = _textures[loaded.texture];
+        if (!loaded.error.empty()) {
+            LOG_WARNING("Texture load failed: ", loaded.error);
+            texture.busy = false;
+            texture.failed = true;
+            continue;
+        }
+        _submitTransfer(loaded.texture, loaded.baseLevel, loaded.levels);
+    }
+}
+
+void TextureStreamer::_retireUploads() {
+    for (auto it = _uploads.begin(); it != _uploads.end();) {
+        if (vkGetFenceStatus(_device, it->fence) != VK_SUCCESS) {
+            ++it;
+            continue;
+        }
+
+        Texture &texture = _textures[it->texture];
+        if (texture.resident.image != VK_NULL_HANDLE) {
+            // Frames already recorded may still sample the old image
+            _pendingDeletes.push_back({_frame + _framesInFlight, texture.resident});
+        }
+        texture.resident = it->image;
+        texture.busy = false;
+
+        if (it->generatedMips && --_mipUploadsInFlight == 0) {
+            _mipGenerator->releaseTransientResources();
+        }
+
+        vkFreeCommandBuffers(_device, _commandPool, 1, &it->commandBuffer);
+        vkDestroyFence(_device, it->fence, nullptr);
+        if (it->stagingBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(_device, it->stagingBuffer, nullptr);
+            Utils::freeMemory(_device, it->stagingMemory);
+        }
+        it = _uploads.erase(it);
+    }
+}
+
+void TextureStreamer::_releaseDeleted() {
+    for (auto it = _pendingDeletes.begin(); it != _pendingDeletes.end();) {
+        if (it->frame <= _frame) {
+            _destroyImage(it->image);
+            it = _pendingDeletes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TextureStreamer::_schedule() {
+    std::vector<uint32_t> promotions;
+
+    for (uint32_t i = 0; i < _textures.size(); i++) {
+        Texture &texture = _textures[i];
+        if (!texture.streamed || texture.busy || texture.failed || texture.resident.image == VK_NULL_HANDLE) {
+            continue;
+        }
+        if (texture.requestedLevel > texture.resident.baseLevel) {
+            // Asked for less detail, drop down without touching the disk
+            _submitTransfer(i, texture.requestedLevel, {});
+        } else if (texture.requestedLevel < texture.resident.baseLevel) {
+            promotions.push_back(i);
+        }
+    }
+
+    std::sort(promotions.begin(), promotions.end(), [this](uint32_t a, uint32_t b) {
+        if (_textures[a].priority != _textures[b].priority) {
+            return _textures[a].priority > _textures[b].priority;
+        }
+        return _textures[a].lastUsedFrame > _textures[b].lastUsedFrame;
+    });
+
+    for (uint32_t index : promotions) {
+        if (_loadsInFlight >= MAX_CONCURRENT_LOADS) {
+            break;
+        }
+        Texture &texture = _textures[index];
+        uint32_t nextLevel = texture.resident.baseLevel - 1;
+        // The new image replaces the resident one once its upload completes
+        VkDeviceSize growth = _estimateSize(texture, nextLevel) - texture.resident.size;
+
+        if (_residentBytes + growth > _budget) {
+            // Memory is only returned once the eviction completes, try again on a later frame
+            _evictOne(index);
+            break;
+        }
+        _queueLoad(index, nextLevel, nextLevel);
+    }
+}
+
+bool TextureStreamer::_evictOne(uint32_t requester) {
+    const Texture &wanted = _textures[requester];
+    uint32_t victim = INVALID_TEXTURE;
+
+    for (uint32_t i = 0; i < _textures.size(); i++) {
+        const Texture &texture = _textures[i];
+        if (i == requester || !texture.streamed || texture.busy || texture.resident.image == VK_NULL_HANDLE || texture.resident.baseLevel >= texture.tailLevel) {
+            continue;
+        }
+        // Never evict something more important that is in use right now
+        if (texture.lastUsedFrame == _frame && texture.priority >= wanted.priority) {
+            continue;
+        }
+        if (victim == INVALID_TEXTURE || texture.lastUsedFrame < _textures[victim].lastUsedFrame) {
+            victim = i;
+        }
+    }
+
+    if (victim == INVALID_TEXTURE) {
+        return false;
+    }
+    _submitTransfer(victim, _textures[victim].resident.baseLevel + 1, {});
+    return true;
+}
+
+void TextureStreamer::_submitTransfer(uint32_t textureIndex, uint32_t baseLevel, const std::vector<std::vector<char>> &newLevels) {
+    PROFILE_FUNCTION();
+    Texture &texture = _textures[textureIndex];
+    const Ktx2File &ktx = texture.ktx;
+    const ResidentImage &old = texture.resident;
+
+    Upload upload;
+    upload.texture = textureIndex;
+    upload.image.baseLevel = baseLevel;
+
+    VkImageCreateInfo imageInfo = _streamedImageInfo(ktx, baseLevel);
+    Utils::createImage(_physicalDevice, _device, MemoryCategory::Texture, imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, upload.image.image, upload.image.memory);
+    upload.image.view = Utils::createImageView(_device, upload.image.image, ktx.format, VK_IMAGE_ASPECT_COLOR_BIT, 0, imageInfo.mipLevels);
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(_device, upload.image.image, &memRequirements);
+    upload.image.size = memRequirements.size;
+    _residentBytes += upload.image.size;
+
+    // Newly loaded levels go through one staging buffer, each level aligned for any block size
+    std::vector<VkBufferImageCopy> bufferCopies;
+    if (!newLevels.empty()) {
+        VkDeviceSize stagingSize = 0;
+        for (const auto &level : newLevels) {
+            stagingSize = alignUp(stagingSize, 16) + level.size();
+        }
+        Utils::createBuffer(_physicalDevice, _device, MemoryCategory::Staging, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, upload.stagingBuffer, upload.stagingMemory);
+
+        char *data;
+        vkMapMemory(_device, upload.stagingMemory, 0, stagingSize, 0, reinterpret_cast<void **>(&data));
+        VkDeviceSize offset = 0;
+        for (uint32_t i = 0; i < newLevels.size(); i++) {
+            offset = alignUp(offset, 16);
+            memcpy(data + offset, newLevels[i].data(), newLevels[i].size());
+
+            VkExtent2D extent = ktx.levelExtent(baseLevel + i);
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = i;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent = {extent.width, extent.height, 1};
+            bufferCopies.push_back(region);
+
+            offset += newLevels[i].size();
+        }
+        vkUnmapMemory(_device, upload.stagingMemory);
+    }
+
+    // Every level not freshly loaded is copied over from the current image
+    std::vector<VkImageCopy> imageCopies;
+    if (old.image != VK_NULL_HANDLE) {
+        uint32_t firstCopied = baseLevel + static_cast<uint32_t>(newLevels.size());
+        for (uint32_t level = std::max(firstCopied, old.baseLevel); level < ktx.levelCount; level++) {
+            VkExtent2D extent = ktx.levelExtent(level);
+            VkImageCopy region{};
+            region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - old.baseLevel, 0, 1};
+            region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - baseLevel, 0, 1};
+            region.extent = {extent.width, extent.height, 1};
+            imageCopies.push_back(region);
+        }
+    }
+
+    _beginUpload(upload);
+
+    imageBarrier(upload.commandBuffer, upload.image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    if (!imageCopies.empty()) {
+        // The old image stays bound in frames that are still in flight, so it goes back to
+        // shader read layout in the same submission
+        imageBarrier(upload.commandBuffer, old.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                     VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        vkCmdCopyImage(upload.commandBuffer, old.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, upload.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       static_cast<uint32_t>(imageCopies.size()), imageCopies.data());
+        imageBarrier(upload.commandBuffer, old.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    if (!bufferCopies.empty()) {
+        vkCmdCopyBufferToImage(upload.commandBuffer, upload.stagingBuffer, upload.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<uint32_t>(bufferCopies.size()), bufferCopies.data());
+    }
+
+    imageBarrier(upload.commandBuffer, upload.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    texture.busy = true;
+    _submitUpload(upload);
+}
+
+void TextureStreamer::_beginUpload(Upload &upload) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = _commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    auto result = vkAllocateCommandBuffers(_device, &allocInfo, &upload.commandBuffer);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate texture upload command buffer");
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(upload.commandBuffer, &beginInfo);
+}
+
+void TextureStreamer::_submitUpload(Upload &upload) {
+    PROFILE_FUNCTION();
+    auto result = vkEndCommandBuffer(upload.commandBuffer);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record texture upload command buffer");
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkCreateFence(_device, &fenceInfo, nullptr, &upload.fence);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &upload.commandBuffer;
+
+    result = vkQueueSubmit(_queue, 1, &submitInfo, upload.fence);
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit texture upload");
+    }
+
+    _uploads.push_back(upload);
+}
+
+VkImageCreateInfo TextureStreamer::_streamedImageInfo(const Ktx2File &ktx, uint32_t baseLevel) const {
+    VkExtent2D baseExtent = ktx.levelExtent(baseLevel);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = ktx.format;
+    imageInfo.extent = {baseExtent.width, baseExtent.height, 1};
+    imageInfo.mipLevels = ktx.levelCount - baseLevel;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    return imageInfo;
+}
+
+VkDeviceSize TextureStreamer::_estimateSize(const Texture &texture, uint32_t baseLevel) const {
+    // Raw level sizes miss alignment and padding, so ask the driver about an image that is never bound
+    VkImageCreateInfo imageInfo = _streamedImageInfo(texture.ktx, baseLevel);
+    VkImage image;
+    if (vkCreateImage(_device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create texture size probe image!");
+    }
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(_device, image, &memRequirements);
+    vkDestroyImage(_device, image, nullptr);
+    return memRequirements.size;
+}
+
+void TextureStreamer::_destroyImage(ResidentImage &image) {
+    if (image.image == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyImageView(_device, image.view, nullptr);
+    vkDestroyImage(_device, image.image, nullptr);
+    Utils::freeMemory(_device, image.memory);
+    _residentBytes -= image.size;
+    image = ResidentImage{};
+}
@@ -0,0 +1,51 @@
+#include "ThreadPool.h"
+
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    for (uint32_t i = 0; i < threadCount; i++) {
+        _workers.emplace_back(&ThreadPool::_workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _condition.notify_one();
+}
+
+size_t ThreadPool::pending() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _tasks.size();
+}
+
+void ThreadPool::_workerLoop() {
+    Profiler::get().setThreadName("io worker");
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this] { return _stop || !_tasks.empty(); });
+            if (_stop && _tasks.empty()) {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        PROFILE_ZONE("io task");
+        task();
+    }
+}
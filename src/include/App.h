@@ -1,6 +1,8 @@
 #pragma once
 
 #include <array>
+#include <future>
+#include <memory>
 #include <optional>
 #include <vector>
 #define GLFW_INCLUDE_VULKAN
@@ -12,10 +14,32 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "ClusteredLighting.h"
+#include "DeviceCapabilities.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "FrameTrace.h"
+#include "GeometryBuffer.h"
+#include "GpuTimer.h"
+#include "HiZBuffer.h"
+#include "JobSystem.h"
+#include "MemoryTelemetry.h"
+#include "MeshLod.h"
+#include "MeshletCuller.h"
+#include "ParticleSystem.h"
+#include "Profiler.h"
+#include "SceneBvh.h"
+#include "Simulation.h"
+#include "SpriteBatcher.h"
+#include "StartupProfiler.h"
+#include "TextureStreamer.h"
+
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
     std::optional<uint32_t> transferFamily;
+    // Compute without graphics, only on devices that can run compute alongside rasterization
+    std::optional<uint32_t> computeFamily;
 
     bool isComplete();
 };
@@ -29,21 +53,167 @@ struct SwapChainSupportDetails {
 struct Vertex {
     glm::vec2 pos;
     glm::vec3 color;
+    glm::vec2 texCoord;
 
     static VkVertexInputBindingDescription getBindingDescription();
-    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions();
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions();
+};
+
+struct AppOptions {
+    // Index or part of the name of the GPU to use, empty picks the highest scoring one
+    std::string device;
+    // Clamped to what the device supports for both color and depth
+    uint32_t msaaSamples = 4;
+    // Exit after this many frames, 0 runs until the window is closed
+    uint32_t maxFrames = 0;
+    // Fixed simulation rate, independent of the frame rate
+    uint32_t simulationRate = 60;
+    // Cull meshlets on the GPU and draw the survivors indirectly
+    bool meshletCulling = true;
+    // Test meshlets against a depth pyramid as well, needs meshlet culling
+    bool occlusionCulling = true;
+    // Simplify the mesh into LODs and draw the coarsest one that still looks the same,
+    // off always draws the full mesh. A flat mesh simplifies without error, so its
+    // coarsest level is picked at any distance.
+    bool meshLods = true;
+
+    // Frame capture is enabled when a directory is set
+    std::string captureDirectory;
+    CaptureFormat captureFormat = CaptureFormat::PPM;
+    uint32_t captureFrames = 0;
+
+    // CPU and GPU zones still held by the profiler are written here at exit, as Chrome tracing JSON
+    std::string traceFile;
+
+    // Frame trace of everything submitted, for replaying the same workload offline
+    std::string recordFile;
+    // Replays a frame trace in a hidden window as fast as possible instead of running the simulation
+    std::string replayFile;
+    // Replayed instead of replayFile, for traces generated in memory
+    std::shared_ptr<const FrameTrace> replayTrace;
+    uint32_t replayLoops = 1;
+
+    // Synthetic load for the benchmark scenes: draws of the mesh per frame without
+    // meshlet culling, and bytes pushed through a blocking upload every frame
+    uint32_t drawCount = 1;
+    // Instances in each of those draws, shrunk onto a grid over the unit square so they
+    // stay in view. Meshlet culling only tests the first, so it is off with more than one.
+    uint32_t instanceCount = 1;
+    VkDeviceSize uploadBytesPerFrame = 0;
+
+    // GPU particles simulated every frame, 0 disables them
+    uint32_t particleCount = 0;
+    // Simulate them on a compute only queue when the device has one, overlapping the frame's
+    // graphics work. Off records them into the frame's command buffer to compare the two.
+    bool asyncCompute = true;
+
+    // Sprites streamed through the batcher and drawn over the scene every frame, 0 disables them
+    uint32_t spriteCount = 0;
+    // Outlines the mesh's screen space bounds with the batcher's debug lines
+    bool debugBounds = false;
+
+    // Point lights orbiting over the mesh, binned into clusters on the GPU and shaded
+    // per fragment, 0 draws the mesh unlit
+    uint32_t lightCount = 0;
+
+    // Windows besides the primary one, each showing the scene from its own camera. They share
+    // the device and pipelines, are recorded into the same frame and presented in one call.
+    uint32_t extraViews = 0;
+
+    // Scales the primary window's scene resolution to keep the GPU frame time at this many
+    // milliseconds and upscales it to the window, 0 always renders at the window's size
+    float targetGpuMilliseconds = 0.0f;
+    // Lowest fraction of the window's width and height the scene is rendered at
+    float minResolutionScale = 0.5f;
+    // Strength of the sharpening applied while upscaling, 0 filters bilinearly
+    float upscaleSharpness = 0.25f;
+
+    // Submit a frame's previous recording again while nothing it depends on changed.
+    // Only applies without particles, sprites, extra views and frame capture, which
+    // record data that changes every frame.
+    bool reuseCommandBuffers = true;
+
+    // Sleep until input, a resize or a change in the scene instead of rendering continuously.
+    // Starts with the animation paused, space toggles it.
+    bool onDemand = false;
+};
+
+// Measured while replaying, read by the benchmark suite once run() returned
+struct ReplayStats {
+    std::string deviceName;
+    double startupMilliseconds = 0.0;
+    std::vector<float> cpuFrameTimes;
+    std::vector<float> gpuFrameTimes;
+    VkDeviceSize peakMemoryBytes = 0;
 };
 
 struct UniformBufferObject {
     alignas(16) glm::mat4 model;
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
+    // Columns of the instance grid, see AppOptions::instanceCount
+    uint32_t instancesPerRow;
+};
+
+// A primary command buffer for one frame in flight and swap chain image, with what its
+// recording depended on. Everything else it reads lives in buffers rewritten every frame,
+// so while these match it is submitted again instead of being recorded anew.
+struct FrameRecording {
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    bool valid = false;
+    bool visible = false;
+    uint32_t lod = 0;
+    VkExtent2D renderExtent{};
+    std::vector<const char *> gpuZones;
+};
+
+// A secondary window drawn with the primary window's render pass and pipelines, so its
+// swap chain has to use the same format. Lives as long as the primary window.
+struct SurfaceView {
+    GLFWwindow *window = nullptr;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+    std::vector<VkImage> images;
+    std::vector<VkImageView> imageViews;
+    std::vector<VkFramebuffer> framebuffers;
+
+    VkImage colorImage = VK_NULL_HANDLE;
+    VkDeviceMemory colorImageMemory = VK_NULL_HANDLE;
+    VkImageView colorImageView = VK_NULL_HANDLE;
+    VkImage depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory depthImageMemory = VK_NULL_HANDLE;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+
+    // Per frame in flight
+    std::vector<VkSemaphore> imageAvailableSemaphores;
+    std::vector<VkSemaphore> renderFinishedSemaphores;
+    std::vector<VkBuffer> uniformBuffers;
+    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<void *> uniformBuffersMapped;
+    std::vector<UniformBufferObject> frameUniforms;
+    std::vector<VkDescriptorSet> descriptorSets;
+    std::vector<VkImageView> boundTextureViews;
+
+    // Around the scene's up axis, relative to the primary camera
+    float cameraAngle = 0.0f;
+    uint32_t imageIndex = 0;
+    // Whether an image was acquired and the view takes part in the current frame
+    bool acquired = false;
+    bool resized = false;
 };
 
 class App {
    public:
+    explicit App(const AppOptions &options = AppOptions());
+
     void run();
+    const ReplayStats &getReplayStats() const { return _replayStats; }
     bool _framebufferResized = false;
+    // Set by window events, the next on demand frame is drawn even if the scene did not change
+    bool _redrawRequested = false;
+    void toggleAnimation();
 
    private:
     void initWindow();
@@ -61,18 +231,35 @@ class App {
     void createRenderPass();
     void createDescriptorSetLayout();
     void createGraphicsPipeline();
+    void createColorResources();
+    void createDepthResources();
     void createFrameBuffers();
     void createCommandPool();
     void createVertexBuffer();
+    void createMeshLods();
+    void createSceneIndex();
     void createIndexBuffer();
+    void createGeometryBuffer();
+    void createMeshlets();
+    void createOcclusionCulling();
+    void createTextureStreamer();
     void createUniformBuffers();
     void createDescriptorPool();
     void createDescriptorSets();
     void createCommandBuffer();
     void createSyncObjects();
+    void createFrameCapture();
+    void createGpuTimer();
+    void createTraceRecorder();
+    void createSyntheticLoad();
+    void createParticles();
+    void createSpriteBatcher();
+    void createLighting();
+    void createViews();
 
     void recreateSwapChain();
     void cleanupSwapChain();
+    void cleanupViews();
 
     void _populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT &createInfo);
     std::vector<const char *> _getRequiredExtensions();
@@ -89,34 +276,80 @@ class App {
     QueueFamilyIndices _findQueueFamilies(VkPhysicalDevice device);
     bool _checkDeviceExtensionSupport(VkPhysicalDevice device);
 
-    SwapChainSupportDetails _querySwapChainSupport(VkPhysicalDevice device);
+    SwapChainSupportDetails _querySwapChainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
     VkSurfaceFormatKHR _chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
     VkPresentModeKHR _chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
-    VkExtent2D _chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities);
+    VkExtent2D _chooseSwapExtent(const VkSurfaceCapabilitiesKHR &capabilities, GLFWwindow *window);
+    // Picks the surface's preferred format unless `requiredFormat` is set
+    void _createSwapChain(VkSurfaceKHR surface, GLFWwindow *window, VkFormat requiredFormat, VkSwapchainKHR &swapChain, std::vector<VkImage> &images, VkFormat &format, VkExtent2D &extent);
+    void _createFramebuffers(const std::vector<VkImageView> &imageViews, VkImageView colorView, VkImageView depthView, VkExtent2D extent, std::vector<VkFramebuffer> &framebuffers);
+    // The single sample color image the pass stores is left in `outputLayout`
+    VkRenderPass _createRenderPass(VkImageLayout outputLayout);
 
     VkShaderModule _createShaderModule(const std::vector<char> &code);
 
-    void _recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    VkSampleCountFlagBits _getMaxUsableSampleCount(uint32_t requested);
+    VkFormat _findDepthFormat();
+    void _createAttachment(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkExtent2D extent, VkImage &image, VkDeviceMemory &memory, VkImageView &view);
+
+    // Culls the scene and records the frame's command buffer, or picks the recording that still matches
+    VkCommandBuffer _prepareCommandBuffer(uint32_t imageIndex);
+    void _recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool visible);
+    void _invalidateRecordings(uint32_t frame);
+    void _bindGeometry(VkCommandBuffer commandBuffer, VkBuffer meshletIndexBuffer, VkDescriptorSet descriptorSet);
 
     void _drawFrame();
+    // Whether anything visible changed since the last frame, for on demand rendering
+    bool _needsRedraw();
 
     uint32_t _findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
-    void _createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory);
+    void _createBuffer(MemoryCategory category, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer, VkDeviceMemory &bufferMemory);
     void _copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+    void _createUniformBuffers(std::vector<VkBuffer> &buffers, std::vector<VkDeviceMemory> &memories, std::vector<void *> &mapped);
+    void _allocateDescriptorSets(const std::vector<VkBuffer> &uniformBuffers, std::vector<VkDescriptorSet> &descriptorSets, std::vector<VkImageView> &boundTextureViews);
 
     void _updateUniformBuffer(uint32_t currentImage);
+    bool _cullScene(const UniformBufferObject &uniforms);
+    void _selectLod(const UniformBufferObject &uniforms, VkExtent2D renderExtent);
+    // Returns whether the descriptor was rewritten
+    bool _updateTextureDescriptor(VkDescriptorSet descriptorSet, VkImageView &boundView);
+    // Fills this frame's sprite batches, after the texture streamer updated
+    void _drawOverlay();
+    // Moves this frame's lights and sets the camera they are clustered for
+    void _updateLights();
+
+    void _createViewSwapChain(SurfaceView &view);
+    void _cleanupViewSwapChain(SurfaceView &view);
+    void _prepareViews();
+    void _recordViews(VkCommandBuffer commandBuffer);
+
+    void _loadReplay();
+    // Moves on to the next traced frame after a present, wrapping around for every loop
+    void _advanceReplay();
+    void _reportReplay() const;
 
    private:
+    AppOptions _options;
+    JobSystem _jobSystem;
+    StartupProfiler _startup;
+
     GLFWwindow *_window;
     uint32_t _width = 800;
     uint32_t _height = 600;
 
     VkInstance _instance;
+    uint32_t _instanceApiVersion = VK_API_VERSION_1_0;
     VkDebugUtilsMessengerEXT _debugMessenger;
     VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    QueueFamilyIndices _queueFamilyIndices;
+    DeviceProfile _deviceProfile;
+    DeviceFeatureTier _featureTier;
+    DeviceFeatureChain _enabledFeatures;
     VkDevice _device;
     VkQueue _graphicsQueue;
     VkQueue _presentQueue;
+    // Only with async compute
+    VkQueue _computeQueue = VK_NULL_HANDLE;
 
     VkSurfaceKHR _surface;
     VkSwapchainKHR _swapChain;
@@ -124,39 +357,134 @@ class App {
     VkFormat _swapChainImageFormat;
     VkExtent2D _swapChainExtent;
     std::vector<VkImageView> _swapChainImageViews;
+
+    VkSampleCountFlagBits _msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkImage _colorImage = VK_NULL_HANDLE;
+    VkDeviceMemory _colorImageMemory = VK_NULL_HANDLE;
+    VkImageView _colorImageView = VK_NULL_HANDLE;
+    VkFormat _depthFormat;
+    VkImage _depthImage;
+    VkDeviceMemory _depthImageMemory;
+    VkImageView _depthImageView;
+
     VkRenderPass _renderPass;
+    // Same as _renderPass but renders into the dynamic resolution target, compatible with its pipelines
+    VkRenderPass _sceneRenderPass = VK_NULL_HANDLE;
     VkDescriptorSetLayout _descriptorSetLayout;
     VkPipelineLayout _pipelineLayout;
     VkPipeline _graphicsPipeline;
+    // Vertex, fragment and vertex pulling SPIR-V, read in the background while the device is created
+    std::future<std::array<std::vector<char>, 4>> _shaderCode;
     std::vector<VkFramebuffer> _swapChainFramebuffers;
     VkCommandPool _commandPool;
-    std::vector<VkCommandBuffer> _commandBuffers;
+    // MAX_FRAMES_IN_FLIGHT recordings per swap chain image, indexed by frame first
+    std::vector<FrameRecording> _recordings;
+    uint64_t _recordedFrames = 0;
 
     std::vector<VkSemaphore> _imageAvailableSemaphores;
     std::vector<VkSemaphore> _renderFinishedSemaphores;
     std::vector<VkFence> _inFlightFences;
 
     size_t _currentFrame = 0;
+    uint64_t _frameCount = 0;
+
+    // Replaced by the trace's buffers when replaying
+    std::vector<Vertex> _vertices = {
+        {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
+        {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+        {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
+        {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}}};
+
+    std::vector<uint32_t> _indices = {0, 1, 2, 2, 3, 0};
+
+    // LOD chain imported from _indices, every level's indices back to back
+    MeshLodChain _lodChain;
+    std::vector<uint32_t> _lodIndices;
+    LodSelector _lodSelector;
+    uint32_t _lod = 0;
+
+    // Object space bounds of the mesh and all its instances, placed in the scene index by the model matrix
+    Aabb _meshBounds;
+    uint32_t _instancesPerRow = 1;
+    SceneBvh _sceneIndex;
+    uint32_t _sceneObject = 0;
+    std::vector<uint32_t> _visibleObjects;
 
-    const std::vector<Vertex> _vertices = {
-        {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
-        {{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}},
-        {{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}},
-        {{-0.5f, 0.5f}, {1.0f, 1.0f, 1.0f}}};
+    // Fixed function vertex input, only used without buffer device address
+    VkBuffer _vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _vertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer _indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _indexBufferMemory = VK_NULL_HANDLE;
 
-    const std::vector<uint16_t> _indices = {0, 1, 2, 2, 3, 0};
+    bool _vertexPulling = false;
+    GeometryBuffer _geometry;
+    uint32_t _mesh = 0;
 
-    VkBuffer _vertexBuffer;
-    VkDeviceMemory _vertexBufferMemory;
-    VkBuffer _indexBuffer;
-    VkDeviceMemory _indexBufferMemory;
+    bool _meshletCulling = false;
+    MeshletCuller _meshletCuller;
+    // Meshlets of every LOD, indexed by level
+    std::vector<MeshletRange> _lodMeshlets;
+
+    // Decided with the render pass, the culling only runs when meshlet culling does too
+    bool _occlusionCulling = false;
+    HiZBuffer _hiz;
+    // Vertex stage only, renders last frame's visible meshlets into the pyramid's depth
+    VkPipeline _depthPrepassPipeline = VK_NULL_HANDLE;
 
     std::vector<VkBuffer> _uniformBuffers;
     std::vector<VkDeviceMemory> _uniformBuffersMemory;
     std::vector<void *> _uniformBuffersMapped;
+    // CPU copy of each frame's uniforms for passes that need the matrices while recording
+    std::vector<UniformBufferObject> _frameUniforms;
     VkDescriptorPool _descriptorPool;
     std::vector<VkDescriptorSet> _descriptorSets;
 
+    MipGenerator _mipGenerator;
+    TextureStreamer _textureStreamer;
+    uint32_t _texture = TextureStreamer::INVALID_TEXTURE;
+    std::vector<VkImageView> _boundTextureViews;
+
+    FrameCapture _frameCapture;
+    GpuTimer _gpuTimer;
+
+    FrameTraceWriter _traceWriter;
+    std::chrono::steady_clock::time_point _traceStart;
+    FrameTrace _replay;
+    size_t _replayFrame = 0;
+    uint32_t _replayLoop = 0;
+    uint32_t _replayLodMismatches = 0;
+    std::chrono::steady_clock::time_point _replayStart;
+    std::chrono::steady_clock::time_point _replayLastPresent;
+    std::vector<float> _replayFrameTimes;
+    ReplayStats _replayStats;
+
+    VkBuffer _uploadTarget = VK_NULL_HANDLE;
+    VkDeviceMemory _uploadTargetMemory = VK_NULL_HANDLE;
+    std::vector<char> _uploadData;
+
+    ParticleSystem _particles;
+    std::chrono::steady_clock::time_point _particleTime;
+
+    // Created when sprites or debug bounds are drawn
+    bool _overlay = false;
+    SpriteBatcher _sprites;
+    uint32_t _whiteTexture = TextureStreamer::INVALID_TEXTURE;
+
+    // Created when lights are drawn, their orbits are in model space
+    ClusteredLighting _lighting;
+    std::vector<PointLight> _lightOrbits;
+
+    std::vector<SurfaceView> _views;
+
+    // Created when a GPU frame time is targeted, the primary window's scene is then rendered into
+    // its target through _sceneFramebuffer and upscaled into the swap chain image
+    DynamicResolution _dynamicResolution;
+    VkFramebuffer _sceneFramebuffer = VK_NULL_HANDLE;
+
+    Simulation _simulation;
+    // What the last frame showed, compared against the simulation to find idle frames
+    SceneState _drawnScene;
+
     std::vector<const char *> validationLayers = {
         "VK_LAYER_KHRONOS_validation"};
     std::vector<const char *> deviceExtensions = {
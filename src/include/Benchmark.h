@@ -0,0 +1,6 @@
+#pragma once
+
+// Renders every synthetic scene in turn and compares the measurements with
+// the stored baselines of the device. Returns the process exit code, non-zero
+// when a metric regressed beyond its noise threshold or has no baseline.
+int runBenchmarks(int argc, char **argv);
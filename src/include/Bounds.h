@@ -0,0 +1,24 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+struct Aabb {
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    float surfaceArea() const;
+    void expand(const Aabb &other);
+    // Bounds of the box after `transform`, which may rotate it
+    Aabb transformed(const glm::mat4 &transform) const;
+};
+
+// Planes point inwards and are normalized, so dot(plane.xyz, p) + plane.w is
+// the signed distance of p from the plane
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Extracts the planes in the space `transform` maps to clip space, with Vulkan's [0, 1] depth range
+    static Frustum fromMatrix(const glm::mat4 &transform);
+};
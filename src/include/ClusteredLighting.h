@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// Froxel grid the view frustum is split into, must match light_cull_shader.glsl and fragment_shader.glsl
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+// Further lights touching a cluster are dropped
+#define CLUSTER_MAX_LIGHTS 256
+
+// World space point light, must match light_cull_shader.glsl and fragment_shader.glsl
+struct PointLight {
+    // Position and radius, the light does not reach past the radius
+    glm::vec4 positionRadius;
+    // Linear RGB, w unused
+    glm::vec4 color;
+};
+
+// Clustered forward lighting. The camera's frustum is split into a grid of
+// froxels, screen tiles subdivided into depth slices of exponentially growing
+// thickness, and a compute pass bins every light whose sphere touches a
+// froxel into that froxel's list. The lit fragment shader finds its froxel
+// from its world position and loops over that list only, so its cost follows
+// the number of lights around it rather than the number in the scene.
+//
+// Lights are written by the caller into a mapped buffer every frame. The
+// lists are built for one camera, other views look fragments up in the same
+// grid, so they are lit correctly inside the camera's frustum and only by the
+// ambient term outside it.
+class ClusteredLighting {
+   public:
+    // The lit pipeline's layout includes this set layout, so it is created before init
+    void createSetLayout(VkDevice device);
+    void init(VkPhysicalDevice physicalDevice, uint32_t framesInFlight, uint32_t maxLights);
+    void cleanup();
+
+    VkDescriptorSetLayout getSetLayout() const { return _setLayout; }
+    VkDescriptorSet getDescriptorSet(uint32_t frame) const { return _frames[frame].descriptorSet; }
+    uint32_t getMaxLights() const { return _maxLights; }
+
+    // The frame's lights, filled after its fence was waited on and before it is submitted
+    PointLight *getLights(uint32_t frame) { return _frames[frame].lights; }
+    // Sets the camera the grid is built for and how many of the frame's lights are used.
+    // `proj` follows glm's default clip space, near and far are read from it.
+    void update(uint32_t frame, uint32_t lightCount, const glm::mat4 &view, const glm::mat4 &proj, const glm::vec3 &ambient);
+    // Bins the frame's lights, outside a render pass. The lists are ready for fragment
+    // shader reads afterwards. Only reads what update() wrote, so a recording stays valid.
+    void record(VkCommandBuffer commandBuffer, uint32_t frame);
+
+   private:
+    struct Frame {
+        VkBuffer paramsBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory paramsMemory = VK_NULL_HANDLE;
+        void *params = nullptr;
+        VkBuffer lightBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory lightMemory = VK_NULL_HANDLE;
+        PointLight *lights = nullptr;
+        // Light count per cluster followed by CLUSTER_MAX_LIGHTS light indices per cluster
+        VkBuffer clusterBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory clusterMemory = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+
+    void _createPipeline();
+
+    VkDevice _device = VK_NULL_HANDLE;
+    uint32_t _maxLights = 0;
+
+    VkDescriptorSetLayout _setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+
+    std::vector<Frame> _frames;
+};
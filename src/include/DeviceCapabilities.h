@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// What the selected device can do beyond plain Vulkan 1.0. Code with a fast
+// path branches on these instead of querying the device again.
+struct DeviceFeatureTier {
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    bool timelineSemaphores = false;
+    bool synchronization2 = false;
+    bool bufferDeviceAddress = false;
+    // Bindless sampled images: runtime sized, partially bound, update after bind, non-uniform indexing
+    bool descriptorIndexing = false;
+    bool memoryBudget = false;
+    bool storageImageDynamicIndexing = false;
+    // Images may have usages their own format lacks, as long as every view only uses what its format supports
+    bool extendedImageUsage = false;
+    bool dedicatedTransferQueue = false;
+    bool asyncComputeQueue = false;
+};
+
+struct DeviceProfile {
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    VkDeviceSize deviceLocalBytes = 0;
+    DeviceFeatureTier tier;
+    uint64_t score = 0;
+};
+
+// Feature structs handed to vkGetPhysicalDeviceFeatures2 and vkCreateDevice.
+// Holds pointers into itself once linked, so it must not be copied afterwards.
+struct DeviceFeatureChain {
+    VkPhysicalDeviceFeatures2 features2{};
+    VkPhysicalDeviceVulkan12Features vulkan12{};
+    VkPhysicalDeviceVulkan13Features vulkan13{};
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2{};
+
+    // Chains the structs `apiVersion` allows and returns the head
+    VkPhysicalDeviceFeatures2 *link(uint32_t apiVersion, bool synchronization2Extension);
+};
+
+class DeviceCapabilities {
+   public:
+    // Newest instance version the loader offers, capped at the newest one we use
+    static uint32_t instanceApiVersion();
+
+    // Collects properties and optional features and scores the device. Whether it
+    // can present to a surface is up to the caller.
+    static DeviceProfile probe(VkPhysicalDevice device, uint32_t instanceVersion);
+
+    // Turns on every feature in the profile's tier and appends the extensions they need
+    static VkPhysicalDeviceFeatures2 *enableFeatures(const DeviceProfile &profile, DeviceFeatureChain &chain, std::vector<const char *> &extensions);
+
+    // Device local memory the process may still allocate, needs the memoryBudget tier
+    static VkDeviceSize queryDeviceLocalBudget(VkPhysicalDevice device);
+
+    static void log(const DeviceProfile &profile, bool suitable);
+};
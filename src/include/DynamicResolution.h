@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Renders the scene into an offscreen target at a fraction of the swap chain's
+// size and upscales it into the swap chain image. The target is allocated at
+// full size once per swap chain and only the rendered area shrinks, so moving
+// the scale costs no allocation and no pipeline change.
+//
+// The scale follows the measured GPU frame time. Frame cost is taken to grow
+// with the pixel count, so the scale moves by the square root of the target
+// over the measured time: it drops at once when a frame runs over budget and
+// climbs back slowly once there is headroom, so noise does not make the image
+// pump between sizes.
+class DynamicResolution {
+   public:
+    // `format` is the swap chain's, `sharpness` 0 upscales with a plain bilinear filter.
+    // Frame times arrive `framesInFlight` frames late, so that many are ignored after a drop.
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format, uint32_t framesInFlight, float targetMilliseconds, float minScale, float sharpness);
+    void cleanup();
+    // Call after vkDeviceWaitIdle when the swap chain was recreated, before getTargetView()
+    void resize(VkExtent2D extent, const std::vector<VkImageView> &swapChainViews);
+
+    // Feeds one measured GPU frame time to the controller
+    void update(float gpuMilliseconds);
+    // Renders at `extent` instead of what the controller picks, for replaying the
+    // sizes of a capture. Clamped to the swap chain, a zero extent releases it.
+    void pinRenderExtent(VkExtent2D extent) { _pinnedExtent = extent; }
+
+    // Color target the scene pass renders into, at the swap chain's size
+    VkImageView getTargetView() const { return _targetView; }
+    // Area of the target the scene covers this frame, from the origin
+    VkExtent2D getRenderExtent() const;
+    float getScale() const { return _scale; }
+
+    // Lets the scene pass overwrite the target once the previous upscale read it,
+    // outside a render pass and before the scene pass begins
+    void beginScene(VkCommandBuffer commandBuffer);
+    // Draws the rendered area over the whole swap chain image, outside a render pass.
+    // The swap chain image ends up in PRESENT_SRC layout.
+    void recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+   private:
+    void _createRenderPass();
+    void _createPipeline();
+    void _createResources(const std::vector<VkImageView> &swapChainViews);
+    void _destroyResources();
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    VkFormat _format = VK_FORMAT_UNDEFINED;
+
+    uint32_t _latencyFrames = 0;
+    uint32_t _settleFrames = 0;
+    float _targetMilliseconds = 0.0f;
+    float _minScale = 1.0f;
+    float _sharpness = 0.0f;
+    float _scale = 1.0f;
+    // Smoothed GPU frame time, negative until the first measurement
+    float _averageMilliseconds = -1.0f;
+
+    VkRenderPass _renderPass = VK_NULL_HANDLE;
+    VkSampler _sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet _descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+
+    VkExtent2D _extent{};
+    VkExtent2D _pinnedExtent{};
+    VkImage _target = VK_NULL_HANDLE;
+    VkDeviceMemory _targetMemory = VK_NULL_HANDLE;
+    VkImageView _targetView = VK_NULL_HANDLE;
+    // One per swap chain image
+    std::vector<VkFramebuffer> _framebuffers;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+enum class CaptureFormat {
+    PPM,
+    PNG,
+    Raw
+};
+
+// Copies presented images into a ring of host visible buffers without ever
+// waiting on the GPU. A slot is only read back once the fence of the frame
+// that recorded the copy has signalled, and encoding and disk writes happen
+// on a separate pool. When every slot is busy the frame is dropped instead of
+// stalling the render loop.
+class FrameCapture {
+   public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkFormat format, VkExtent2D extent, const std::string &directory, CaptureFormat captureFormat, uint32_t maxFrames, uint32_t slotCount);
+    void cleanup();
+    // Call after vkDeviceWaitIdle when the swap chain was recreated
+    void resize(VkFormat format, VkExtent2D extent);
+
+    bool isEnabled() const { return _enabled; }
+    static bool isFormatSupported(VkFormat format);
+
+    // Records a copy of `image`, which must be in PRESENT_SRC layout, after the render pass
+    void record(VkCommandBuffer commandBuffer, VkImage image, uint32_t frameSlot);
+    // Call once the fence of `frameSlot` has signalled
+    void collect(uint32_t frameSlot);
+    void report();
+
+   private:
+    enum SlotState {
+        SLOT_FREE,
+        SLOT_RECORDED,
+        SLOT_ENCODING
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        const uint8_t *mapped = nullptr;
+        uint32_t frameSlot = 0;
+        uint64_t sequence = 0;
+        std::atomic<int> state{SLOT_FREE};
+    };
+
+    void _createSlots();
+    void _destroySlots();
+    void _waitForEncoders();
+    void _encode(Slot &slot, uint64_t sequence);
+    void _toRgb(const uint8_t *pixels, std::vector<uint8_t> &rgb) const;
+    void _writePpm(const std::string &filename, const std::vector<uint8_t> &rgb) const;
+    void _writePng(const std::string &filename, const std::vector<uint8_t> &rgb) const;
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    bool _enabled = false;
+    VkFormat _format = VK_FORMAT_UNDEFINED;
+    VkExtent2D _extent{};
+    std::string _directory;
+    CaptureFormat _captureFormat = CaptureFormat::PPM;
+    uint32_t _maxFrames = 0;
+
+    std::unique_ptr<Slot[]> _slots;
+    uint32_t _slotCount = 0;
+    uint32_t _nextSlot = 0;
+    uint64_t _recorded = 0;
+
+    std::unique_ptr<ThreadPool> _encoders;
+    std::mutex _encodeMutex;
+    std::condition_variable _encodeCondition;
+    uint32_t _encoding = 0;
+    uint64_t _nextRawSequence = 0;
+    std::ofstream _rawFile;
+
+    std::atomic<uint64_t> _framesWritten{0};
+    std::atomic<uint64_t> _bytesWritten{0};
+    std::atomic<uint64_t> _encodeNanoseconds{0};
+    uint64_t _framesDropped = 0;
+    std::chrono::steady_clock::time_point _startTime;
+    std::chrono::steady_clock::time_point _lastReport;
+};
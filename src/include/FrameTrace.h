@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#define FRAME_TRACE_VERSION 2
+
+// Renderer settings that shape the workload, a replay forces them back
+struct TraceConfig {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t msaaSamples = 1;
+    uint32_t meshletCulling = 0;
+    uint32_t occlusionCulling = 0;
+    uint32_t vertexPulling = 0;
+    uint32_t meshLods = 1;
+    uint32_t drawCount = 1;
+    uint32_t instanceCount = 1;
+    uint32_t particleCount = 0;
+    uint32_t asyncCompute = 1;
+    uint32_t spriteCount = 0;
+    uint32_t debugBounds = 0;
+    uint32_t lightCount = 0;
+    uint32_t extraViews = 0;
+    uint32_t reuseCommandBuffers = 1;
+    float targetGpuMilliseconds = 0.0f;
+    float minResolutionScale = 0.5f;
+    float upscaleSharpness = 0.25f;
+    uint64_t uploadBytesPerFrame = 0;
+};
+
+// Contents of a buffer the renderer created at startup, with the element size
+// so a replay can tell when the layout changed since the capture
+struct TraceBuffer {
+    std::string name;
+    uint32_t stride = 0;
+    std::vector<char> data;
+};
+
+// One submit and present, with everything _recordCommandBuffer derives its work from
+struct TraceFrame {
+    // Nanoseconds since the capture started
+    uint64_t time = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // UINT32_MAX when the trace was generated rather than captured
+    uint32_t lod = UINT32_MAX;
+    // Scene resolution picked by dynamic resolution, 0 when it was off or the trace was generated
+    uint32_t renderWidth = 0;
+    uint32_t renderHeight = 0;
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 proj;
+};
+
+// Binary trace of what the renderer submitted: its settings, the buffer
+// contents it uploaded and the inputs of every frame. Replaying the frames
+// through the renderer reproduces the captured command stream without the
+// window, the simulation or any timing of the original run.
+//
+// File layout: the magic "VKFTRACE" and FRAME_TRACE_VERSION (u32), then chunks
+// of a type (u32), a payload size (u32) and the payload.
+class FrameTrace {
+   public:
+    enum class Chunk : uint32_t {
+        Config = 1,
+        Buffer = 2,
+        Frame = 3,
+    };
+
+    static FrameTrace load(const std::string &filename);
+    const TraceBuffer *findBuffer(const std::string &name) const;
+
+    TraceConfig config;
+    std::vector<TraceBuffer> buffers;
+    std::vector<TraceFrame> frames;
+};
+
+// Appends chunks as they happen, a frame costs one buffered write of a few hundred bytes
+class FrameTraceWriter {
+   public:
+    void open(const std::string &filename, const TraceConfig &config);
+    void close();
+    bool isOpen() const { return _file.is_open(); }
+
+    void writeBuffer(const std::string &name, uint32_t stride, const void *data, size_t size);
+    void writeFrame(const TraceFrame &frame);
+
+   private:
+    void _writeChunk(FrameTrace::Chunk type, const void *payload, size_t size);
+
+    std::string _filename;
+    std::ofstream _file;
+    uint64_t _frameCount = 0;
+};
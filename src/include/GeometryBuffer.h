@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Which attributes follow the position in a pulled vertex, all of them 32 bit floats.
+// Must match vertex_pull_shader.glsl.
+enum VertexLayoutFlags : uint32_t {
+    VERTEX_LAYOUT_POSITION_3D = 1,
+    VERTEX_LAYOUT_COLOR = 2,
+    VERTEX_LAYOUT_TEXCOORD = 4
+};
+
+struct MeshRange {
+    VkDeviceAddress vertexAddress = 0;
+    VkDeviceSize indexOffset = 0;
+    uint32_t indexCount = 0;
+    uint32_t vertexCount = 0;
+    // In 32 bit words
+    uint32_t vertexStride = 0;
+    uint32_t vertexLayout = 0;
+};
+
+// Push constants of the vertex pulling shader
+struct VertexPullConstants {
+    VkDeviceAddress vertices;
+    uint32_t vertexStride;
+    uint32_t vertexLayout;
+};
+
+// One device local buffer holding the vertices and indices of every mesh.
+// Shaders fetch vertices through its device address, so meshes of any layout
+// share one pipeline; indices are bound from the same buffer so the fixed
+// function index fetch and post-transform cache still apply.
+class GeometryBuffer {
+   public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, VkDeviceSize capacity);
+    void cleanup();
+
+    // Copies a mesh into the buffer and waits for the upload, meant for load time
+    uint32_t addMesh(const void *vertices, uint32_t vertexCount, uint32_t vertexLayout, const uint32_t *indices, uint32_t indexCount);
+
+    const MeshRange &getMesh(uint32_t mesh) const { return _meshes[mesh]; }
+    VkBuffer getBuffer() const { return _buffer; }
+    VkDeviceSize getUsedBytes() const { return _used; }
+
+    static uint32_t vertexStride(uint32_t vertexLayout);
+
+   private:
+    VkDeviceSize _allocate(VkDeviceSize size);
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueue _queue = VK_NULL_HANDLE;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+
+    VkBuffer _buffer = VK_NULL_HANDLE;
+    VkDeviceMemory _memory = VK_NULL_HANDLE;
+    VkDeviceAddress _address = 0;
+    VkDeviceSize _capacity = 0;
+    VkDeviceSize _used = 0;
+
+    std::vector<MeshRange> _meshes;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "Profiler.h"
+
+// Begin and end timestamp pairs per frame
+#define GPU_TIMER_MAX_ZONES 16
+// Durations of the outermost zone kept for getFrameTimes()
+#define GPU_TIMER_HISTORY 4096
+
+// Timestamp queries around parts of a frame's command buffer. Results are read
+// back once the frame's fence signalled and handed to the Profiler as a "GPU"
+// track. GPU ticks are mapped to the CPU clock with one calibration at init,
+// which keeps the GPU zones lined up with the CPU zones that recorded them
+// to within the calibration submit's latency.
+class GpuTimer {
+   public:
+    // Does nothing when the queue cannot write timestamps
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t framesInFlight);
+    void cleanup();
+
+    // Forwards the zones recorded the last time `frame` was used, call after its fence was waited on.
+    // Returns whether a new frame time was read.
+    bool collect(uint32_t frame);
+
+    // Resets the frame's queries, outside a render pass and before any zone
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame);
+    // `name` must outlive the profiler. Returns the zone to end, zones may nest.
+    uint32_t beginZone(VkCommandBuffer commandBuffer, uint32_t frame, const char *name);
+    void endZone(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t zone);
+
+    // Zones recorded into `frame`'s command buffer since beginFrame
+    const std::vector<const char *> &getZones(uint32_t frame) const { return _frames[frame].names; }
+    // For a command buffer submitted again as it was recorded, `zones` are the ones it was recorded with
+    void reuseFrame(uint32_t frame, const std::vector<const char *> &zones);
+
+    // Milliseconds of each frame's first zone, oldest first, up to GPU_TIMER_HISTORY of the latest frames
+    std::vector<float> getFrameTimes() const;
+    // Milliseconds of the frame read by the last successful collect()
+    float getLastFrameTime() const { return _lastFrameTime; }
+
+   private:
+    struct FrameZones {
+        std::vector<const char *> names;
+    };
+
+    void _calibrate(VkQueue queue, uint32_t queueFamily);
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueryPool _queryPool = VK_NULL_HANDLE;
+    double _period = 1.0;
+    uint64_t _validMask = ~0ull;
+    uint64_t _anchorTicks = 0;
+    uint64_t _anchorNanoseconds = 0;
+
+    std::vector<FrameZones> _frames;
+    std::vector<float> _frameTimes;
+    uint64_t _frameTimeCount = 0;
+    float _lastFrameTime = 0.0f;
+    Profiler::Track *_track = nullptr;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+// Hierarchical depth for occlusion culling. A depth pre-pass renders into a
+// single sampled depth image owned by this class, then a compute pass reduces
+// it into an R32F pyramid where every texel holds the farthest depth of the
+// area it covers. Level 0 is the largest power of two that fits inside the
+// depth image, so every further level is an exact 2x2 reduction and a box
+// covering at most 2x2 texels of some level can be tested with four fetches.
+class HiZBuffer {
+   public:
+    static bool isSupported(VkPhysicalDevice physicalDevice, VkFormat depthFormat);
+
+    // The pre-pass pipeline is built against this render pass, so it is created before init
+    void createRenderPass(VkDevice device, VkFormat depthFormat);
+    void init(VkPhysicalDevice physicalDevice, VkExtent2D extent);
+    void cleanup();
+    // Call after vkDeviceWaitIdle when the swap chain was recreated
+    void resize(VkExtent2D extent);
+
+    // Begins the depth pre-pass and sets its viewport and scissor
+    void beginDepthPass(VkCommandBuffer commandBuffer);
+    // Records the pyramid build after the pre-pass ended. The pyramid is ready
+    // for compute shader reads afterwards and stays in GENERAL layout.
+    void build(VkCommandBuffer commandBuffer);
+
+    VkRenderPass getRenderPass() const { return _renderPass; }
+    VkImageView getView() const { return _pyramidView; }
+    VkSampler getSampler() const { return _sampler; }
+    VkExtent2D getSize() const { return _size; }
+    uint32_t getMipCount() const { return _mipCount; }
+
+   private:
+    void _createPipeline();
+    void _createResources();
+    void _destroyResources();
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    VkFormat _depthFormat = VK_FORMAT_UNDEFINED;
+    VkRenderPass _renderPass = VK_NULL_HANDLE;
+    VkSampler _sampler = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout _descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+
+    VkExtent2D _extent{};
+    VkImage _depthImage = VK_NULL_HANDLE;
+    VkDeviceMemory _depthImageMemory = VK_NULL_HANDLE;
+    VkImageView _depthImageView = VK_NULL_HANDLE;
+    VkFramebuffer _framebuffer = VK_NULL_HANDLE;
+
+    VkExtent2D _size{};
+    uint32_t _mipCount = 0;
+    bool _pyramidInitialized = false;
+    VkImage _pyramid = VK_NULL_HANDLE;
+    VkDeviceMemory _pyramidMemory = VK_NULL_HANDLE;
+    VkImageView _pyramidView = VK_NULL_HANDLE;
+    std::vector<VkImageView> _levelViews;
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> _levelSets;
+};
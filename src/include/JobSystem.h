@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class JobCounter;
+
+struct Job {
+    const char *name = nullptr;
+    std::function<void()> function;
+    JobCounter *counter = nullptr;
+};
+
+// Number of unfinished jobs signalling this counter. Jobs scheduled with this
+// counter as their dependency are held back until it drops to zero.
+class JobCounter {
+   public:
+    bool isDone() const { return _value.load(std::memory_order_acquire) == 0; }
+
+   private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> _value{0};
+    std::mutex _mutex;
+    std::vector<Job> _dependents;
+};
+
+struct JobStats {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t totalNanoseconds = 0;
+    uint64_t maxNanoseconds = 0;
+};
+
+// Work stealing scheduler for short CPU bound work. Every worker owns a deque,
+// pushes and pops its own jobs at the back and steals from the front of the
+// others when it runs dry. The thread that created the system is worker 0 and
+// executes jobs while it waits on a counter, so it never idles while work is
+// pending. Blocking work (file I/O) belongs on a ThreadPool instead, and jobs
+// must not throw.
+class JobSystem {
+   public:
+    // 0 uses one thread per hardware thread, including the calling one
+    explicit JobSystem(uint32_t threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(_queues.size()); }
+
+    // `name` must outlive the system, it keys the timing statistics
+    void run(const char *name, std::function<void()> function, JobCounter *counter = nullptr, JobCounter *dependency = nullptr);
+    // Executes pending jobs until `counter` reaches zero
+    void wait(JobCounter &counter);
+    // Splits [0, count) into ranges of at most `grainSize` and blocks until all are done.
+    // A grain size of 0 picks one that gives every thread a few ranges.
+    void parallelFor(const char *name, uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)> &body);
+
+    // Returns the timings gathered since the last call, sorted by total time
+    std::vector<JobStats> collectStats();
+    void report();
+
+   private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    struct ThreadStats {
+        std::mutex mutex;
+        std::unordered_map<const char *, JobStats> jobs;
+    };
+
+    void _workerLoop(uint32_t index);
+    void _push(Job job);
+    bool _pop(uint32_t index, Job &job);
+    bool _steal(uint32_t index, Job &job);
+    bool _tryExecute(uint32_t index);
+    void _execute(uint32_t index, Job &job);
+    void _finish(JobCounter *counter);
+    uint32_t _currentIndex() const;
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::unique_ptr<ThreadStats>> _stats;
+    std::vector<std::thread> _workers;
+
+    std::atomic<uint32_t> _queuedJobs{0};
+    std::atomic<uint32_t> _nextQueue{0};
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+    bool _stop = false;
+};
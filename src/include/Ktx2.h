@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// Header and level index of a KTX2 container. Only the metadata is read up
+// front; mip payloads are read on demand so they can be streamed from worker
+// threads without keeping the whole file in memory.
+class Ktx2File {
+   public:
+    static Ktx2File open(const std::string &filename);
+
+    // Safe to call from any thread, every call opens its own stream
+    std::vector<char> readLevel(uint32_t level) const;
+    VkExtent2D levelExtent(uint32_t level) const;
+
+    std::string filename;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levelCount = 0;
+    std::vector<Ktx2Level> levels;
+};
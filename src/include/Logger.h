@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// Messages waiting for the writer thread, a power of two
+#define LOG_QUEUE_SIZE 4096
+// Encoded arguments stored in the queue slot itself, longer messages go to the heap
+#define LOG_INLINE_PAYLOAD 240
+// A repeated message is printed this many times before further repeats are suppressed
+#define LOG_REPEAT_LIMIT 5
+#define LOG_REPEAT_SLOTS 1024
+// How long the writer sleeps when the queue ran empty
+#define LOG_WRITER_IDLE_MS 2
+
+#define LOG_LEVEL_VERBOSE 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+
+// Messages below LOG_LEVEL are compiled out, their arguments are never evaluated
+#ifndef LOG_LEVEL
+#ifdef VERBOSE
+#define LOG_LEVEL LOG_LEVEL_VERBOSE
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define LOG_AT(level, severity, ...)                              \
+    do {                                                          \
+        if constexpr (LOG_LEVEL <= level) {                       \
+            Logger::get().log(LogLevel::severity, __VA_ARGS__);   \
+        }                                                         \
+    } while (0)
+
+// Arguments are concatenated, LOG_INFO("Created ", count, " buffers")
+#define LOG_VERBOSE(...) LOG_AT(LOG_LEVEL_VERBOSE, Verbose, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, Info, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LOG_LEVEL_WARNING, Warning, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, Error, __VA_ARGS__)
+
+enum class LogLevel : uint8_t {
+    Verbose,
+    Info,
+    Warning,
+    Error,
+};
+
+// Asynchronous logger. Callers only encode their arguments, numbers as raw
+// values and strings as copies, into a slot of a lock-free queue. A background
+// thread turns them into text and writes them to stdout / stderr, and to an
+// optional binary log holding the encoded records as they are.
+//
+// Binary log layout: the magic "VKLOG\1\0\0", then per record the timestamp in
+// nanoseconds (u64), thread index (u32), level (u8), payload size (u32) and the
+// payload. Every payload argument is a tag byte followed by its value, see ArgTag.
+class Logger {
+   public:
+    enum class ArgTag : uint8_t {
+        Int,      // i64
+        UInt,     // u64
+        Float,    // f64
+        Bool,     // u8
+        Char,     // u8
+        String,   // u32 length, then the bytes
+        Pointer,  // u64
+    };
+
+    static Logger &get();
+
+    template <typename... Args>
+    void log(LogLevel level, const Args &...args) {
+        std::string &payload = _scratch();
+        payload.clear();
+        (_encode(payload, args), ...);
+        _push(level, payload);
+    }
+
+    // False once `key` was seen LOG_REPEAT_LIMIT times, keys colliding in the table share a count
+    bool allowRepeat(uint64_t key);
+
+    // Also writes every record to `filename`, returns false when it cannot be opened
+    bool openBinaryLog(const std::string &filename);
+    // Blocks until everything logged so far was written
+    void flush();
+    // Flushes and stops the writer, later messages are written by the caller
+    void shutdown();
+
+   private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        uint64_t time = 0;
+        uint32_t thread = 0;
+        LogLevel level = LogLevel::Info;
+        uint32_t size = 0;
+        std::unique_ptr<char[]> overflow;
+        char payload[LOG_INLINE_PAYLOAD];
+    };
+
+    Logger();
+    ~Logger();
+
+    static std::string &_scratch();
+    static uint32_t _threadIndex();
+
+    template <typename T>
+    static void _append(std::string &payload, ArgTag tag, T value) {
+        payload.push_back(static_cast<char>(tag));
+        payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    static void _appendString(std::string &payload, std::string_view text) {
+        _append(payload, ArgTag::String, static_cast<uint32_t>(text.size()));
+        payload.append(text.data(), text.size());
+    }
+
+    template <typename T>
+    static void _encode(std::string &payload, const T &value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            _append(payload, ArgTag::Bool, static_cast<uint8_t>(value));
+        } else if constexpr (std::is_same_v<T, char>) {
+            _append(payload, ArgTag::Char, value);
+        } else if constexpr (std::is_enum_v<T>) {
+            _encode(payload, static_cast<std::underlying_type_t<T>>(value));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            _append(payload, ArgTag::Int, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<T>) {
+            _append(payload, ArgTag::UInt, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            _append(payload, ArgTag::Float, static_cast<double>(value));
+        } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+            _appendString(payload, std::string_view(value));
+        } else if constexpr (std::is_pointer_v<T>) {
+            _append(payload, ArgTag::Pointer, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+        } else {
+            static_assert(std::is_same_v<T, void>, "Unsupported log argument, format it into a string first");
+        }
+    }
+
+    void _push(LogLevel level, const std::string &payload);
+    bool _pop(Slot *&slot);
+    bool _drain();
+    void _write(const Slot &slot);
+    void _writerLoop();
+
+    std::unique_ptr<Slot[]> _slots;
+    alignas(64) std::atomic<uint64_t> _tail{0};
+    alignas(64) uint64_t _head = 0;
+    std::atomic<uint64_t> _written{0};
+    std::atomic<uint64_t> _dropped{0};
+    uint64_t _startNanoseconds;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> _repeats;
+    std::atomic<uint64_t> _suppressed{0};
+
+    std::ofstream _binaryLog;
+    std::atomic<bool> _binaryLogOpen{false};
+    std::atomic<bool> _stop{false};
+    std::thread _writer;
+    // Set once the writer has exited, from then on callers write on their own thread
+    // under the mutex, which also covers the final drain and closing the binary log
+    std::atomic<bool> _joined{false};
+    std::mutex _directMutex;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+enum class MemoryCategory : uint32_t {
+    Vertex,
+    Index,
+    Uniform,
+    Staging,
+    Texture,
+    Attachment,
+    // Compute inputs and outputs, indirect commands
+    Storage,
+    // Host visible copies of GPU results
+    Readback,
+    Count
+};
+
+struct MemoryCounters {
+    VkDeviceSize liveBytes = 0;
+    VkDeviceSize peakBytes = 0;
+    uint32_t liveAllocations = 0;
+    uint64_t totalAllocations = 0;
+};
+
+// Accounts for every VkDeviceMemory allocated through Utils, by category and
+// by heap. With VK_EXT_memory_budget the heap budgets and the usage of the
+// whole process come from the driver, and allocations made since the last poll
+// are added on top. Without it the budget is a fixed share of the heap size and
+// only our own allocations count. A warning is printed once a heap gets close
+// to its budget, before allocations start failing or the driver starts paging.
+class MemoryTelemetry {
+   public:
+    // Process wide, so Utils can account for allocations without every subsystem holding a pointer
+    static MemoryTelemetry &get();
+    static const char *categoryName(MemoryCategory category);
+
+    // Call once the device exists, `memoryBudget` when VK_EXT_memory_budget is enabled
+    void init(VkPhysicalDevice physicalDevice, bool memoryBudget);
+
+    void track(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size, MemoryCategory category);
+    void untrack(VkDeviceMemory memory);
+
+    // Refreshes the driver's budget and usage, cheap enough to call every few frames
+    void pollBudget();
+
+    MemoryCounters getCategoryCounters(MemoryCategory category) const;
+    // Every category together, the peak is of the sum rather than a sum of peaks
+    MemoryCounters getTotalCounters() const;
+    MemoryCounters getHeapCounters(uint32_t heap) const;
+    uint32_t getHeapCount() const;
+    VkDeviceSize getHeapBudget(uint32_t heap) const;
+    // Usage of the heap by the whole process as far as we know it
+    VkDeviceSize getHeapUsage(uint32_t heap) const;
+
+    // Starts every peak over from the current live bytes
+    void resetPeaks();
+
+    void report() const;
+    // Lists every allocation that was never freed, returns how many there are
+    size_t reportLeaks() const;
+
+   private:
+    struct Allocation {
+        VkDeviceSize size;
+        uint32_t heap;
+        MemoryCategory category;
+    };
+
+    struct Heap {
+        VkDeviceSize size = 0;
+        bool deviceLocal = false;
+        VkDeviceSize budget = 0;
+        // Driver reported usage and our live bytes at the last poll
+        VkDeviceSize polledUsage = 0;
+        VkDeviceSize polledLiveBytes = 0;
+        bool warned = false;
+        MemoryCounters counters;
+    };
+
+    static void _add(MemoryCounters &counters, VkDeviceSize size);
+    VkDeviceSize _usage(const Heap &heap) const;
+    void _checkBudget(uint32_t heapIndex);
+
+    mutable std::mutex _mutex;
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    bool _memoryBudget = false;
+    std::vector<uint32_t> _typeHeaps;
+    std::vector<Heap> _heaps;
+    std::array<MemoryCounters, static_cast<size_t>(MemoryCategory::Count)> _categories{};
+    MemoryCounters _total;
+    std::unordered_map<VkDeviceMemory, Allocation> _allocations;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#define MESH_LOD_MAX_LEVELS 8
+
+struct MeshLod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    // Largest geometric deviation from the full detail mesh, in object space units
+    float error = 0.0f;
+};
+
+// Every level of detail of a mesh. All levels share the vertices of the full
+// mesh, only the index ranges differ, so one vertex buffer serves the chain.
+struct MeshLodChain {
+    std::vector<uint32_t> indices;
+    std::vector<MeshLod> lods;
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+// Quadric error edge collapse. Vertices only ever collapse onto one of their
+// neighbours, open borders and attribute seams (split vertices) are kept in
+// place. Returns at least `targetIndexCount` indices unless the mesh could
+// not be reduced that far, and the largest error introduced.
+std::vector<uint32_t> simplifyMesh(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, size_t targetIndexCount, float &error);
+
+// Builds LODs at import time by halving the triangle count each level until it
+// stops paying off. Level 0 is the input itself.
+MeshLodChain buildLodChain(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices);
+
+// Picks the coarsest level whose error projects to fewer than `thresholdPixels`
+// on screen. Moving to a coarser level needs the error to be `hysteresis`
+// below the threshold, so an object sitting at a boundary does not flicker
+// between two levels.
+class LodSelector {
+   public:
+    explicit LodSelector(float thresholdPixels = 1.0f, float hysteresis = 0.25f);
+
+    // `projectionScale` is proj[1][1] * viewportHeight / 2, the pixels covered by one unit at distance one
+    uint32_t select(const MeshLodChain &chain, float distance, float projectionScale, uint32_t current) const;
+
+   private:
+    float _thresholdPixels;
+    float _hysteresis;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// std430 layout, must match meshlet_cull_shader.glsl
+struct Meshlet {
+    glm::vec3 center;
+    float radius;
+    // Back facing from every point where dot(normalize(center - eye), coneAxis) >= coneCutoff,
+    // padded by the radius. A cutoff of 1 disables the cone test.
+    glm::vec3 coneAxis;
+    float coneCutoff;
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+struct MeshletMesh {
+    std::vector<Meshlet> meshlets;
+    // Mesh vertex index of every meshlet local vertex
+    std::vector<uint32_t> vertices;
+    // One entry per triangle, three 8 bit meshlet local vertex indices
+    std::vector<uint32_t> triangles;
+};
+
+struct MeshletRange {
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+};
+
+// Splits an indexed triangle list into meshlets greedily in index order, so
+// a mesh that is already optimized for vertex cache locality gives compact
+// clusters. Counter-clockwise triangles are front facing.
+MeshletMesh buildMeshlets(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices);
+
+// Appends the meshlets of `other` to `mesh`, used to keep every LOD of a mesh in one set of buffers
+MeshletRange appendMeshlets(MeshletMesh &mesh, const MeshletMesh &other);
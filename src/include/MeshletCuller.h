@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Meshlet.h"
+
+// Culls the meshlets of one mesh on the GPU every frame. A compute pass tests
+// each cluster against the view frustum and its normal cone and appends the
+// triangles of the survivors to a per-frame index buffer, along with the
+// indirect draw command that renders them. Plain compute and indirect draws,
+// so it works on any Vulkan 1.1 device without mesh shaders.
+//
+// With occlusion culling the frame runs in two phases. The prepass draws the
+// meshlets that were visible last frame into a depth pre-pass, the caller
+// reduces that depth into a HiZBuffer, and the final pass tests every meshlet
+// against the pyramid. Meshlets that were hidden last frame but show up now
+// are caught by the final pass, and its results become next frame's prepass set.
+class MeshletCuller {
+   public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, uint32_t framesInFlight, const MeshletMesh &mesh, bool occlusion = false);
+    void cleanup();
+
+    // Points the final pass at the depth pyramid, call again whenever it was recreated.
+    // Only with occlusion, and before the first frame is recorded.
+    void setHiZ(VkImageView view, VkSampler sampler, VkExtent2D size, uint32_t mipCount);
+
+    // Records the frustum and cone test of the meshlets visible last frame into the
+    // prepass buffers, outside a render pass. Only with occlusion.
+    void recordPrepass(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &proj, MeshletRange range);
+    // Records the culling pass over `range`, outside a render pass. The results are
+    // ready for vertex input and indirect draws once the command buffer reaches the draw.
+    // With occlusion this is the final pass, the pyramid must already be built for
+    // this frame and the matrices must match the prepass.
+    void record(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &proj, MeshletRange range);
+    // Both passes read the matrices from a per-frame buffer, so a recording can be submitted
+    // again with new ones written here instead of being recorded anew
+    void updateParams(uint32_t frame, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &proj);
+
+    // Indices are 32 bit and refer to the mesh's own vertices
+    VkBuffer getIndexBuffer(uint32_t frame) const { return _frames[frame].main.indexBuffer; }
+    VkBuffer getDrawBuffer(uint32_t frame) const { return _frames[frame].main.drawBuffer; }
+    VkBuffer getPrepassIndexBuffer(uint32_t frame) const { return _frames[frame].prepass.indexBuffer; }
+    VkBuffer getPrepassDrawBuffer(uint32_t frame) const { return _frames[frame].prepass.drawBuffer; }
+    uint32_t getMeshletCount() const { return _meshletCount; }
+
+   private:
+    struct PassResources {
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+        VkBuffer drawBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory drawBufferMemory = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+
+    struct FrameResources {
+        VkBuffer paramsBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory paramsBufferMemory = VK_NULL_HANDLE;
+        void *paramsMapped = nullptr;
+        PassResources main;
+        PassResources prepass;
+    };
+
+    void _createPipeline();
+    void _createStaticBuffer(const void *data, VkDeviceSize size, VkBuffer &buffer, VkDeviceMemory &memory);
+    void _createPass(const FrameResources &frame, VkDeviceSize indexBufferSize, PassResources &pass);
+    void _destroyPass(PassResources &pass);
+    void _dispatch(VkCommandBuffer commandBuffer, const PassResources &pass, MeshletRange range, uint32_t mode);
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueue _queue = VK_NULL_HANDLE;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+
+    VkDescriptorSetLayout _descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+
+    uint32_t _meshletCount = 0;
+    VkBuffer _meshletBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _meshletBufferMemory = VK_NULL_HANDLE;
+    VkBuffer _vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _vertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer _triangleBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _triangleBufferMemory = VK_NULL_HANDLE;
+
+    bool _occlusion = false;
+    // One flag per meshlet, written by the final pass and read by the next frame's prepass
+    VkBuffer _visibilityBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _visibilityBufferMemory = VK_NULL_HANDLE;
+    VkExtent2D _hizSize{};
+    uint32_t _hizMipCount = 0;
+
+    std::vector<FrameResources> _frames;
+};
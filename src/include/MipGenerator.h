@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+enum class MipFilter {
+    Box,
+    Min,
+    Max
+};
+
+// Generates mip chains on the GPU. Formats with storage image support go
+// through a single dispatch compute downsampler, everything else falls back
+// to a chain of vkCmdBlitImage calls (box filter only).
+class MipGenerator {
+   public:
+    // Without `extendedUsage` sRGB images cannot be written through a UNORM storage view and are blitted
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, bool dynamicIndexing, bool extendedUsage);
+    void cleanup();
+
+    // Adds the usage and create flags `generate` needs for this format
+    void prepareImageInfo(VkImageCreateInfo &imageInfo) const;
+    // Usage to restrict sampled views of an image prepared above to, 0 when the view can inherit the image's
+    VkImageUsageFlags sampledViewUsage(const VkImageCreateInfo &imageInfo) const;
+
+    // Records generation of levels 1..mipLevels-1 from level 0. All levels must be in
+    // TRANSFER_DST_OPTIMAL and are left in SHADER_READ_ONLY_OPTIMAL.
+    void generate(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, MipFilter filter);
+
+    // Frees the views and descriptor sets of every recorded generate call, the caller
+    // must make sure those command buffers have finished executing
+    void releaseTransientResources();
+
+   private:
+    enum StorageFormat {
+        STORAGE_RGBA8,
+        STORAGE_RGBA16F,
+        STORAGE_R32F,
+        STORAGE_FORMAT_COUNT,
+        STORAGE_UNSUPPORTED = STORAGE_FORMAT_COUNT
+    };
+
+    StorageFormat _storageFormat(VkFormat format, VkFormat &viewFormat, bool &srgb) const;
+    void _generateCompute(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, MipFilter filter);
+    void _generateBlit(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels);
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    bool _computeAvailable = false;
+    bool _extendedUsage = false;
+
+    VkDescriptorSetLayout _descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    std::array<VkPipeline, STORAGE_FORMAT_COUNT> _pipelines{};
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    VkBuffer _counterBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _counterBufferMemory = VK_NULL_HANDLE;
+
+    std::vector<VkImageView> _transientViews;
+};
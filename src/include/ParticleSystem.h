@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// GPU particles simulated entirely in compute and drawn indirectly. Particle
+// state lives in separate arrays (position and age, velocity and lifetime)
+// that are double buffered: step n reads set (n - 1) % 2 and writes set n % 2.
+// Every step simulates the particles alive in the previous set and compacts
+// the survivors into a new alive list, returns the dead to a free list, emits
+// new particles from the free list, then bitonic sorts the alive particles
+// back to front and writes the indirect draw and next step's dispatch size.
+//
+// With a compute only queue the steps are submitted there and overlap the
+// graphics work of the same frame: the frame draws the previous step's set,
+// and two timeline semaphores order the queues, step n waits for frame n - 1
+// to finish drawing the set it overwrites and frame n waits for step n - 1.
+// Without one the step is recorded into the frame's command buffer before
+// the render pass and the frame draws it right away.
+class ParticleSystem {
+   public:
+    // `computeQueue` is VK_NULL_HANDLE for the single queue path. The draw pipeline
+    // is built against `renderPass`, `capacity` is the most particles alive at once.
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue graphicsQueue, uint32_t graphicsFamily, VkQueue computeQueue, uint32_t computeFamily,
+              uint32_t framesInFlight, uint32_t capacity, VkRenderPass renderPass, VkSampleCountFlagBits samples);
+    void cleanup();
+
+    bool isAsync() const { return _computeQueue != VK_NULL_HANDLE; }
+
+    // Starts step n + 1 with the frame's time step and camera, once per frame
+    void beginFrame(float deltaTime, const glm::mat4 &view);
+    // Async only: records and submits the step on the compute queue
+    void submit();
+    // Single queue only: records the step into the frame's command buffer, outside a render pass
+    void record(VkCommandBuffer commandBuffer);
+    // Draws the newest set the frame may read, inside the render pass with the viewport set
+    void draw(VkCommandBuffer commandBuffer, const glm::mat4 &view, const glm::mat4 &proj);
+
+    // Async only: the frame's graphics submit waits for the compute timeline at
+    // getGraphicsWaitValue and signals the graphics timeline to getGraphicsSignalValue
+    VkSemaphore getComputeTimeline() const { return _computeTimeline; }
+    VkSemaphore getGraphicsTimeline() const { return _graphicsTimeline; }
+    uint64_t getGraphicsWaitValue() const { return _step - 1; }
+    uint64_t getGraphicsSignalValue() const { return _step; }
+
+   private:
+    struct ParticleSet {
+        VkBuffer positions = VK_NULL_HANDLE;
+        VkDeviceMemory positionsMemory = VK_NULL_HANDLE;
+        VkBuffer velocities = VK_NULL_HANDLE;
+        VkDeviceMemory velocitiesMemory = VK_NULL_HANDLE;
+        VkBuffer alive = VK_NULL_HANDLE;
+        VkDeviceMemory aliveMemory = VK_NULL_HANDLE;
+        // Sort key and particle index pairs, ordered back to front after the step
+        VkBuffer sorted = VK_NULL_HANDLE;
+        VkDeviceMemory sortedMemory = VK_NULL_HANDLE;
+        // Alive count, next step's dispatch and the draw, see ParticleArgs
+        VkBuffer args = VK_NULL_HANDLE;
+        VkDeviceMemory argsMemory = VK_NULL_HANDLE;
+
+        // The simulation set reads the other set and writes this one
+        VkDescriptorSet simulateSet = VK_NULL_HANDLE;
+        VkDescriptorSet sortSet = VK_NULL_HANDLE;
+        VkDescriptorSet drawSet = VK_NULL_HANDLE;
+    };
+
+    void _createBuffers();
+    void _createDescriptors();
+    void _createComputePipelines();
+    void _createDrawPipeline(VkRenderPass renderPass, VkSampleCountFlagBits samples);
+    void _createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer, VkDeviceMemory &memory);
+    VkPipeline _createComputePipeline(const char *filename, VkPipelineLayout layout);
+    void _recordStep(VkCommandBuffer commandBuffer);
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueue _graphicsQueue = VK_NULL_HANDLE;
+    VkQueue _computeQueue = VK_NULL_HANDLE;
+    // Both families when they differ, buffers are shared between them without ownership transfers
+    std::vector<uint32_t> _queueFamilies;
+    VkCommandPool _uploadPool = VK_NULL_HANDLE;
+    VkCommandPool _computePool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> _computeCommandBuffers;
+
+    uint32_t _capacity = 0;
+    // Capacity rounded up to a power of two of at least one sort workgroup
+    uint32_t _sortSize = 0;
+
+    std::array<ParticleSet, 2> _sets;
+    VkBuffer _dead = VK_NULL_HANDLE;
+    VkDeviceMemory _deadMemory = VK_NULL_HANDLE;
+    VkBuffer _counters = VK_NULL_HANDLE;
+    VkDeviceMemory _countersMemory = VK_NULL_HANDLE;
+
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _simulateSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _sortSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _drawSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _simulateLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _sortLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _drawLayout = VK_NULL_HANDLE;
+    VkPipeline _simulatePipeline = VK_NULL_HANDLE;
+    VkPipeline _sortPipeline = VK_NULL_HANDLE;
+    VkPipeline _drawPipeline = VK_NULL_HANDLE;
+
+    VkSemaphore _computeTimeline = VK_NULL_HANDLE;
+    VkSemaphore _graphicsTimeline = VK_NULL_HANDLE;
+
+    // Steps begun so far, step n writes set n % 2
+    uint64_t _step = 0;
+    float _deltaTime = 0.0f;
+    float _time = 0.0f;
+    // Fraction of a particle carried over to the next step's emission
+    float _emitRemainder = 0.0f;
+    uint32_t _emitCount = 0;
+    glm::vec3 _cameraPosition{0.0f};
+    glm::vec3 _cameraForward{0.0f, 0.0f, -1.0f};
+};
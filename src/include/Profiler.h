@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_TSC 1
+#endif
+
+// Events kept per thread, the oldest are overwritten once a ring is full
+#define PROFILER_RING_SIZE (1u << 14)
+
+// Scoped CPU zones, on by default. Building with -DDISABLE_PROFILER compiles
+// every zone out. `name` must be a string literal or otherwise outlive the profiler.
+#ifndef DISABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#endif
+
+// Flight recorder for timed zones. Every thread writes into its own ring of
+// fixed size events without locks, recording a zone costs two timestamp reads
+// and a handful of stores, so it can stay enabled in release builds. The rings
+// always hold the most recent events and can be exported at any time as a
+// Chrome tracing / Perfetto JSON file, along with GPU zones fed in by GpuTimer.
+class Profiler {
+   public:
+    struct Event {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> begin{0};
+        std::atomic<uint64_t> end{0};
+    };
+
+    // Written by one thread only, read by the exporter
+    struct Track {
+        std::string name;
+        uint32_t id = 0;
+        // GPU tracks are fed steady clock nanoseconds instead of CPU ticks
+        bool steadyClock = false;
+        std::atomic<uint64_t> head{0};
+        std::unique_ptr<Event[]> events;
+    };
+
+    static Profiler &get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // Raw timestamp, the time stamp counter where there is one
+    static uint64_t ticks() {
+#ifdef PROFILER_TSC
+        return __rdtsc();
+#else
+        return nanoseconds();
+#endif
+    }
+
+    // Current steady clock time, the domain GPU zones are converted to
+    static uint64_t nanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Names the calling thread's track in exported traces
+    void setThreadName(const std::string &name);
+    // A track for zones with explicit nanosecond timestamps, written by a single thread
+    Track *createTrack(const std::string &name);
+
+    void record(Track &track, const char *name, uint64_t begin, uint64_t end) {
+        uint64_t head = track.head.load(std::memory_order_relaxed);
+        Event &event = track.events[head & (PROFILER_RING_SIZE - 1)];
+        event.name.store(name, std::memory_order_relaxed);
+        event.begin.store(begin, std::memory_order_relaxed);
+        event.end.store(end, std::memory_order_relaxed);
+        track.head.store(head + 1, std::memory_order_release);
+    }
+
+    Track &threadTrack() {
+        static thread_local Track *track = nullptr;
+        if (track == nullptr) {
+            track = _createThreadTrack();
+        }
+        return *track;
+    }
+
+    // Writes the events currently held by every ring, safe while other threads keep recording
+    bool exportChromeTrace(const std::string &filename);
+
+   private:
+    Profiler();
+
+    Track *_createThreadTrack();
+    Track *_addTrack(const std::string &name, bool steadyClock);
+
+    // Anchors for converting ticks to steady clock nanoseconds
+    uint64_t _startTicks;
+    uint64_t _startNanoseconds;
+
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Track>> _tracks;
+};
+
+class ProfileZone {
+   public:
+    explicit ProfileZone(const char *name) : _name(name), _begin(Profiler::ticks()) {}
+    ~ProfileZone() { Profiler::get().record(Profiler::get().threadTrack(), _name, _begin, Profiler::ticks()); }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+   private:
+    const char *_name;
+    uint64_t _begin;
+};
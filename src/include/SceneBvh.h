@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Bounds.h"
+
+class JobSystem;
+
+// Children per node, matching the widest float vector the build targets
+#if defined(__AVX2__)
+#define BVH_WIDTH 8
+#else
+#define BVH_WIDTH 4
+#endif
+
+struct RayHit {
+    uint32_t object = UINT32_MAX;
+    float distance = 0.0f;
+};
+
+// Spatial index over the bounding boxes of scene objects. Built top-down with
+// a binned surface area heuristic and collapsed into BVH_WIDTH-wide nodes
+// whose child bounds are stored structure-of-arrays, so one SIMD pass tests
+// every child of a node against a frustum plane. Every subtree owns a
+// contiguous range of objects, so a node entirely inside the frustum is
+// emitted without visiting its children.
+//
+// Moving objects only refit the bounds along their path to the root. Objects
+// added since the last build are not visible to queries until update().
+class SceneBvh {
+   public:
+    // Ids are handed out densely from zero
+    uint32_t add(const Aabb &bounds);
+    void setBounds(uint32_t object, const Aabb &bounds);
+    // Rebuilds when objects were added, refits the changed paths otherwise
+    void update();
+    void build();
+
+    // Appends the ids of objects whose bounds touch the frustum. With a job
+    // system, subtrees below the first few levels are traversed in parallel.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible, JobSystem *jobSystem = nullptr);
+
+    // Nearest object whose bounds the ray enters within `maxDistance`. When
+    // given, `intersect` tests the object itself and returns the hit distance
+    // or a negative value for a miss, otherwise the box entry point counts.
+    RayHit raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, const std::function<float(uint32_t object)> &intersect = nullptr) const;
+
+    uint32_t getObjectCount() const { return static_cast<uint32_t>(_bounds.size()); }
+    uint32_t getNodeCount() const { return static_cast<uint32_t>(_nodes.size()); }
+
+   private:
+    struct alignas(32) Node {
+        float minX[BVH_WIDTH];
+        float minY[BVH_WIDTH];
+        float minZ[BVH_WIDTH];
+        float maxX[BVH_WIDTH];
+        float maxY[BVH_WIDTH];
+        float maxZ[BVH_WIDTH];
+        // Node index, BVH_LEAF_BIT | position in _order, or BVH_EMPTY_SLOT
+        uint32_t child[BVH_WIDTH];
+        uint32_t parent;
+        uint32_t parentSlot;
+        // Objects of the whole subtree, _order[first, first + count)
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct BuildNode {
+        Aabb bounds;
+        uint32_t first;
+        uint32_t count;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    struct CullTask {
+        uint32_t node;
+        uint32_t planeMask;
+    };
+
+    uint32_t _buildBinary(std::vector<BuildNode> &nodes);
+    void _collapse(const std::vector<BuildNode> &nodes, uint32_t root);
+    void _setSlot(Node &node, uint32_t slot, const Aabb &bounds);
+    Aabb _nodeBounds(const Node &node) const;
+    void _refit();
+    uint32_t _testChildren(const Node &node, const Frustum &frustum, uint32_t planeMask, uint32_t *insideMasks) const;
+    void _cullNode(const Frustum &frustum, CullTask task, std::vector<uint32_t> &visible, std::vector<CullTask> *deferred) const;
+    void _emitRange(uint32_t first, uint32_t count, std::vector<uint32_t> &visible) const;
+
+    std::vector<Aabb> _bounds;
+    // Object ids in tree order
+    std::vector<uint32_t> _order;
+    // Node and slot holding each object
+    std::vector<uint32_t> _objectNode;
+    std::vector<uint8_t> _objectSlot;
+
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _dirtyNodes;
+    std::vector<bool> _nodeDirty;
+    bool _needsBuild = false;
+
+    std::vector<CullTask> _frontier;
+    std::vector<std::vector<uint32_t>> _taskResults;
+};
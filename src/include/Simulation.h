@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include "TripleBuffer.h"
+
+// Everything the renderer needs from the simulation for one tick
+struct SceneState {
+    float rotation = 0.0f;
+    glm::vec3 cameraPosition = glm::vec3(2.0f, 2.0f, 2.0f);
+    glm::vec3 cameraTarget = glm::vec3(0.0f);
+};
+
+struct SimulationSnapshot {
+    SceneState previous;
+    SceneState current;
+    uint64_t tick = 0;
+    std::chrono::steady_clock::time_point tickTime;
+};
+
+// Advances the scene at a fixed rate on its own thread and publishes immutable
+// snapshots through a triple buffer, so a slow frame never slows the
+// simulation down and the renderer never waits for a tick.
+class Simulation {
+   public:
+    void start(uint32_t tickRate);
+    void stop();
+
+    // Single consumer: any thread may call it, but calls must be ordered externally and never
+    // overlap, each one takes over the triple buffer's read slot. Blends the last two ticks so
+    // motion stays smooth when the frame rate and tick rate differ, at the cost of one tick of latency.
+    SceneState sample(std::chrono::steady_clock::time_point time);
+    uint64_t getTickCount() const { return _tickCount.load(std::memory_order_relaxed); }
+    // A paused simulation stops stepping, samples settle on the last tick
+    void setPaused(bool paused) { _paused.store(paused, std::memory_order_relaxed); }
+    bool isPaused() const { return _paused.load(std::memory_order_relaxed); }
+
+   private:
+    void _threadLoop();
+    void _step(SceneState &state, float deltaTime);
+    void _publish(const SceneState &previous, std::chrono::steady_clock::time_point tickTime);
+
+    std::thread _thread;
+    std::atomic<bool> _running{false};
+    std::atomic<bool> _paused{false};
+    std::chrono::nanoseconds _tickInterval{0};
+
+    // Owned by the simulation thread once it is running
+    SceneState _state;
+    std::atomic<uint64_t> _tickCount{0};
+
+    TripleBuffer<SimulationSnapshot> _snapshots;
+};
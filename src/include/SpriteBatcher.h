@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+// Screen space vertex in pixels, must match sprite_vertex_shader.glsl
+struct SpriteVertex {
+    glm::vec2 position;
+    // 16 bit unorm u and v
+    uint32_t texCoord;
+    // 8 bit unorm RGBA
+    uint32_t color;
+
+    static uint32_t packTexCoord(const glm::vec2 &texCoord);
+    static uint32_t packColor(const glm::vec4 &color);
+};
+
+// Streams dynamic 2D geometry (sprites, lines and debug shapes) through a
+// persistently mapped vertex and index ring in host visible memory. Every
+// frame in flight owns one region of the ring, reused once the frame's fence
+// has signaled, and vertices are written straight into it with no staging
+// copy. Consecutive primitives with the same pipeline and texture are merged
+// into one indexed draw, so callers that group their submissions get few
+// draws while the order in which overlapping primitives blend is kept.
+//
+// Not thread safe, but the quads handed out by reserveQuads can be filled
+// from several threads before record() is called.
+class SpriteBatcher {
+   public:
+    // `maxQuads` bounds the vertices and indices written per frame, a line counts
+    // as half a quad. Lines and untextured shapes sample `whiteTexture`.
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, uint32_t maxQuads, VkRenderPass renderPass, VkSampleCountFlagBits samples,
+              VkSampler sampler, VkImageView whiteTexture);
+    void cleanup();
+
+    // Call after the frame's fence was waited on, drops what the frame drew last time
+    void beginFrame(uint32_t frame);
+
+    // Reserves `count` textured quads whose indices are already written, the caller fills
+    // four vertices per quad (top left, top right, bottom right, bottom left).
+    // Returns nullptr when the frame's region cannot hold them.
+    SpriteVertex *reserveQuads(VkImageView texture, uint32_t count);
+
+    // `uvRect` holds the texture coordinates of the top left and bottom right corners
+    void drawSprite(VkImageView texture, const glm::vec2 &center, const glm::vec2 &size, float rotation, const glm::vec4 &uvRect, uint32_t color);
+    void fillRect(const glm::vec2 &min, const glm::vec2 &max, uint32_t color);
+    void drawLine(const glm::vec2 &from, const glm::vec2 &to, uint32_t color);
+    void drawRect(const glm::vec2 &min, const glm::vec2 &max, uint32_t color);
+    void drawCircle(const glm::vec2 &center, float radius, uint32_t color, uint32_t segments = 32);
+
+    // Draws the frame's batches inside a render pass whose viewport covers `extent`
+    void record(VkCommandBuffer commandBuffer, VkExtent2D extent);
+
+    uint32_t getDrawCount() const { return static_cast<uint32_t>(_frames[_frame].batches.size()); }
+    uint32_t getQuadCapacity() const { return _maxQuads; }
+
+   private:
+    enum Topology {
+        TOPOLOGY_TRIANGLES,
+        TOPOLOGY_LINES,
+        TOPOLOGY_COUNT
+    };
+
+    struct Batch {
+        Topology topology;
+        VkDescriptorSet textureSet;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    struct Frame {
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<std::pair<VkImageView, VkDescriptorSet>> textureSets;
+        std::vector<Batch> batches;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+    };
+
+    // Appends to the last batch when the topology and texture match. `baseVertex` is
+    // the first vertex's index relative to the frame's region.
+    SpriteVertex *_reserve(Topology topology, VkImageView texture, uint32_t vertexCount, uint32_t indexCount, uint32_t *&indices, uint32_t &baseVertex);
+    VkDescriptorSet _getTextureSet(VkImageView texture);
+
+    void _createDescriptors();
+    void _createPipelines(VkRenderPass renderPass, VkSampleCountFlagBits samples);
+
+    VkDevice _device = VK_NULL_HANDLE;
+    VkSampler _sampler = VK_NULL_HANDLE;
+    VkImageView _whiteTexture = VK_NULL_HANDLE;
+
+    uint32_t _maxQuads = 0;
+    uint32_t _vertexCapacity = 0;
+    uint32_t _indexCapacity = 0;
+
+    // One region of `_vertexCapacity` vertices and `_indexCapacity` indices per frame in flight
+    VkBuffer _vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _vertexMemory = VK_NULL_HANDLE;
+    SpriteVertex *_vertices = nullptr;
+    VkBuffer _indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory _indexMemory = VK_NULL_HANDLE;
+    uint32_t *_indices = nullptr;
+
+    std::vector<Frame> _frames;
+    uint32_t _frame = 0;
+    // Running out is reported once, not every frame
+    bool _warnedFull = false;
+    bool _warnedTextures = false;
+
+    VkDescriptorSetLayout _setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout _pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _pipelines[TOPOLOGY_COUNT] = {};
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Records how long every initialization step takes and the time until the
+// first frame was presented. Steps may be measured from any thread; the ones
+// that ran off the main thread are marked in the report so overlapping work
+// is easy to spot.
+class StartupProfiler {
+   public:
+    void begin();
+
+    template <typename Step>
+    void measure(const char *name, Step &&step) {
+        auto start = std::chrono::steady_clock::now();
+        step();
+        _record(name, start, std::chrono::steady_clock::now());
+    }
+
+    // Reports once, later calls are ignored
+    void markFirstFrame();
+    // Milliseconds from begin() to the first frame, 0 before there was one
+    double getTimeToFirstFrame() const;
+    void report() const;
+
+   private:
+    struct Record {
+        const char *name;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        bool mainThread;
+    };
+
+    void _record(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _firstFrame;
+    std::thread::id _mainThread;
+    bool _finished = false;
+
+    mutable std::mutex _mutex;
+    std::vector<Record> _records;
+};
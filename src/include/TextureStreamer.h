@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Ktx2.h"
+#include "MipGenerator.h"
+#include "ThreadPool.h"
+
+// Streams KTX2 textures in the background. The coarse mip tail of every
+// texture is always resident, finer mips are loaded one level at a time
+// (smallest first) by priority and evicted least-recently-used first when the
+// residency budget is exceeded.
+//
+// Without sparse residency a texture's resident mips live in their own image.
+// Promoting or evicting a level creates a new image for the new mip range,
+// copies the levels that are already on the GPU and uploads the new one from
+// a staging buffer. The old image is destroyed once no frame in flight can
+// reference it anymore.
+class TextureStreamer {
+   public:
+    static constexpr uint32_t INVALID_TEXTURE = UINT32_MAX;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, uint32_t queueFamily, MipGenerator *mipGenerator, uint32_t framesInFlight, VkDeviceSize budget);
+    void cleanup();
+
+    // Reads the container header synchronously and queues the mip tail load
+    uint32_t load(const std::string &filename);
+    // Uploads level 0 of a runtime generated texture and builds its mip chain on the GPU.
+    // These textures are always fully resident.
+    uint32_t create(uint32_t width, uint32_t height, VkFormat format, const void *pixels, VkDeviceSize size, MipFilter filter);
+    // Marks the texture as used this frame and asks for `mip` to be the finest resident level
+    void request(uint32_t texture, uint32_t mip, float priority);
+    // Call once per frame from the render thread
+    void update();
+
+    VkImageView getImageView(uint32_t texture) const;
+    VkSampler getSampler() const { return _sampler; }
+    VkDeviceSize getResidentBytes() const { return _residentBytes; }
+    // No load or upload in flight, the resident images stay as they are until a request changes
+    bool isIdle() const { return _loadsInFlight == 0 && _uploads.empty(); }
+
+   private:
+    struct ResidentImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t baseLevel = 0;
+        VkDeviceSize size = 0;
+    };
+
+    struct Texture {
+        Ktx2File ktx;
+        ResidentImage resident;
+        uint32_t tailLevel = 0;
+        uint32_t requestedLevel = 0;
+        float priority = 0.0f;
+        uint64_t lastUsedFrame = 0;
+        bool streamed = true;
+        bool busy = false;
+        bool failed = false;
+    };
+
+    struct LoadResult {
+        uint32_t texture;
+        uint32_t baseLevel;
+        std::vector<std::vector<char>> levels;
+        std::string error;
+    };
+
+    struct Upload {
+        uint32_t texture;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkBuffer stagingBuffer = VK_NULL_HANDLE;
+        VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+        ResidentImage image;
+        bool generatedMips = false;
+    };
+
+    struct PendingDelete {
+        uint64_t frame;
+        ResidentImage image;
+    };
+
+    void _createPlaceholder();
+    void _queueLoad(uint32_t texture, uint32_t firstLevel, uint32_t lastLevel);
+    void _collectLoads();
+    void _retireUploads();
+    void _releaseDeleted();
+    void _schedule();
+    bool _evictOne(uint32_t requester);
+    void _submitTransfer(uint32_t texture, uint32_t baseLevel, const std::vector<std::vector<char>> &newLevels);
+    void _beginUpload(Upload &upload);
+    void _submitUpload(Upload &upload);
+    VkImageCreateInfo _streamedImageInfo(const Ktx2File &ktx, uint32_t baseLevel) const;
+    // Memory an image of the levels from baseLevel down would take, measured like _residentBytes
+    VkDeviceSize _estimateSize(const Texture &texture, uint32_t baseLevel) const;
+    void _destroyImage(ResidentImage &image);
+
+    VkPhysicalDevice _physicalDevice = VK_NULL_HANDLE;
+    VkDevice _device = VK_NULL_HANDLE;
+    VkQueue _queue = VK_NULL_HANDLE;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    VkSampler _sampler = VK_NULL_HANDLE;
+    MipGenerator *_mipGenerator = nullptr;
+    uint32_t _mipUploadsInFlight = 0;
+    ResidentImage _placeholder;
+
+    uint32_t _framesInFlight = 2;
+    uint64_t _frame = 0;
+    VkDeviceSize _budget = 0;
+    VkDeviceSize _residentBytes = 0;
+    uint32_t _loadsInFlight = 0;
+
+    std::vector<Texture> _textures;
+    std::vector<Upload> _uploads;
+    std::vector<PendingDelete> _pendingDeletes;
+
+    std::unique_ptr<ThreadPool> _ioPool;
+    std::mutex _resultsMutex;
+    std::vector<LoadResult> _results;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer exchange of whole values without locks.
+// The producer fills writeBuffer() and publishes it, the consumer picks up the
+// newest published value with update(). Neither side ever waits: a value the
+// consumer never saw is simply overwritten by the next publish.
+template <typename T>
+class TripleBuffer {
+   public:
+    // Producer side
+    T &writeBuffer() { return _buffers[_writeIndex]; }
+    void publish() {
+        uint8_t previous = _shared.exchange(_writeIndex | DIRTY_BIT, std::memory_order_acq_rel);
+        _writeIndex = previous & INDEX_MASK;
+    }
+
+    // Consumer side, returns false when nothing new was published since the last call
+    bool update() {
+        if ((_shared.load(std::memory_order_relaxed) & DIRTY_BIT) == 0) {
+            return false;
+        }
+        uint8_t previous = _shared.exchange(_readIndex, std::memory_order_acq_rel);
+        _readIndex = previous & INDEX_MASK;
+        return true;
+    }
+    const T &read() const { return _buffers[_readIndex]; }
+
+   private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t DIRTY_BIT = 0x4;
+
+    std::array<T, 3> _buffers{};
+    // Producer and consumer indices live on separate cache lines so the two threads don't false share
+    alignas(64) uint8_t _writeIndex = 0;
+    alignas(64) std::atomic<uint8_t> _shared{1};
+    alignas(64) uint8_t _readIndex = 2;
+};
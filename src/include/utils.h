@@ -1,9 +1,38 @@
 #pragma once
 
+#include <vulkan/vulkan.h>
+
 #include <string>
 #include <vector>
 
+#include "MemoryTelemetry.h"
+
+#define UNI_RED "\033[0;31m"
+#define UNI_GREEN "\033[0;32m"
+#define UNI_YELLOW "\033[0;33m"
+#define UNI_BLUE "\033[0;34m"
+#define UNI_REDBACK "\033[41m"
+#define UNI_RESET "\033[0m"
+
 class Utils {
    public:
     static std::vector<char> readFile(const std::string& filename);
-};
\ No newline at end of file
+    // Escapes quotes and backslashes for a JSON string literal
+    static std::string escapeJson(const std::string& text);
+    // Reads SPIR-V from `filename`, the caller destroys the module
+    static VkShaderModule createShaderModule(VkDevice device, const std::string& filename);
+
+    static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    static bool tryFindMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties, uint32_t& typeIndex);
+    // `preferredProperties` are added to `properties` when a matching memory type exists.
+    // `allocateFlags` (e.g. VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT) need Vulkan 1.1.
+    // The memory is accounted to `category` in MemoryTelemetry until it is released with freeMemory.
+    // With more than one of `queueFamilies` the buffer is shared between them without ownership transfers.
+    static void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, MemoryCategory category, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory, VkMemoryPropertyFlags preferredProperties = 0, VkMemoryAllocateFlags allocateFlags = 0, const std::vector<uint32_t>& queueFamilies = {});
+    // Copies `data` into `buffer` at `offset` through a staging buffer and waits for the queue, meant for load time
+    static void uploadBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool, VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+    static void createImage(VkPhysicalDevice physicalDevice, VkDevice device, MemoryCategory category, const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, VkMemoryPropertyFlags preferredProperties = 0);
+    static void freeMemory(VkDevice device, VkDeviceMemory memory);
+    // A nonzero `usage` restricts the view to it, needed for views of extended usage images
+    static VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t levelCount, VkImageUsageFlags usage = 0);
+};
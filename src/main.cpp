@@ -1,18 +1,113 @@
 #include <cstdlib>
-#include <iostream>
+#include <cstring>
 #include <stdexcept>
+#include <string>
 
 #include "App.h"
+#include "Benchmark.h"
+#include "Logger.h"
 
-int main() {
-    App app;
+static AppOptions parseOptions(int argc, char** argv) {
+    AppOptions options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--device") == 0 && hasValue) {
+            options.device = argv[++i];
+        } else if (strcmp(argv[i], "--msaa") == 0 && hasValue) {
+            options.msaaSamples = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+            options.maxFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--sim-rate") == 0 && hasValue) {
+            options.simulationRate = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--no-meshlet-culling") == 0) {
+            options.meshletCulling = false;
+        } else if (strcmp(argv[i], "--no-occlusion-culling") == 0) {
+            options.occlusionCulling = false;
+        } else if (strcmp(argv[i], "--no-lods") == 0) {
+            options.meshLods = false;
+        } else if (strcmp(argv[i], "--capture") == 0 && hasValue) {
+            options.captureDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--capture-frames") == 0 && hasValue) {
+            options.captureFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--capture-format") == 0 && hasValue) {
+            std::string format = argv[++i];
+            if (format == "ppm") {
+                options.captureFormat = CaptureFormat::PPM;
+            } else if (format == "png") {
+                options.captureFormat = CaptureFormat::PNG;
+            } else if (format == "raw") {
+                options.captureFormat = CaptureFormat::Raw;
+            } else {
+                throw std::runtime_error("Unknown capture format: " + format);
+            }
+        } else if (strcmp(argv[i], "--trace") == 0 && hasValue) {
+            options.traceFile = argv[++i];
+        } else if (strcmp(argv[i], "--binary-log") == 0 && hasValue) {
+            Logger::get().openBinaryLog(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            options.recordFile = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            options.replayFile = argv[++i];
+        } else if (strcmp(argv[i], "--particles") == 0 && hasValue) {
+            options.particleCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--no-async-compute") == 0) {
+            options.asyncCompute = false;
+        } else if (strcmp(argv[i], "--sprites") == 0 && hasValue) {
+            options.spriteCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--debug-bounds") == 0) {
+            options.debugBounds = true;
+        } else if (strcmp(argv[i], "--lights") == 0 && hasValue) {
+            options.lightCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--extra-views") == 0 && hasValue) {
+            options.extraViews = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (strcmp(argv[i], "--dynamic-resolution") == 0 && hasValue) {
+            options.targetGpuMilliseconds = std::stof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-resolution-scale") == 0 && hasValue) {
+            options.minResolutionScale = std::stof(argv[++i]);
+        } else if (strcmp(argv[i], "--sharpness") == 0 && hasValue) {
+            options.upscaleSharpness = std::stof(argv[++i]);
+        } else if (strcmp(argv[i], "--no-command-reuse") == 0) {
+            options.reuseCommandBuffers = false;
+        } else if (strcmp(argv[i], "--on-demand") == 0) {
+            options.onDemand = true;
+        } else if (strcmp(argv[i], "--replay-loops") == 0 && hasValue) {
+            options.replayLoops = static_cast<uint32_t>(std::stoul(argv[++i]));
+#ifdef FRAME_REPLAYER
+        } else if (argv[i][0] != '-' && options.replayFile.empty()) {
+            options.replayFile = argv[i];
+#endif
+        } else {
+            throw std::runtime_error(std::string("Unknown argument: ") + argv[i]);
+        }
+    }
+#ifdef FRAME_REPLAYER
+    // The replayer target only replays
+    if (options.replayFile.empty()) {
+        throw std::runtime_error("Usage: replay <trace> [--replay-loops count] [--device name]");
+    }
+#endif
+    if (!options.recordFile.empty() && !options.replayFile.empty()) {
+        throw std::runtime_error("Cannot record and replay at the same time");
+    }
+    return options;
+}
 
+int main(int argc, char** argv) {
     try {
+#ifdef BENCHMARK
+        int result = runBenchmarks(argc, argv);
+        Logger::get().shutdown();
+        return result;
+#else
+        App app(parseOptions(argc, argv));
         app.run();
+#endif
     } catch (const std::exception& e) {
-        std::cerr << e.what() << std::endl;
+        LOG_ERROR(e.what());
+        Logger::get().shutdown();
         return EXIT_FAILURE;
     }
 
+    Logger::get().shutdown();
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}